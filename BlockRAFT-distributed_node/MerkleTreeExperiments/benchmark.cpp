@@ -0,0 +1,330 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "trieAdapter.h"
+
+using namespace std;
+
+// Scaling sweep over the tries behind TrieAdapter. Every combination of the
+// swept parameters is one run: preload the store so the measured phase has
+// keys to update, optionally drop the store from the page cache, then write
+// `keys` records in blocks and time insert and commit per block. Results go
+// to <out>.csv and <out>.json, rewritten after every run so a long sweep
+// keeps what it finished.
+struct SweepConfig {
+  vector<string> trees = {"globalState", "serialMerkleTree",
+                          "parallelMerkleTree"};
+  vector<size_t> keys = {10000, 100000};
+  vector<int> threads = {1, 4};
+  vector<double> updateRatios = {0.0, 0.5};
+  vector<size_t> valueSizes = {32, 256};
+  vector<string> caches = {"warm", "cold"};
+  size_t blockSize = 1000;
+  string dataDir = "benchmarkData";
+  string out = "benchmarkResults";
+};
+
+struct RunResult {
+  string tree;
+  size_t keys;
+  int threads;
+  double updateRatio;
+  size_t valueSize;
+  string cache;
+  double insertSeconds = 0;
+  double commitSeconds = 0;
+  double insertThroughput = 0;  // records/s over insert time only
+  double totalThroughput = 0;   // records/s over insert and commit
+  double commitP50 = 0, commitP95 = 0, commitP99 = 0;  // ms per block
+  uint64_t logicalBytes = 0;
+  uint64_t bytesWritten = 0;  // write() volume from /proc/self/io
+  uint64_t storageBytes = 0;  // bytes the kernel sent to the block layer
+  double writeAmplification = 0;
+  uint64_t peakRssKB = 0;
+  string rootHash;
+};
+
+// Reads "<field>: <value>" from a /proc/self file; 0 if absent
+uint64_t readProcField(const string& file, const string& field) {
+  ifstream in(file);
+  string line;
+  while (getline(in, line)) {
+    if (line.compare(0, field.size() + 1, field + ":") == 0) {
+      return stoull(line.substr(field.size() + 1));
+    }
+  }
+  return 0;
+}
+
+// Restarts VmHWM so each run reports its own peak
+void resetPeakRss() {
+  ofstream clearRefs("/proc/self/clear_refs");
+  if (clearRefs) clearRefs << "5";
+}
+
+// Writes the store's files back and evicts them from the page cache, so the
+// reopened store starts from disk. RocksDB's block cache goes with close().
+void dropPageCache(const string& path) {
+  error_code ec;
+  for (const auto& entry :
+       filesystem::recursive_directory_iterator(path, ec)) {
+    if (!entry.is_regular_file()) continue;
+    int fd = open(entry.path().c_str(), O_RDONLY);
+    if (fd < 0) continue;
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+  }
+}
+
+string randomValue(mt19937_64& rng, size_t size) {
+  static const char alphabet[] =
+      "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+  string value(size, 'a');
+  for (auto& c : value) c = alphabet[rng() % (sizeof(alphabet) - 1)];
+  return value;
+}
+
+// Keys are generated a block at a time so 10M-key runs do not hold the
+// whole workload in memory. Updates pick a random preloaded key.
+vector<Record> makeBlock(mt19937_64& rng, size_t count, size_t& nextKey,
+                         size_t preloaded, double updateRatio,
+                         size_t valueSize) {
+  bernoulli_distribution isUpdate(updateRatio);
+  vector<Record> block(count);
+  for (auto& record : block) {
+    size_t id = preloaded > 0 && isUpdate(rng) ? rng() % preloaded
+                                               : nextKey++;
+    record.address = "key" + to_string(id);
+    record.data = randomValue(rng, valueSize);
+  }
+  return block;
+}
+
+double percentile(vector<double> samples, double p) {
+  if (samples.empty()) return 0;
+  sort(samples.begin(), samples.end());
+  size_t rank = static_cast<size_t>(p * (samples.size() - 1) + 0.5);
+  return samples[min(rank, samples.size() - 1)];
+}
+
+RunResult runOne(const SweepConfig& config, const string& tree, size_t keys,
+                 int threads, double updateRatio, size_t valueSize,
+                 const string& cache) {
+  RunResult result{tree, keys, threads, updateRatio, valueSize, cache};
+  string path = config.dataDir + "/" + tree;
+  filesystem::remove_all(path);
+  filesystem::create_directories(config.dataDir);
+  auto trie = makeAdapter(tree, path);
+  mt19937_64 rng(42);
+
+  trie->open(true);
+  size_t preloaded = static_cast<size_t>(keys * updateRatio);
+  size_t nextKey = 0;
+  while (nextKey < preloaded) {
+    size_t count = min(config.blockSize, preloaded - nextKey);
+    auto block = makeBlock(rng, count, nextKey, 0, 0, valueSize);
+    trie->insert(block, threads);
+    trie->commit(block);
+  }
+  if (cache == "cold") {
+    trie->close();
+    dropPageCache(path);
+    trie->open(false);
+  }
+
+  resetPeakRss();
+  uint64_t wcharBefore = readProcField("/proc/self/io", "wchar");
+  uint64_t storageBefore = readProcField("/proc/self/io", "write_bytes");
+  vector<double> commitMs;
+  for (size_t written = 0; written < keys; written += config.blockSize) {
+    size_t count = min(config.blockSize, keys - written);
+    auto block = makeBlock(rng, count, nextKey, preloaded, updateRatio,
+                           valueSize);
+    for (const auto& record : block) {
+      result.logicalBytes += record.address.size() + record.data.size();
+    }
+
+    auto start = chrono::high_resolution_clock::now();
+    trie->insert(block, threads);
+    auto inserted = chrono::high_resolution_clock::now();
+    trie->commit(block);
+    auto committed = chrono::high_resolution_clock::now();
+    result.insertSeconds += chrono::duration<double>(inserted - start).count();
+    double commit = chrono::duration<double>(committed - inserted).count();
+    result.commitSeconds += commit;
+    commitMs.push_back(commit * 1000);
+  }
+  result.rootHash = trie->rootHash();
+  trie->close();
+
+  result.bytesWritten = readProcField("/proc/self/io", "wchar") - wcharBefore;
+  result.storageBytes =
+      readProcField("/proc/self/io", "write_bytes") - storageBefore;
+  result.peakRssKB = readProcField("/proc/self/status", "VmHWM");
+  result.insertThroughput =
+      result.insertSeconds > 0 ? keys / result.insertSeconds : 0;
+  double total = result.insertSeconds + result.commitSeconds;
+  result.totalThroughput = total > 0 ? keys / total : 0;
+  result.commitP50 = percentile(commitMs, 0.50);
+  result.commitP95 = percentile(commitMs, 0.95);
+  result.commitP99 = percentile(commitMs, 0.99);
+  result.writeAmplification =
+      result.logicalBytes > 0
+          ? static_cast<double>(result.bytesWritten) / result.logicalBytes
+          : 0;
+  filesystem::remove_all(path);
+  return result;
+}
+
+void writeResults(const string& out, const vector<RunResult>& results) {
+  ofstream csv(out + ".csv");
+  csv << "tree,keys,threads,updateRatio,valueSize,cache,insertSeconds,"
+         "commitSeconds,insertThroughput,totalThroughput,commitP50Ms,"
+         "commitP95Ms,commitP99Ms,logicalBytes,bytesWritten,storageBytes,"
+         "writeAmplification,peakRssKB,rootHash\n";
+  ofstream json(out + ".json");
+  json << "[\n";
+  csv << fixed << setprecision(4);
+  json << fixed << setprecision(4);
+  for (size_t i = 0; i < results.size(); ++i) {
+    const auto& r = results[i];
+    csv << r.tree << "," << r.keys << "," << r.threads << ","
+        << r.updateRatio << "," << r.valueSize << "," << r.cache << ","
+        << r.insertSeconds << "," << r.commitSeconds << ","
+        << r.insertThroughput << "," << r.totalThroughput << ","
+        << r.commitP50 << "," << r.commitP95 << "," << r.commitP99 << ","
+        << r.logicalBytes << "," << r.bytesWritten << "," << r.storageBytes
+        << "," << r.writeAmplification << "," << r.peakRssKB << ","
+        << r.rootHash << "\n";
+    json << "  {\"tree\": \"" << r.tree << "\", \"keys\": " << r.keys
+         << ", \"threads\": " << r.threads
+         << ", \"updateRatio\": " << r.updateRatio
+         << ", \"valueSize\": " << r.valueSize << ", \"cache\": \""
+         << r.cache << "\", \"insertSeconds\": " << r.insertSeconds
+         << ", \"commitSeconds\": " << r.commitSeconds
+         << ", \"insertThroughput\": " << r.insertThroughput
+         << ", \"totalThroughput\": " << r.totalThroughput
+         << ", \"commitP50Ms\": " << r.commitP50
+         << ", \"commitP95Ms\": " << r.commitP95
+         << ", \"commitP99Ms\": " << r.commitP99
+         << ", \"logicalBytes\": " << r.logicalBytes
+         << ", \"bytesWritten\": " << r.bytesWritten
+         << ", \"storageBytes\": " << r.storageBytes
+         << ", \"writeAmplification\": " << r.writeAmplification
+         << ", \"peakRssKB\": " << r.peakRssKB << ", \"rootHash\": \""
+         << r.rootHash << "\"}" << (i + 1 < results.size() ? "," : "")
+         << "\n";
+  }
+  json << "]\n";
+}
+
+template <typename T>
+vector<T> parseList(const string& list) {
+  vector<T> values;
+  stringstream ss(list);
+  string item;
+  while (getline(ss, item, ',')) {
+    if (item.empty()) continue;
+    T value;
+    stringstream(item) >> value;
+    values.push_back(value);
+  }
+  return values;
+}
+
+void printUsage() {
+  cerr << "Usage: benchmark [--trees=a,b] [--keys=n,...] [--threads=n,...]\n"
+          "  [--update-ratio=r,...] [--value-size=n,...] [--cache=warm,cold]\n"
+          "  [--block-size=n] [--data-dir=path] [--out=prefix]\n"
+          "  [--preset=scaling]  (keys 10k to 10M, threads 1 to cores)\n";
+}
+
+int main(int argc, char* argv[]) {
+  SweepConfig config;
+  for (int i = 1; i < argc; ++i) {
+    string arg = argv[i];
+    size_t eq = arg.find('=');
+    string flag = arg.substr(0, eq);
+    string value = eq == string::npos ? "" : arg.substr(eq + 1);
+    if (flag == "--trees") {
+      config.trees = parseList<string>(value);
+    } else if (flag == "--keys") {
+      config.keys = parseList<size_t>(value);
+    } else if (flag == "--threads") {
+      config.threads = parseList<int>(value);
+    } else if (flag == "--update-ratio") {
+      config.updateRatios = parseList<double>(value);
+    } else if (flag == "--value-size") {
+      config.valueSizes = parseList<size_t>(value);
+    } else if (flag == "--cache") {
+      config.caches = parseList<string>(value);
+    } else if (flag == "--block-size") {
+      config.blockSize = stoul(value);
+    } else if (flag == "--data-dir") {
+      config.dataDir = value;
+    } else if (flag == "--out") {
+      config.out = value;
+    } else if (flag == "--preset" && value == "scaling") {
+      config.keys = {10000, 100000, 1000000, 10000000};
+      config.threads.clear();
+      unsigned cores = max(1u, thread::hardware_concurrency());
+      for (unsigned t = 1; t <= cores; t *= 2) config.threads.push_back(t);
+    } else {
+      printUsage();
+      return 1;
+    }
+  }
+  for (const auto& tree : config.trees) {
+    if (!makeAdapter(tree, "")) {
+      cerr << "Unknown tree: " << tree << endl;
+      return 1;
+    }
+  }
+  if (config.blockSize == 0) {
+    printUsage();
+    return 1;
+  }
+
+  vector<RunResult> results;
+  for (const auto& tree : config.trees) {
+    for (size_t keys : config.keys) {
+      for (int threads : config.threads) {
+        // The serial tree has a single writer
+        if (tree == "serialMerkleTree" && threads != config.threads.front()) {
+          continue;
+        }
+        for (double ratio : config.updateRatios) {
+          for (size_t valueSize : config.valueSizes) {
+            for (const auto& cache : config.caches) {
+              RunResult r = runOne(config, tree, keys, threads, ratio,
+                                   valueSize, cache);
+              results.push_back(r);
+              writeResults(config.out, results);
+              cout << fixed << setprecision(2) << tree << " keys=" << keys
+                   << " threads=" << threads << " update=" << ratio
+                   << " value=" << valueSize << " " << cache << ": "
+                   << r.insertThroughput << " inserts/s, commit p99 "
+                   << r.commitP99 << " ms, WA " << r.writeAmplification
+                   << ", peak RSS " << r.peakRssKB << " kB" << endl;
+            }
+          }
+        }
+      }
+    }
+  }
+  cout << "Results written to " << config.out << ".csv and " << config.out
+       << ".json" << endl;
+  return 0;
+}
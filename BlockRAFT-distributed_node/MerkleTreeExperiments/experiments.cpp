@@ -169,6 +169,37 @@ void expThreadForAllFiles() {
   }
 }
 
+// Runs the parallel insert on the same synthetic keys with default RocksDB
+// options and with the shared storage profile.
+void expStorageProfile(int threadCount, size_t keyCount) {
+  vector<Record> records(keyCount);
+  for (size_t i = 0; i < keyCount; ++i) {
+    records[i] = {"address" + to_string(i), "data" + to_string(i)};
+  }
+
+  BOOST_LOG_TRIVIAL(info) << "Experiment for storage profile with "
+                          << keyCount << " keys:";
+  for (bool tuned : {false, true}) {
+    deleteRocksDB("merkleTree");
+    auto start = chrono::high_resolution_clock::now();
+    {
+      parallelMerkleTree parallelState("merkleTree", true, tuned);
+      for (const auto& rec : records) {
+        parallelState.updateValue(rec.address, rec.data);
+      }
+      parallelState.parallelInsertFromMap(threadCount);
+    }
+    auto end = chrono::high_resolution_clock::now();
+    chrono::duration<double> duration = end - start;
+
+    BOOST_LOG_TRIVIAL(info) << "Updated " << keyCount << " records with "
+                            << (tuned ? "storage profile" : "default options")
+                            << " using " << threadCount << " threads in "
+                            << duration.count() << " seconds.";
+  }
+  deleteRocksDB("merkleTree");
+}
+
 int main() {
   int threadCount = 4;
   int expRuns = 1;
@@ -192,6 +223,10 @@ int main() {
   for (int i = 0; i < expRuns; ++i) {
     expThreadForAllFiles();
   }
+  std::cout << "Running expStorageProfile" << endl;
+  for (int i = 0; i < expRuns; ++i) {
+    expStorageProfile(threadCount, 1000000);
+  }
 
   return 0;
 }
@@ -2,16 +2,20 @@
 #include <openssl/evp.h>
 #include <tbb/concurrent_hash_map.h>
 
+#include <algorithm>
+#include <array>
 #include <filesystem>
 #include <functional>
 #include <iomanip>
 #include <iostream>
+#include <mutex>
 #include <sstream>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
+#include "../merkleTree/storageProfile.h"
 #include "rocksdb/db.h"
 
 using namespace std;
@@ -25,13 +29,36 @@ class parallelMerkleTree {
   };
 
   rocksdb::DB* db;
+  vector<rocksdb::ColumnFamilyHandle*> families;  // empty for default layout
   string dbPath;
+  bool tuned;
   Node rootNode;
 
+  // Writers lock the stripe of each node they rewrite; children stay sorted
+  // so the root does not depend on insertion order.
+  static const size_t kInsertStripes = 256;
+  array<mutex, kInsertStripes> insertStripes;
+
+  mutex& stripeFor(const string& key) {
+    return insertStripes[std::hash<string>{}(key) % kInsertStripes];
+  }
+
+  static bool addChild(vector<string>& children, const string& child) {
+    if (find(children.begin(), children.end(), child) != children.end()) {
+      return false;
+    }
+    children.insert(lower_bound(children.begin(), children.end(), child),
+                    child);
+    return true;
+  }
+
  public:
   tbb::concurrent_hash_map<std::string, std::string> myMap;
-  parallelMerkleTree(const string& path = "merkleTree", bool fresh = false)
-      : db(nullptr), dbPath(path) {
+  // tuned opens the store with the shared storage profile and column
+  // family layout; otherwise it uses default options in one keyspace.
+  parallelMerkleTree(const string& path = "merkleTree", bool fresh = false,
+                     bool tuned = true)
+      : db(nullptr), dbPath(path), tuned(tuned) {
     if (fresh && filesystem::exists(dbPath)) {
       rocksdb::DestroyDB(dbPath, rocksdb::Options());
     }
@@ -40,9 +67,15 @@ class parallelMerkleTree {
     rootNode.children = {};
     rootNode.hash = computeHash(rootNode.value);
 
-    rocksdb::Options options;
-    options.create_if_missing = true;
-    rocksdb::Status status = rocksdb::DB::Open(options, dbPath, &db);
+    rocksdb::Status status;
+    if (tuned) {
+      status = rocksdb::DB::Open(profileDBOptions(), dbPath,
+                                 trieColumnFamilies(), &families, &db);
+    } else {
+      rocksdb::Options options;
+      options.create_if_missing = true;
+      status = rocksdb::DB::Open(options, dbPath, &db);
+    }
     if (!status.ok()) {
       throw runtime_error("Failed to open rocksDB at path: " + dbPath);
     }
@@ -57,8 +90,19 @@ class parallelMerkleTree {
     }
   }
 
-  ~parallelMerkleTree() {
-    if (db) delete db;
+  ~parallelMerkleTree() { closeDB(); }
+
+  void closeDB() {
+    if (!db) return;
+    for (auto* family : families) db->DestroyColumnFamilyHandle(family);
+    families.clear();
+    delete db;
+    db = nullptr;
+  }
+
+  rocksdb::ColumnFamilyHandle* familyFor(const string& key) {
+    if (families.empty()) return db->DefaultColumnFamily();
+    return families[trieFamilyOf(key)];
   }
 
   void updateValue(const string& key, const string& value) {
@@ -114,6 +158,8 @@ class parallelMerkleTree {
     pos = nextPos + 1;
     nextPos = data.find(',', pos);
     node.value = data.substr(pos, nextPos - pos);
+    // Leaves serialize as "hash,value" with no child list
+    if (nextPos == string::npos) return node;
     pos = nextPos + 1;
     while ((nextPos = data.find(',', pos)) != string::npos) {
       node.children.push_back(data.substr(pos, nextPos - pos));
@@ -155,7 +201,7 @@ class parallelMerkleTree {
 
     // Serially update parent hashes for all keys
     for (ConstIterator it = myMap.begin(); it != myMap.end(); ++it) {
-      this->updateParentHashes(it->first);
+      this->updateParentHashes(computeHash(it->first));
     }
   }
 
@@ -165,25 +211,27 @@ class parallelMerkleTree {
     Node newNode = {value, valueHash, {}};
     string serializedNode = serializeNode(newNode);
     rocksdb::Status status =
-        db->Put(rocksdb::WriteOptions(), keyHash, serializedNode);
+        db->Put(rocksdb::WriteOptions(), familyFor(keyHash), keyHash,
+                serializedNode);
     if (!status.ok()) return false;
     string currentHash = "";
     string parentKey = "";
     currentHash += keyHash[0];
-    Node root = getNode("rootNode");
-    if (find(root.children.begin(), root.children.end(), currentHash) ==
-        root.children.end()) {
-      root.children.push_back(currentHash);
-      db->Put(rocksdb::WriteOptions(), "rootNode", serializeNode(root));
+    {
+      lock_guard<mutex> lock(stripeFor("rootNode"));
+      Node root = getNode("rootNode");
+      if (addChild(root.children, currentHash)) {
+        db->Put(rocksdb::WriteOptions(), "rootNode", serializeNode(root));
+      }
     }
     for (size_t i = 1; i < keyHash.size(); ++i) {
-      Node parentNode = getNode(currentHash);
       parentKey = currentHash;
       currentHash += keyHash[i];
-      if (find(parentNode.children.begin(), parentNode.children.end(),
-               currentHash) == parentNode.children.end()) {
-        parentNode.children.push_back(currentHash);
-        db->Put(rocksdb::WriteOptions(), parentKey, serializeNode(parentNode));
+      lock_guard<mutex> lock(stripeFor(parentKey));
+      Node parentNode = getNode(parentKey);
+      if (addChild(parentNode.children, currentHash)) {
+        db->Put(rocksdb::WriteOptions(), familyFor(parentKey), parentKey,
+                serializeNode(parentNode));
       }
     }
     return true;
@@ -198,7 +246,8 @@ class parallelMerkleTree {
   Node getNode(const string& key) {
     string data;
     Node node = {"", "", {}};
-    rocksdb::Status status = db->Get(rocksdb::ReadOptions(), key, &data);
+    rocksdb::Status status =
+        db->Get(rocksdb::ReadOptions(), familyFor(key), key, &data);
     if (status.ok()) return deserializeNode(data);
     return node;
   }
@@ -232,7 +281,8 @@ class parallelMerkleTree {
 
         if (node.hash != newHash) {
           node.hash = newHash;
-          db->Put(rocksdb::WriteOptions(), currentKey, serializeNode(node));
+          db->Put(rocksdb::WriteOptions(), familyFor(currentKey), currentKey,
+                  serializeNode(node));
         }
 
         currentKey.pop_back();
@@ -261,8 +311,8 @@ class parallelMerkleTree {
       }
       combinedHash += currentNode.value;
       currentNode.hash = computeHash(combinedHash);
-      db->Put(rocksdb::WriteOptions(), currentHashKey,
-              serializeNode(currentNode));
+      db->Put(rocksdb::WriteOptions(), familyFor(currentHashKey),
+              currentHashKey, serializeNode(currentNode));
       currentHashKey.pop_back();
     }
     Node currentNode = getNode("rootNode");
@@ -275,36 +325,44 @@ class parallelMerkleTree {
     db->Put(rocksdb::WriteOptions(), "rootNode", serializeNode(currentNode));
   }
 
-  bool duplicateState(const string& targetPath = "globalState_tmp") {
-    rocksdb::Options options;
-    options.create_if_missing = true;
-
-    rocksdb::DB* newDb;
-    rocksdb::Status status = rocksdb::DB::Open(options, targetPath, &newDb);
-    if (!status.ok()) return false;
+  vector<rocksdb::ColumnFamilyHandle*> allFamilies() {
+    if (families.empty()) return {db->DefaultColumnFamily()};
+    return families;
+  }
 
-    rocksdb::Iterator* it = db->NewIterator(rocksdb::ReadOptions());
-    for (it->SeekToFirst(); it->Valid(); it->Next()) {
-      newDb->Put(rocksdb::WriteOptions(), it->key(), it->value());
+  bool duplicateState(const string& targetPath = "globalState_tmp") {
+    // The copy keeps this tree's layout so replaceWith() can reopen it
+    parallelMerkleTree copy(targetPath, false, tuned);
+    vector<rocksdb::ColumnFamilyHandle*> source = allFamilies();
+    vector<rocksdb::ColumnFamilyHandle*> target = copy.allFamilies();
+
+    bool success = true;
+    for (size_t i = 0; i < source.size(); ++i) {
+      rocksdb::Iterator* it =
+          db->NewIterator(rocksdb::ReadOptions(), source[i]);
+      for (it->SeekToFirst(); it->Valid(); it->Next()) {
+        copy.db->Put(rocksdb::WriteOptions(), target[i], it->key(),
+                     it->value());
+      }
+      success = success && it->status().ok();
+      delete it;
     }
-    bool success = it->status().ok();
-    delete it;
-    delete newDb;
     return success;
   }
 
   void resetTree() {
-    delete db;
+    closeDB();
     rocksdb::DestroyDB(dbPath, rocksdb::Options());
-    new (this) parallelMerkleTree(dbPath, true);  // Placement new to re-init
+    // Placement new to re-init
+    new (this) parallelMerkleTree(dbPath, true, tuned);
   }
 
   bool replaceWith(const string& sourcePath) {
-    delete db;
+    closeDB();
     rocksdb::DestroyDB(dbPath, rocksdb::Options());
     filesystem::remove_all(dbPath);
     filesystem::rename(sourcePath, dbPath);
-    new (this) parallelMerkleTree(dbPath, false);  // Reload
+    new (this) parallelMerkleTree(dbPath, false, tuned);  // Reload
     return true;
   }
 
@@ -313,20 +371,22 @@ class parallelMerkleTree {
     unordered_set<string> allNodes;
     unordered_set<string> leafNodes;
 
-    rocksdb::Iterator* it = db->NewIterator(rocksdb::ReadOptions());
-    for (it->SeekToFirst(); it->Valid(); it->Next()) {
-      string key = it->key().ToString();
-      Node node = deserializeNode(it->value().ToString());
-      allNodes.insert(key);
-      if (!node.children.empty()) {
-        for (const auto& child : node.children) {
-          parentToChildren[key].push_back(child);
+    for (auto* family : allFamilies()) {
+      rocksdb::Iterator* it = db->NewIterator(rocksdb::ReadOptions(), family);
+      for (it->SeekToFirst(); it->Valid(); it->Next()) {
+        string key = it->key().ToString();
+        Node node = deserializeNode(it->value().ToString());
+        allNodes.insert(key);
+        if (!node.children.empty()) {
+          for (const auto& child : node.children) {
+            parentToChildren[key].push_back(child);
+          }
+        } else {
+          leafNodes.insert(key);
         }
-      } else {
-        leafNodes.insert(key);
       }
+      delete it;
     }
-    delete it;
 
     // DFS post-order from root
     unordered_set<string> visited;
@@ -344,7 +404,8 @@ class parallelMerkleTree {
       combinedHash += node.value;
 
       node.hash = computeHash(combinedHash);
-      db->Put(rocksdb::WriteOptions(), key, serializeNode(node));
+      db->Put(rocksdb::WriteOptions(), familyFor(key), key,
+              serializeNode(node));
       return node.hash;
     };
 
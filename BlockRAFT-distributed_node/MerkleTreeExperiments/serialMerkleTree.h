@@ -106,6 +106,8 @@ class serialMerkleTree {
     pos = nextPos + 1;
     nextPos = data.find(',', pos);
     node.value = data.substr(pos, nextPos - pos);
+    // Leaves serialize as "hash,value" with no child list
+    if (nextPos == string::npos) return node;
     pos = nextPos + 1;
     while ((nextPos = data.find(',', pos)) != string::npos) {
       node.children.push_back(data.substr(pos, nextPos - pos));
@@ -129,7 +131,10 @@ class serialMerkleTree {
     Node root = getNode("rootNode");
     if (find(root.children.begin(), root.children.end(), currentHash) ==
         root.children.end()) {
-      root.children.push_back(currentHash);
+      // Sorted like parallelMerkleTree so both build the same root
+      root.children.insert(lower_bound(root.children.begin(),
+                                       root.children.end(), currentHash),
+                           currentHash);
       db->Put(rocksdb::WriteOptions(), "rootNode", serializeNode(root));
     }
     for (size_t i = 1; i < keyHash.size(); ++i) {
@@ -138,7 +143,10 @@ class serialMerkleTree {
       currentHash += keyHash[i];
       if (find(parentNode.children.begin(), parentNode.children.end(),
                currentHash) == parentNode.children.end()) {
-        parentNode.children.push_back(currentHash);
+        parentNode.children.insert(
+            lower_bound(parentNode.children.begin(),
+                        parentNode.children.end(), currentHash),
+            currentHash);
         db->Put(rocksdb::WriteOptions(), parentKey, serializeNode(parentNode));
       }
     }
@@ -85,6 +85,23 @@ TEST(GlobalStateTest, RetrieveAndVerifyTree) {
   EXPECT_EQ(state.getValue("key10"), "");
 }
 
+// Parallel insertion must give the same root as inserting one key at a time
+TEST(GlobalStateTest, ParallelInsertMatchesSerialRoot) {
+  parallelMerkleTree serialState("serialTree", true);
+  parallelMerkleTree parallelState("parallelTree", true);
+  for (int i = 0; i < 1000; ++i) {
+    std::string key = "key" + std::to_string(i);
+    std::string value = "value" + std::to_string(i);
+    serialState.insert(key, value);
+    parallelState.myMap.insert({key, value});
+  }
+  serialState.updateAllNonLeafHashes();
+  parallelState.parallelInsertFromMap(8);
+
+  EXPECT_EQ(parallelState.getRootHash(), serialState.getRootHash());
+  EXPECT_EQ(parallelState.getValue("key123"), "value123");
+}
+
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -0,0 +1,152 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../merkleTree/globalState.h"
+#include "parallelMerkleTree.h"
+#include "serialMerkleTree.h"
+
+using namespace std;
+
+struct Record {
+  string address;
+  string data;
+};
+
+// One interface over the three tries so the benchmark drives them with the
+// same workload. A block is written with insert() and made final with
+// commit(); tries that hash while inserting do nothing in commit().
+class TrieAdapter {
+ public:
+  explicit TrieAdapter(const string& path) : path(path) {}
+  virtual ~TrieAdapter() {}
+
+  virtual string name() const = 0;
+  // Opens the store at path; fresh drops what is there
+  virtual void open(bool fresh) = 0;
+  virtual void close() = 0;
+  virtual void insert(const vector<Record>& block, int threads) = 0;
+  virtual void commit(const vector<Record>& block) = 0;
+  virtual string rootHash() = 0;
+
+  const string path;
+
+ protected:
+  // Splits the block into one contiguous slice per writer thread
+  template <typename Fn>
+  static void forEachSlice(const vector<Record>& block, int threads, Fn fn) {
+    size_t chunk = (block.size() + threads - 1) / threads;
+    vector<thread> writers;
+    for (int t = 0; t < threads; ++t) {
+      size_t start = t * chunk;
+      size_t end = min(start + chunk, block.size());
+      if (start >= end) break;
+      writers.emplace_back([&, start, end]() {
+        for (size_t i = start; i < end; ++i) fn(block[i]);
+      });
+    }
+    for (auto& writer : writers) writer.join();
+  }
+};
+
+class GlobalStateAdapter : public TrieAdapter {
+ private:
+  unique_ptr<GlobalState> state;
+
+ public:
+  using TrieAdapter::TrieAdapter;
+
+  string name() const override { return "globalState"; }
+
+  void open(bool fresh) override {
+    state.reset();
+    state = make_unique<GlobalState>(path, fresh);
+  }
+
+  void close() override { state.reset(); }
+
+  void insert(const vector<Record>& block, int threads) override {
+    forEachSlice(block, threads, [this](const Record& record) {
+      state->insert(record.address, record.data);
+    });
+  }
+
+  void commit(const vector<Record>& block) override {
+    string keys;
+    for (const auto& record : block) keys += record.address + " ";
+    state->updateTree(keys);
+  }
+
+  string rootHash() override { return state->getRootHash(); }
+};
+
+// Single writer: insert() rehashes each key's path as it goes
+class SerialTreeAdapter : public TrieAdapter {
+ private:
+  unique_ptr<serialMerkleTree> tree;
+
+ public:
+  using TrieAdapter::TrieAdapter;
+
+  string name() const override { return "serialMerkleTree"; }
+
+  void open(bool fresh) override {
+    tree.reset();
+    tree = make_unique<serialMerkleTree>(path, fresh);
+  }
+
+  void close() override { tree.reset(); }
+
+  void insert(const vector<Record>& block, int) override {
+    for (const auto& record : block) tree->insert(record.address, record.data);
+  }
+
+  void commit(const vector<Record>&) override {}
+
+  string rootHash() override { return tree->getRootHash(); }
+};
+
+// Concurrent inserts, then one path rehash per key as in
+// parallelInsertFromMap()
+class ParallelTreeAdapter : public TrieAdapter {
+ private:
+  unique_ptr<parallelMerkleTree> tree;
+
+ public:
+  using TrieAdapter::TrieAdapter;
+
+  string name() const override { return "parallelMerkleTree"; }
+
+  void open(bool fresh) override {
+    tree.reset();
+    tree = make_unique<parallelMerkleTree>(path, fresh);
+  }
+
+  void close() override { tree.reset(); }
+
+  void insert(const vector<Record>& block, int threads) override {
+    forEachSlice(block, threads, [this](const Record& record) {
+      tree->insert(record.address, record.data);
+    });
+  }
+
+  void commit(const vector<Record>& block) override {
+    for (const auto& record : block) {
+      tree->updateParentHashes(tree->computeHash(record.address));
+    }
+  }
+
+  string rootHash() override { return tree->getRootHash(); }
+};
+
+inline unique_ptr<TrieAdapter> makeAdapter(const string& name,
+                                           const string& path) {
+  if (name == "globalState") return make_unique<GlobalStateAdapter>(path);
+  if (name == "serialMerkleTree") return make_unique<SerialTreeAdapter>(path);
+  if (name == "parallelMerkleTree") {
+    return make_unique<ParallelTreeAdapter>(path);
+  }
+  return nullptr;
+}
@@ -1,9 +1,13 @@
 #include <rdkafka.h>  // For Kafka producer (RedPanda)
 
+#include <atomic>
+#include <chrono>
 #include <future>
 #include <iostream>
+#include <memory>
 
 #include "../Crow/include/crow.h"
+#include "../merkleTree/globalState.h"
 #include "transaction.pb.h"  // Include the generated Protobuf header
 
 // A function to simulate submitting a serialized transaction to RedPanda
@@ -61,9 +65,98 @@ void submitTransactionToRedPanda(
   rd_kafka_destroy(rk);
 }
 
+// Serializes a proof for light clients; verification mirrors verifyProof
+// in merkleTree/merkleProof.h.
+crow::json::wvalue proofToJson(const MerkleProof& proof) {
+  crow::json::wvalue result;
+  result["rootHash"] = proof.rootHash;
+  std::vector<crow::json::wvalue> nodes;
+  for (const auto& [path, node] : proof.nodes) {
+    crow::json::wvalue entry;
+    entry["path"] = node.path;
+    entry["labels"] = node.labels;
+    entry["childHashes"] = node.childHashes;
+    entry["value"] = node.value;
+    nodes.push_back(std::move(entry));
+  }
+  result["nodes"] = std::move(nodes);
+  return result;
+}
+
+// Catches the secondary up with the node at most once per interval; requests
+// in between are served from the state it last caught up to.
+void catchUpThrottled(GlobalState& state,
+                      std::chrono::milliseconds interval =
+                          std::chrono::milliseconds(100)) {
+  static std::atomic<long long> lastCatchUp{0};
+  long long now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      std::chrono::steady_clock::now().time_since_epoch())
+                      .count();
+  long long last = lastCatchUp.load();
+  if (now - last < interval.count()) return;
+  if (lastCatchUp.compare_exchange_strong(last, now)) state.catchUp();
+}
+
+// Serves a proof, or 503 when a key's partition is not maintained on this
+// node under distributed commit
+crow::response proofResponse(GlobalState& state,
+                             const std::vector<std::string>& keys) {
+  try {
+    return crow::response{proofToJson(state.getMultiProof(keys))};
+  } catch (const std::runtime_error& e) {
+    return crow::response{503, e.what()};
+  }
+}
+
 int main() {
   crow::SimpleApp app;
 
+  // Proofs are served from a read-only secondary of the node's state
+  std::unique_ptr<GlobalState> state;
+  try {
+    state = std::make_unique<GlobalState>("globalState", false, true);
+  } catch (const std::exception& e) {
+    std::cerr << "State proofs disabled: " << e.what() << std::endl;
+  }
+
+  // Route to fetch the Merkle proof of a single key
+  CROW_ROUTE(app, "/api/state/proof/<string>")
+  ([&state](const std::string& key) {
+    if (!state) return crow::response{503, "State not available"};
+    catchUpThrottled(*state);
+    return proofResponse(*state, {key});
+  });
+
+  // Route to fetch one proof covering several keys: {"keys": [...]}
+  CROW_ROUTE(app, "/api/state/multiproof")
+      .methods("POST"_method)([&state](const crow::request& req) {
+        if (!state) return crow::response{503, "State not available"};
+        auto body = crow::json::load(req.body);
+        if (!body || !body.has("keys") ||
+            body["keys"].t() != crow::json::type::List) {
+          return crow::response{400, "Expected a JSON list of keys"};
+        }
+        std::vector<std::string> keys;
+        for (const auto& key : body["keys"]) keys.push_back(key.s());
+        catchUpThrottled(*state);
+        return proofResponse(*state, keys);
+      });
+
+  // Route to read a key as of a retained block
+  CROW_ROUTE(app, "/api/state/value/<string>/<int>")
+  ([&state](const std::string& key, int block) {
+    if (!state) return crow::response{503, "State not available"};
+    catchUpThrottled(*state);
+    std::string root = state->getRootHashAt(block);
+    if (root.empty()) return crow::response{404, "Block not retained"};
+    crow::json::wvalue result;
+    result["key"] = key;
+    result["block"] = block;
+    result["rootHash"] = root;
+    result["value"] = state->getValueAt(key, block);
+    return crow::response{result};
+  });
+
   // Route to handle smart contract transactions
   CROW_ROUTE(app, "/api/transaction")
       .methods("POST"_method)([](const crow::request& req) {
@@ -9,6 +9,7 @@
 #include <string>
 #include <vector>
 
+#include "../merkleTree/storageProfile.h"
 #include "block.pb.h"
 #include "rocksdb/db.h"
 #include "transaction.pb.h"
@@ -18,7 +19,7 @@ class blocksDB {
  public:
   // Constructor
   blocksDB() {
-    options.create_if_missing = true;
+    options = profileOptions();
     rocksdb::Status status = rocksdb::DB::Open(options, "blockDataBase", &db);
     assert(status.ok());
   }
@@ -58,6 +59,25 @@ class blocksDB {
     return status.ok();
   }
 
+  // Stores a committed block with the state root it produced, kept under
+  // "<blockID>:root" for replays to check against
+  bool storeBlock(const string &blockID, const std::string &blockData,
+                  const std::string &stateRoot) {
+    rocksdb::WriteBatch batch;
+    batch.Put(blockID, blockData);
+    batch.Put(blockID + ":root", stateRoot);
+    batch.Put("LatestBlock", blockID);
+    return db->Write(rocksdb::WriteOptions(), &batch).ok();
+  }
+
+  // State root stored with a committed block, "" when none was
+  string getStateRoot(const string &blockID) {
+    string stateRoot;
+    rocksdb::Status status =
+        db->Get(rocksdb::ReadOptions(), blockID + ":root", &stateRoot);
+    return status.ok() ? stateRoot : "";
+  }
+
   virtual bool storePendingBlock(const string &blockID,
                                  const std::string &blockData) {
     rocksdb::Status status =
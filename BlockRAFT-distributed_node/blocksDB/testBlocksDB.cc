@@ -72,6 +72,16 @@ TEST(BlocksDBTest, testingLatestBlockNum) {
   // Retrieve the latest block
   blocksDB db;
   EXPECT_EQ("B1", db.getLatestBlockNum());
+}
+
+// Test that a committed block is stored with its state root
+TEST(BlocksDBTest, StoresStateRoot) {
+  blocksDB db;
+  EXPECT_EQ("", db.getStateRoot("B1"));
+  EXPECT_TRUE(db.storeBlock("B2", "blockData", "rootAfterB2"));
+  EXPECT_EQ("blockData", db.getBlock("B2"));
+  EXPECT_EQ("rootAfterB2", db.getStateRoot("B2"));
+  EXPECT_EQ("B2", db.getLatestBlockNum());
   db.destroyDB();
 }
 
@@ -8,7 +8,11 @@
 #include <iostream>
 #include <string>
 #include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
+#include "../protos/protosUtils/compactEncoding.h"
 #include "block.pb.h"
 #include "components.pb.h"
 #include "matrix.pb.h"
@@ -29,6 +33,9 @@ class DAGmodule {
  public:
   vector<TransactionStruct> CurrentTransactions;
   vector<vector<int>> adjacencyMatrix;
+  // Followers given edge lists keep only the successors of the transactions
+  // they were assigned, instead of the matrix
+  vector<vector<int>> successors;
   unique_ptr<std::atomic<int>[]> inDegree;
   atomic<int> completedTxns{0}, lastTxn{0};  // Global atomic counter
   int totalTxns,
@@ -158,11 +165,17 @@ class DAGmodule {
     };
   
     // Treat graph as undirected for weak components
+    std::vector<std::pair<int, int>> edges;
     for (int i = 0; i < n; ++i) {
       for (int j = i + 1; j < n; ++j) {
-        if (adjacencyMatrix[i][j] || adjacencyMatrix[j][i]) {
-          unite(i, j);
+        if (adjacencyMatrix[i][j]) {
+          edges.emplace_back(i, j);
+        } else if (adjacencyMatrix[j][i]) {
+          edges.emplace_back(j, i);
+        } else {
+          continue;
         }
+        unite(i, j);
       }
     }
   
@@ -175,19 +188,25 @@ class DAGmodule {
   
     // Populate protobuf componentsTable
     int compID = 0;
+    std::unordered_map<int, components::componentsTable::component*> byRoot;
     for (const auto& [root, txnList] : componentsMap) {
       auto* comp = cTable.add_componentslist();
-  
-      for (int txn : txnList) {
-        auto* txnID = comp->add_transactionlist();
-        txnID->set_id(txn);
-      }
-  
+      encodeComponentTxns(txnList, comp, true);
       comp->set_compid(compID);
+      byRoot[root] = comp;
       compID++;
     }
+
+    // Ship each component's edges, so followers set up only their own
+    for (const auto& [from, to] : edges) {
+      auto* comp = byRoot[find(from)];
+      comp->add_edgefrom(from);
+      comp->add_edgeto(to);
+    }
   
     cTable.set_totalcomponents(compID);
+    cTable.set_edgelists(true);
+    cTable.set_version(kCompactProtoVersion);
     std::cout << "Total components: " << compID << std::endl;
     return cTable;
   }
@@ -209,10 +228,11 @@ class DAGmodule {
     }
   }
 
+  // Parses the block on a follower. The adjacency matrix is left to
+  // buildMatrix(), as components normally arrive with their edges.
   bool createfollower(Block block, int thCount) {
     int i;
     threadCount = thCount;
-    thread threads[threadCount];
 
     int position = 0;
     for (const auto& transaction : block.transactions()) {
@@ -221,34 +241,53 @@ class DAGmodule {
     }
     totalTxns = position;
     completedTxns = position;
-    adjacencyMatrix.resize(totalTxns, vector<int>(totalTxns, 0));
+    successors.assign(totalTxns, {});
     inDegree = unique_ptr<atomic<int>[]>(new atomic<int>[totalTxns]);
     for (i = 0; i < totalTxns; ++i) {
       inDegree[i].store(-1);  // Atomic store to set initial value to 0
     }
 
-    for (i = 0; i < threadCount; i++) {
-      threads[i] = thread(&DAGmodule::dependencyMatrix, this, i);
+    return true;
+  }
+
+  // Builds the whole adjacency matrix on a follower, for component tables
+  // published without edge lists
+  void buildMatrix() {
+    if (!adjacencyMatrix.empty()) return;
+    adjacencyMatrix.resize(totalTxns, vector<int>(totalTxns, 0));
+    vector<thread> threads;
+    for (int i = 0; i < threadCount; i++) {
+      threads.emplace_back(&DAGmodule::dependencyMatrix, this, i);
     }
-    for (i = 0; i < threadCount; i++) {
-      threads[i].join();
+    for (auto& t : threads) {
+      t.join();
     }
+  }
 
-    return true;
+  // Registers the successors of a component's transactions from its edge
+  // list and returns their in-degrees, in componentTxns() order. Costs time
+  // in the component's size, not the block's.
+  vector<int> loadComponent(
+      const components::componentsTable::component& component) {
+    unordered_map<int, int> predecessors;
+    for (int k = 0; k < component.edgefrom_size(); ++k) {
+      int from = component.edgefrom(k), to = component.edgeto(k);
+      successors[from].push_back(to);
+      predecessors[to]++;
+    }
+    vector<int> inDegrees;
+    for (int txn : componentTxns(component)) {
+      auto it = predecessors.find(txn);
+      inDegrees.push_back(it == predecessors.end() ? 0 : it->second);
+    }
+    return inDegrees;
   }
 
-  // Function to serialize adjacency matrix to DirectedGraph proto
-  std::string serializeDAG() {
+  // Function to serialize adjacency matrix to DirectedGraph proto, as
+  // edge lists when compact
+  std::string serializeDAG(bool compact = false) {
     matrix::DirectedGraph graphProto;
-    graphProto.set_num_nodes(adjacencyMatrix.size());
-
-    for (const auto& row : adjacencyMatrix) {
-      matrix::DirectedGraph::MatrixRow* matrixRow =
-          graphProto.add_adjacencymatrix();
-      for (int edge : row) {
-        matrixRow->add_edges(edge);
-      }
-    }
+    encodeMatrix(adjacencyMatrix, &graphProto, compact);
 
     // Serialize the protobuf message to a string
     std::string serializedData;
@@ -318,6 +357,10 @@ class DAGmodule {
     inDegree[txnID].fetch_sub(1);
     completedTxns++;
 
+    if (adjacencyMatrix.empty()) {
+      for (int next : successors[txnID]) inDegree[next].fetch_sub(1);
+      return;
+    }
     for (int i = txnID + 1; i < totalTxns; i++) {
       if (adjacencyMatrix[txnID][i] == 1) {
         inDegree[i].fetch_sub(1);
@@ -331,6 +374,7 @@ class DAGmodule {
 
     // Reset adjacency matrix
     adjacencyMatrix.clear();
+    successors.clear();
 
     // Reset inDegree pointer
     inDegree.reset();
@@ -150,7 +150,34 @@ TEST(DAGmoduleTest, ConnectedComponents) {
   // Validate results
   EXPECT_EQ(cTable.totalcomponents(), 1);
   EXPECT_EQ(cTable.componentslist_size(), 1);
-  EXPECT_EQ(cTable.componentslist(0).transactionlist_size(), 3);
+  EXPECT_EQ(componentTxns(cTable.componentslist(0)).size(), 3);
+}
+
+TEST(DAGmoduleTest, CompactEncodings) {
+  DAGmodule dag;
+  dag.adjacencyMatrix = {{0, 1, 0, 1}, {0, 0, 0, 1}, {0, 0, 0, 0},
+                         {0, 0, 0, 0}};
+
+  // Both graph versions decode to the same matrix, the compact one smaller
+  std::string dense = dag.serializeDAG(), compact = dag.serializeDAG(true);
+  EXPECT_LT(compact.size(), dense.size());
+  for (const std::string& serialized : {dense, compact}) {
+    matrix::DirectedGraph graph;
+    ASSERT_TRUE(graph.ParseFromString(serialized));
+    std::vector<std::vector<int>> decoded;
+    EXPECT_TRUE(decodeMatrix(graph, &decoded));
+    EXPECT_EQ(decoded, dag.adjacencyMatrix);
+  }
+
+  // Component members read the same from either version
+  std::vector<int> members = {7, 2, 40, 3};
+  components::componentsTable::component v1, v2;
+  encodeComponentTxns(members, &v1, false);
+  encodeComponentTxns(members, &v2, true);
+  EXPECT_EQ(v1.transactionlist_size(), 4);
+  EXPECT_EQ(v2.transactionlist_size(), 0);
+  EXPECT_EQ(componentTxns(v1), members);
+  EXPECT_EQ(componentTxns(v2), std::vector<int>({2, 3, 7, 40}));
 }
 
 TEST(DAGmoduleTest, SelectTxn) {
@@ -208,6 +235,46 @@ TEST(DAGmoduleTest, CompleteTransaction) {
   EXPECT_EQ(dag.inDegree[2].load(), 0);
 }
 
+TEST(DAGmoduleTest, ComponentEdgeLists) {
+  // 0 -> 1 -> 3 and 0 -> 3 form one component, 2 is on its own
+  Block block;
+  *block.add_transactions() = CreateMockTransaction({"A"}, {"B"});
+  *block.add_transactions() = CreateMockTransaction({"B"}, {"C"});
+  *block.add_transactions() = CreateMockTransaction({"X"}, {"Y"});
+  *block.add_transactions() = CreateMockTransaction({"C"}, {"B"});
+
+  DAGmodule leader;
+  leader.create(block, 2);
+  components::componentsTable cTable = leader.connectedComponents();
+  EXPECT_TRUE(cTable.edgelists());
+
+  // The follower never builds the matrix, yet gets the same in-degrees
+  DAGmodule follower;
+  follower.createfollower(block, 2);
+  EXPECT_TRUE(follower.adjacencyMatrix.empty());
+  int edges = 0;
+  for (const auto& component : cTable.componentslist()) {
+    edges += component.edgefrom_size();
+    vector<int> inDegrees = follower.loadComponent(component);
+    vector<int> txns = componentTxns(component);
+    for (int j = 0; j < (int)txns.size(); ++j) {
+      int txn = txns[j];
+      int sum = 0;
+      for (const auto& row : leader.adjacencyMatrix) sum += row[txn];
+      EXPECT_EQ(inDegrees[j], sum);
+      follower.inDegree[txn].store(inDegrees[j]);
+    }
+  }
+  EXPECT_EQ(edges, 3);
+
+  follower.complete(0);
+  EXPECT_EQ(follower.inDegree[1].load(), 0);
+  EXPECT_EQ(follower.inDegree[3].load(), 1);
+  follower.complete(1);
+  EXPECT_EQ(follower.inDegree[3].load(), 0);
+  EXPECT_EQ(follower.inDegree[2].load(), 0);
+}
+
 int main(int argc, char** argv) {
   testing::InitGoogleTest(&argc, argv);
   //  DAGmodule dag;
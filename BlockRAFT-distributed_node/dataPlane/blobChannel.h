@@ -0,0 +1,90 @@
+#pragma once
+#include <boost/log/trivial.hpp>
+#include <etcd/Client.hpp>
+#include <etcd/Response.hpp>
+#include <memory>
+#include <string>
+
+#include "../leader/etcdGlobals.h"
+#include "dataPlane.h"
+
+// Bulk values of the block protocol (the block, component tables, write
+// sets) go through here instead of straight into etcd. With the data plane
+// running, etcd only gets a BlobRef naming this node and the value's
+// digest, and readers stream the value from the publishing node; without
+// it values stay inline, so nodes with and without a data plane interoperate.
+
+// This node's data plane, or null when it is disabled
+inline std::unique_ptr<DataPlaneServer>& dataPlaneServer() {
+  static std::unique_ptr<DataPlaneServer> server;
+  return server;
+}
+
+// Starts the data plane on defaultDataPlanePort() unless it is disabled
+inline void startDataPlane() {
+  if (defaultDataPlanePort() < 0 || dataPlaneServer()) return;
+  dataPlaneServer() = std::make_unique<DataPlaneServer>(
+      static_cast<unsigned short>(defaultDataPlanePort()));
+  BOOST_LOG_TRIVIAL(info) << "Data plane listening on port "
+                          << dataPlaneServer()->port();
+}
+
+// Host other nodes reach this node's data plane at
+inline std::string dataPlaneHost() {
+  return node_ip.empty() ? "127.0.0.1" : node_ip;
+}
+
+// Whether ref names a blob this node's data plane serves
+inline bool servedHere(const BlobRef& ref) {
+  auto& server = dataPlaneServer();
+  return server && ref.host == dataPlaneHost() && ref.port == server->port();
+}
+
+// What etcd should hold for value under key: the value itself, or the
+// reference to it once it is served by this node's data plane
+inline std::string blobValue(const std::string& key, std::string value) {
+  auto& server = dataPlaneServer();
+  if (!server) return value;
+  return server->put(key, std::move(value), dataPlaneHost()).serialize();
+}
+
+// Publishes value under an etcd key
+inline etcd::Response publishBlob(const std::string& key, std::string value) {
+  return etcdClient.put(key, blobValue(key, std::move(value))).get();
+}
+
+// Turns what etcd holds under key, inline or a reference, into the value
+inline bool resolveBlob(const std::string& key, const std::string& stored,
+                        std::string* value) {
+  BlobRef ref;
+  if (!ref.parse(stored)) {
+    *value = stored;
+    return true;
+  }
+  if (servedHere(ref)) {
+    auto blob = dataPlaneServer()->find(ref.blobId(key));
+    if (blob) {
+      *value = *blob;
+      return true;
+    }
+  }
+  // One client, and so one connection per server, per fetching thread
+  thread_local DataPlaneClient client;
+  if (client.fetch(ref, key, value)) return true;
+  BOOST_LOG_TRIVIAL(error) << "Failed to fetch " << key << " from "
+                           << ref.host << ":" << ref.port;
+  return false;
+}
+
+// Reads a value published with publishBlob; false when missing
+inline bool readBlob(const std::string& key, std::string* value) {
+  etcd::Response response = etcdClient.get(key).get();
+  if (!response.is_ok()) return false;
+  return resolveBlob(key, response.value().as_string(), value);
+}
+
+// Drops what this node serves; call once the previous block is committed
+// everywhere, i.e. when the next one starts
+inline void retireBlobs(const std::string& prefix = "") {
+  if (dataPlaneServer()) dataPlaneServer()->retire(prefix);
+}
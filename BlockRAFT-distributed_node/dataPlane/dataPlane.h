@@ -0,0 +1,246 @@
+#pragma once
+#include <boost/asio.hpp>
+#include <atomic>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "../merkleTree/hashEngine.h"
+#include "../stateSync/stateSync.h"
+
+using namespace std;
+using boost::asio::ip::tcp;
+
+// TCP port of this node's data plane: -1 keeps bulk values (blocks, DAGs,
+// component tables, write sets) inline in etcd, 0 picks a free port.
+// node.cpp sets it from the "dataPlanePort" config key.
+inline int& defaultDataPlanePort() {
+  static int port = -1;
+  return port;
+}
+
+// What etcd holds in place of a blob served by a data plane: where to
+// fetch it and the size and sha256 to check it against. Serialized with a
+// leading NUL, which no serialized protobuf starts with (field 0 is
+// invalid), so readers tell references from inline values.
+struct BlobRef {
+  string host;
+  unsigned short port = 0;
+  size_t size = 0;
+  string digest;
+
+  static const char kMarker = '\0';
+
+  string serialize() const {
+    return string(1, kMarker) + "blob " + host + " " + to_string(port) +
+           " " + to_string(size) + " " + digest;
+  }
+
+  // Name of the value under key on the server
+  string blobId(const string& key) const { return key + "@" + digest; }
+
+  static bool isRef(const string& value) {
+    return !value.empty() && value[0] == kMarker;
+  }
+
+  bool parse(const string& value) {
+    if (!isRef(value)) return false;
+    istringstream in(value.substr(1));
+    string tag;
+    return in >> tag >> host >> port >> size >> digest && tag == "blob";
+  }
+};
+
+// Serves published blobs by key to other nodes. Each client connection is
+// a sequence of requests, one key per frame, answered with the blob in
+// frames of up to 1 MiB followed by an empty frame ("" alone when the key
+// is unknown); an empty request ends the connection. Connections are
+// served on their own threads, and the blocking writes leave flow control
+// to TCP: a slow reader stalls only its own connection.
+class DataPlaneServer {
+ private:
+  boost::asio::io_context io;
+  tcp::acceptor acceptor;
+  thread acceptThread;
+  atomic<bool> stopping{false};
+  mutex blobsMutex;
+  map<string, shared_ptr<const string>> blobs;
+  struct Connection {
+    shared_ptr<tcp::socket> socket;
+    shared_ptr<atomic<bool>> done;
+    thread serving;
+  };
+  mutex connectionsMutex;
+  vector<Connection> connections;
+
+  static const size_t kChunk = 1 << 20;
+
+  void serve(shared_ptr<tcp::socket> socket, shared_ptr<atomic<bool>> done) {
+    try {
+      for (string key; !(key = readFrame(*socket)).empty();) {
+        // Held for the whole transfer, so retiring the key meanwhile is safe
+        shared_ptr<const string> blob = find(key);
+        if (blob) {
+          for (size_t offset = 0; offset < blob->size(); offset += kChunk) {
+            writeFrame(*socket, blob->substr(offset, kChunk));
+          }
+        }
+        writeFrame(*socket, "");
+      }
+    } catch (const exception&) {
+      // The client went away or the server is stopping
+    }
+    done->store(true);
+  }
+
+  // Joins the threads of connections their clients closed
+  void reap() {
+    for (auto it = connections.begin(); it != connections.end();) {
+      if (!it->done->load()) {
+        ++it;
+        continue;
+      }
+      it->serving.join();
+      it = connections.erase(it);
+    }
+  }
+
+  void acceptLoop() {
+    while (true) {
+      auto socket = make_shared<tcp::socket>(io);
+      boost::system::error_code ec;
+      acceptor.accept(*socket, ec);
+      if (stopping.load()) return;
+      if (ec) continue;
+      lock_guard<mutex> lock(connectionsMutex);
+      reap();
+      auto done = make_shared<atomic<bool>>(false);
+      connections.push_back(
+          {socket, done, thread(&DataPlaneServer::serve, this, socket, done)});
+    }
+  }
+
+ public:
+  explicit DataPlaneServer(unsigned short port)
+      : acceptor(io, tcp::endpoint(tcp::v4(), port)) {
+    acceptThread = thread(&DataPlaneServer::acceptLoop, this);
+  }
+
+  ~DataPlaneServer() { stop(); }
+
+  unsigned short port() const { return acceptor.local_endpoint().port(); }
+
+  // The blob stored under a blobId, null when unknown
+  shared_ptr<const string> find(const string& key) {
+    lock_guard<mutex> lock(blobsMutex);
+    auto it = blobs.find(key);
+    return it == blobs.end() ? nullptr : it->second;
+  }
+
+  // Makes data fetchable under key and returns its reference. Blobs are
+  // stored per digest, so a reader holding the reference of an earlier
+  // value of key (a component table republished after a failover) still
+  // gets the value it asked for.
+  BlobRef put(const string& key, string data, const string& host) {
+    BlobRef ref{host, port(), data.size(), HashEngine::hash(data)};
+    auto blob = make_shared<const string>(move(data));
+    lock_guard<mutex> lock(blobsMutex);
+    blobs[ref.blobId(key)] = move(blob);
+    return ref;
+  }
+
+  // Drops the blobs whose keys start with prefix, e.g. a finished block's
+  void retire(const string& prefix) {
+    lock_guard<mutex> lock(blobsMutex);
+    auto it = blobs.lower_bound(prefix);
+    while (it != blobs.end() &&
+           it->first.compare(0, prefix.size(), prefix) == 0) {
+      it = blobs.erase(it);
+    }
+  }
+
+  size_t size() {
+    lock_guard<mutex> lock(blobsMutex);
+    return blobs.size();
+  }
+
+  // Closes every connection and waits for the serving threads
+  void stop() {
+    if (stopping.exchange(true)) return;
+    // A connection of our own wakes the blocking accept()
+    boost::system::error_code ec;
+    tcp::socket wake(io);
+    wake.connect(
+        tcp::endpoint(boost::asio::ip::address_v4::loopback(), port()), ec);
+    acceptThread.join();
+    acceptor.close(ec);
+    lock_guard<mutex> lock(connectionsMutex);
+    for (auto& connection : connections) {
+      connection.socket->shutdown(tcp::socket::shutdown_both, ec);
+      connection.serving.join();
+    }
+    connections.clear();
+  }
+};
+
+// Fetches blobs from data plane servers, keeping one connection per server
+// for the blocks that follow.
+class DataPlaneClient {
+ private:
+  boost::asio::io_context io;
+  map<string, unique_ptr<tcp::socket>> connections;
+
+  tcp::socket& connectionTo(const BlobRef& ref) {
+    string address = ref.host + ":" + to_string(ref.port);
+    auto& socket = connections[address];
+    if (!socket) {
+      auto fresh = make_unique<tcp::socket>(io);
+      tcp::resolver resolver(io);
+      boost::asio::connect(*fresh,
+                           resolver.resolve(ref.host, to_string(ref.port)));
+      socket = move(fresh);
+    }
+    return *socket;
+  }
+
+ public:
+  ~DataPlaneClient() {
+    for (auto& [address, socket] : connections) {
+      try {
+        writeFrame(*socket, "");
+      } catch (const exception&) {
+      }
+    }
+  }
+
+  // Fetches key from the server ref names and checks it against ref
+  bool fetch(const BlobRef& ref, const string& key, string* data) {
+    for (int attempt = 0; attempt < 2; ++attempt) {
+      try {
+        tcp::socket& socket = connectionTo(ref);
+        writeFrame(socket, ref.blobId(key));
+        data->clear();
+        data->reserve(ref.size);
+        for (string chunk; !(chunk = readFrame(socket)).empty();) {
+          *data += chunk;
+        }
+        return data->size() == ref.size &&
+               HashEngine::hash(*data) == ref.digest;
+      } catch (const exception& e) {
+        // A connection kept from an earlier block may have gone stale
+        connections.erase(ref.host + ":" + to_string(ref.port));
+        if (attempt == 1) {
+          cerr << "Data plane fetch of " << key << " failed: " << e.what()
+               << endl;
+        }
+      }
+    }
+    return false;
+  }
+};
@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "addressList.pb.h"
+#include "dataPlane.h"
+
+// Test that references round-trip and are told apart from protobufs
+TEST(DataPlaneTest, BlobRefs) {
+  BlobRef ref{"127.0.0.1", 7000, 42, "abc"};
+  BlobRef parsed;
+  ASSERT_TRUE(parsed.parse(ref.serialize()));
+  EXPECT_EQ(parsed.host, "127.0.0.1");
+  EXPECT_EQ(parsed.port, 7000);
+  EXPECT_EQ(parsed.size, 42);
+  EXPECT_EQ(parsed.digest, "abc");
+
+  addressList::AddressValueList list;
+  auto* pair = list.add_pairs();
+  pair->set_address("alice");
+  pair->set_value("10");
+  std::string serialized;
+  list.SerializeToString(&serialized);
+  EXPECT_FALSE(BlobRef::isRef(serialized));
+  EXPECT_FALSE(BlobRef::isRef(""));
+}
+
+// Test that blobs stream in chunks, are checked, and can be retired
+TEST(DataPlaneTest, StreamsBlobs) {
+  DataPlaneServer server(0);
+  std::string block(3 * (1 << 20) + 17, 'b');
+  for (size_t i = 0; i < block.size(); i += 4096) block[i] = char(i);
+  BlobRef blockRef = server.put("s0/1/4/block", block, "127.0.0.1");
+  BlobRef small = server.put("s0/1/4/data/s1", "writes", "127.0.0.1");
+
+  DataPlaneClient client;
+  std::string data;
+  ASSERT_TRUE(client.fetch(blockRef, "s0/1/4/block", &data));
+  EXPECT_EQ(data, block);
+  ASSERT_TRUE(client.fetch(small, "s0/1/4/data/s1", &data));
+  EXPECT_EQ(data, "writes");
+
+  // A republished key keeps serving the value each reference names
+  BlobRef updated = server.put("s0/1/4/data/s1", "rewritten", "127.0.0.1");
+  ASSERT_TRUE(client.fetch(small, "s0/1/4/data/s1", &data));
+  EXPECT_EQ(data, "writes");
+  ASSERT_TRUE(client.fetch(updated, "s0/1/4/data/s1", &data));
+  EXPECT_EQ(data, "rewritten");
+
+  // A reference whose digest does not match fails
+  BlobRef forged = small;
+  forged.size = 9;
+  EXPECT_FALSE(client.fetch(forged, "s0/1/4/data/s1", &data));
+
+  server.retire("s0/1/4/");
+  EXPECT_EQ(server.size(), 0);
+  EXPECT_FALSE(client.fetch(blockRef, "s0/1/4/block", &data));
+  server.stop();
+}
+
+// Test that a client reconnects after its server was restarted
+TEST(DataPlaneTest, ReconnectsAfterRestart) {
+  DataPlaneClient client;
+  std::string data;
+  unsigned short port;
+  {
+    DataPlaneServer first(0);
+    port = first.port();
+    BlobRef ref = first.put("k", "one", "127.0.0.1");
+    ASSERT_TRUE(client.fetch(ref, "k", &data));
+  }
+  DataPlaneServer second(port);
+  BlobRef ref = second.put("k", "two", "127.0.0.1");
+  ASSERT_TRUE(client.fetch(ref, "k", &data));
+  EXPECT_EQ(data, "two");
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
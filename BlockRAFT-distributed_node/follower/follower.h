@@ -8,6 +8,9 @@
 #include <etcd/Response.hpp>
 #include <etcd/Watcher.hpp>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <nlohmann/json.hpp>
 #include <sstream>
 #include <string>
@@ -17,8 +20,14 @@
 #include "../blockProducer/blockProducer.h"
 #include "../blocksDB/blocksDB.h"
 #include "../dagModule/DAGmodule.h"
+#include "../dataPlane/blobChannel.h"
+#include "../leader/componentProgress.h"
+#include "../leader/controlTxn.h"
 #include "../leader/etcdGlobals.h"
+#include "../leader/healthMonitor.h"
+#include "../leader/prefixWatch.h"
 #include "../merkleTree/globalState.h"
+#include "../merkleTree/snapshots.h"
 #include "../scheduler/scheduler.h"
 
 using namespace std;
@@ -29,14 +38,23 @@ class follower {
  public:
   string Leader;
   GlobalState state;
-  GlobalState tmp;
   scheduler Scheduler;
 
-  follower() : tmp("globalState_tmp"), Scheduler(tmp) {
-    // Duplicate the state into tmp DB
-    state.duplicateState("globalState_tmp");
-  }
-  atomic<int> stopWatcher;
+  // One follower serves block after block: the state handle, scheduler
+  // and leader watch are kept, and startBlock resets only per-block state.
+  // The watches are declared after the scheduler, so they are cancelled
+  // before what their callbacks use is destroyed.
+  std::mutex leaderMutex;
+  std::unique_ptr<etcd::Watcher> leaderWatch, componentsWatch;
+
+  // Execution reads the committed state directly; the block's writes are
+  // staged in the state overlay and committed or discarded in startBlock.
+  follower() : Scheduler(state) {}
+
+  // Block committed by the last startBlock, -1 if it committed none, and
+  // the state root it produced
+  int committedBlock = -1;
+  std::string committedRoot;
 
   // 1. Leader and BLock Management functions :
 
@@ -51,6 +69,7 @@ class follower {
         return "";
       }
 
+      std::lock_guard<std::mutex> lock(leaderMutex);
       Leader = response.value().as_string();
       return Leader;
     } catch (const std::exception& e) {
@@ -183,16 +202,21 @@ class follower {
 
   void watchComponentChanges(const std::string& leader_id,
                              const std::string& term_no, int block_num) {
-    std::string components_key = leader_id + "/" + term_no + "/" +
-                                 std::to_string(block_num) + "/components";
-
-    etcd::Watcher watcher(
-        etcdClient, components_key, [this, block_num](etcd::Response response) {
-          if (response.is_ok() && response.action() == "set") {
-            std::string new_components_data = response.value().as_string();
-
+    std::string blockPath =
+        leader_id + "/" + term_no + "/" + std::to_string(block_num);
+    std::string components_key = blockPath + "/components";
+
+    componentsWatch = std::make_unique<etcd::Watcher>(
+        etcdClient, components_key,
+        [this, blockPath, components_key](etcd::Response response) {
+          std::string new_components_data;
+          if (response.is_ok() && response.action() == "set" &&
+              resolveBlob(components_key, response.value().as_string(),
+                          &new_components_data)) {
             int nodeNum = stoi(node_id.substr(1));
-            Scheduler.ExtractNewComponents(new_components_data, nodeNum);
+            // Components their previous owner published are not rerun
+            Scheduler.ExtractNewComponents(new_components_data, nodeNum,
+                                           completedComponents(blockPath));
 
           } else {
             BOOST_LOG_TRIVIAL(error) << "Error watching component changes: "
@@ -210,16 +234,12 @@ class follower {
         leader_id + "/" + term_no + "/" + std::to_string(block_num) + "/DAG";
 
     try {
-      etcd::Response response = etcdClient.get(dag_key).get();
-
-      if (!response.is_ok()) {
-        BOOST_LOG_TRIVIAL(error)
-            << "Error retrieving DAG data: " << response.error_message();
+      std::string dag_data;
+      if (!readBlob(dag_key, &dag_data)) {
+        BOOST_LOG_TRIVIAL(error) << "Error retrieving DAG data: " << dag_key;
         return;
       }
 
-      std::string dag_data = response.value().as_string();
-
       // Extract the DAG using the scheduler
       Scheduler.extractDAG(dag_data);
       if (Scheduler.dag.totalTxns > 0) {
@@ -240,15 +260,12 @@ class follower {
                                  std::to_string(block_num) + "/components";
 
     try {
-      etcd::Response response = etcdClient.get(components_key).get();
-
-      if (!response.is_ok()) {
+      std::string serialized_data;
+      if (!readBlob(components_key, &serialized_data)) {
         BOOST_LOG_TRIVIAL(error)
-            << "Error retrieving components: " << response.error_message();
+            << "Error retrieving components: " << components_key;
         return;
       }
-
-      std::string serialized_data = response.value().as_string();
       // deserializeAndPrintComponents(serialized_data);
 
       // Use scheduler's ExtractComponents method
@@ -268,15 +285,11 @@ class follower {
         leader_id + "/" + term_no + "/" + std::to_string(block_num) + "/block";
 
     try {
-      etcd::Response response = etcdClient.get(block_key).get();
-
-      if (!response.is_ok()) {
-        BOOST_LOG_TRIVIAL(error)
-            << "Error retrieving block: " << response.error_message();
+      std::string block_data;
+      if (!readBlob(block_key, &block_data)) {
+        BOOST_LOG_TRIVIAL(error) << "Error retrieving block: " << block_key;
       }
 
-      std::string block_data = response.value().as_string();
-
       Scheduler.extractBlock(block_data);
       return block_data;
 
@@ -326,55 +339,126 @@ class follower {
       return false;
     }
   }
+  // Stops execution when CurrentLeader is deleted or moves away from the
+  // leader getLeaderID() last read. One watch serves every block.
   void watchLeaderCrash() {
+    if (leaderWatch) return;
     std::string watch_key = "CurrentLeader";
-    std::string initial_leader = Leader;
 
     BOOST_LOG_TRIVIAL(info)
         << "Watching for leader crash on key: " << watch_key;
 
-    std::thread([this, watch_key, initial_leader]() {
-      etcd::Watcher watcher(
-          etcdClient, watch_key,
-          [this, initial_leader](etcd::Response response) {
-            if (!response.is_ok()) {
-              BOOST_LOG_TRIVIAL(error)
-                  << "Leader watch failed: " << response.error_message();
-              return;
-            }
+    leaderWatch = std::make_unique<etcd::Watcher>(
+        etcdClient, watch_key, [this](etcd::Response response) {
+          if (!response.is_ok()) {
+            BOOST_LOG_TRIVIAL(error)
+                << "Leader watch failed: " << response.error_message();
+            return;
+          }
 
-            if (response.action() == "delete") {
-              BOOST_LOG_TRIVIAL(info)
-                  << "Leader crashed or stepped down! Stopping execution.";
-              Scheduler.flag.store(false);
-              leaderCrashed.store(true);
-              return;
-            }
+          if (response.action() == "delete") {
+            BOOST_LOG_TRIVIAL(info)
+                << "Leader crashed or stepped down! Stopping execution.";
+            Scheduler.flag.store(false);
+            leaderCrashed.store(true);
+            return;
+          }
 
-            std::string new_leader = response.value().as_string();
-            if (new_leader != initial_leader) {
-              BOOST_LOG_TRIVIAL(info)
-                  << "Leader changed from " << initial_leader << " to "
-                  << new_leader << ". Stopping execution.";
-              Scheduler.flag.store(false);
-              leaderCrashed.store(true);
-              return;
-            }
-          });
+          std::string new_leader = response.value().as_string();
+          std::lock_guard<std::mutex> lock(leaderMutex);
+          if (new_leader != Leader) {
+            BOOST_LOG_TRIVIAL(info)
+                << "Leader changed from " << Leader << " to " << new_leader
+                << ". Stopping execution.";
+            Scheduler.flag.store(false);
+            leaderCrashed.store(true);
+          }
+        });
+  }
 
-      // Instead of fixed sleep, poll stop flag
-      while (!stopWatcher.load()) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  // Restores the newest local snapshot and replays the blocks blocksDB
+  // holds after it, instead of re-executing the chain from genesis. Each
+  // block is replayed in the overlay and kept only if it reaches the state
+  // root stored with it. Returns the block the state is at, -1 without a
+  // usable snapshot.
+  int bootFromSnapshot(blocksDB& db) {
+    SnapshotStore snapshots;
+    SnapshotManifest manifest;
+    if (!snapshots.latest(&manifest)) return -1;
+    std::string blockId = "B" + std::to_string(manifest.block);
+    if (HashEngine::hash(db.getBlock(blockId)) != manifest.blockHash) {
+      BOOST_LOG_TRIVIAL(error)
+          << "Snapshot of block " << manifest.block
+          << " does not match the stored chain";
+      return -1;
+    }
+    if (!snapshots.restore(state, manifest.block)) {
+      BOOST_LOG_TRIVIAL(error)
+          << "Failed to restore snapshot of block " << manifest.block;
+      return -1;
+    }
+
+    std::string latestId = db.getLatestBlockNum();
+    int latest = manifest.block;
+    if (latestId.size() > 1 && latestId[0] == 'B') {
+      latest = std::stoi(latestId.substr(1));
+    }
+    int block_num = manifest.block;
+    while (block_num < latest) {
+      Block block;
+      if (!block.ParseFromString(
+              db.getBlock("B" + std::to_string(block_num + 1)))) {
+        break;
+      }
+      std::vector<std::pair<std::string, std::string>> writes;
+      if (!Scheduler.replayBlock(block, writes)) {
+        BOOST_LOG_TRIVIAL(error)
+            << "Failed to replay block " << block_num + 1;
+        break;
+      }
+      state.beginOverlay();
+      std::string keys;
+      for (const auto& [key, value] : writes) {
+        state.insert(key, value);
+        keys += key + " ";
       }
-    }).detach();
+      state.updateTree(keys);
+
+      std::string root = db.getStateRoot("B" + std::to_string(block_num + 1));
+      if (root.empty() || root != state.getRootHash()) {
+        BOOST_LOG_TRIVIAL(error)
+            << "State root differs after replaying block " << block_num + 1;
+        state.discardOverlay();
+        break;
+      }
+      if (!state.commitOverlay()) {
+        BOOST_LOG_TRIVIAL(error)
+            << "Failed to commit replayed block " << block_num + 1;
+        break;
+      }
+      ++block_num;
+      state.commitVersion(block_num);
+    }
+    BOOST_LOG_TRIVIAL(info) << "Booted from snapshot of block "
+                            << manifest.block << ", replayed "
+                            << block_num - manifest.block << " blocks";
+    return block_num;
   }
 
   string startBlock(const std::string& leader_id, const std::string& term_no,
                     int block_num, int thCount, int clusterSize) {
-    
-    stopWatcher.store(false);  // Reset before starting
+    // The previous block's watch and scheduler state go first
+    committedBlock = -1;
+    componentsWatch.reset();
+    Scheduler.resetBlock();
+    // A leader change seen since the block was picked still stops it
+    if (leaderCrashed.load()) Scheduler.flag.store(false);
+    // Dynamic claims go away with this node's heartbeat
+    Scheduler.claimLease = healthMonitor().lease();
+    // The leader committed the previous block before starting this one
+    retireBlobs();
     // cout << "follower started: "<<leader_id<<" "<<term_no<<" "<<block_num<<endl;
-    watchLeaderCrash();  // Start watching
+    watchLeaderCrash();  // Start watching, once
     auto start = std::chrono::high_resolution_clock::now();
     string serializedBlock = readBlock(leader_id, term_no, block_num);
     BOOST_LOG_TRIVIAL(info) << "dag is created";
@@ -383,12 +467,15 @@ class follower {
     if (Scheduler.dag.totalTxns <= 0 || Scheduler.dag.totalTxns > 10000) {
       BOOST_LOG_TRIVIAL(error) << "Error: Invalid DAG transaction count: "
                                << Scheduler.dag.totalTxns;
-      stopWatcher.store(true);  // Stop watcher early
       return "";
     }
+    state.beginOverlay();
     try {
       getComponents(leader_id, term_no, block_num);
 
+      auto preS = std::chrono::high_resolution_clock::now();
+      Scheduler.prefetchReadSet(thCount);
+
       auto exeS = std::chrono::high_resolution_clock::now();
 
       watchComponentChanges(leader_id, term_no, block_num);
@@ -400,24 +487,49 @@ class follower {
                                     .get();
       if (!flag) {
         BOOST_LOG_TRIVIAL(error) << "Execution failed";
+        state.discardOverlay();
         return serializedBlock;
       }
       if (flag && response.value().as_string() == "1") {
-        saveData(leader_id + "/" + term_no + "/" + std::to_string(block_num),
-                 clusterSize);
+        std::string blockPath =
+            leader_id + "/" + term_no + "/" + std::to_string(block_num);
+        if (defaultCommitMode() == "distributed") {
+          if (!saveDataDistributed(blockPath, term_no)) return serializedBlock;
+        } else {
+          saveData(blockPath);
+        }
+        committedBlock = block_num;
+        committedRoot = state.getRootHash();
+        if (!state.commitVersion(block_num)) {
+          BOOST_LOG_TRIVIAL(error)
+              << "Failed to version state for block " << block_num;
+        }
+        if (!snapshotIfDue(state, block_num, serializedBlock)) {
+          BOOST_LOG_TRIVIAL(error)
+              << "Failed to snapshot state at block " << block_num;
+        }
+        AddressFilter::Stats filter = state.addressFilterStats();
+        BOOST_LOG_TRIVIAL(info)
+            << "Address filter: " << filter.skipped << " lookups skipped, "
+            << filter.falsePositives << " false positives (rate "
+            << filter.falsePositiveRate() << "), " << filter.keys << " keys";
 
       } else {
-        state.resetTree();
+        state.discardOverlay();
       }
 
       // db.storeBlock("B" + to_string(header.block_num()), serializedBlock);
-      stopWatcher.store(true);
       auto end = std::chrono::high_resolution_clock::now();
       auto dura3 =
-          std::chrono::duration_cast<std::chrono::milliseconds>(exeS - start)
+          std::chrono::duration_cast<std::chrono::milliseconds>(preS - start)
               .count();
       BOOST_LOG_TRIVIAL(info)
           << "Time for geting DAG and block: " << dura3 << " ms";
+      auto duraPre =
+          std::chrono::duration_cast<std::chrono::milliseconds>(exeS - preS)
+              .count();
+      BOOST_LOG_TRIVIAL(info)
+          << "Time for prefetching read set: " << duraPre << " ms";
       auto dura4 =
           std::chrono::duration_cast<std::chrono::milliseconds>(exeE - exeS)
               .count();
@@ -434,6 +546,7 @@ class follower {
     } catch (const std::exception& e) {
       BOOST_LOG_TRIVIAL(error)
           << "Exception during block execution: " << e.what();
+      state.discardOverlay();
     }
     return serializedBlock;
   }
@@ -442,7 +555,7 @@ class follower {
     components::componentsTable table;
     if (table.ParseFromString(binaryData)) {
       for (const auto& comp : table.componentslist()) {
-        for (const auto& txn : comp.transactionlist()) {
+        for (int txn : componentTxns(comp)) {
         }
       }
     } else {
@@ -462,58 +575,113 @@ class follower {
     }
   }
 
-  std::string fetchAndParseKeys(const std::string& path, int i,
-                                GlobalState& tmp) {
-    std::string etcdKey = path + "/data/s" + std::to_string(i);
-    etcd::Response response = etcdClient.get(etcdKey).get();
-
-    if (!response.is_ok()) {
-      BOOST_LOG_TRIVIAL(error)
-          << "Failed to fetch data from etcd at: " << etcdKey;
-      return "";
+  // Applies every component's write set to the overlay and commits it in
+  // one batch, so the cost is proportional to the block's writes.
+  void saveData(const std::string& path) {
+    std::string allUpdatedKeys;
+    for (const auto& [key, value] : componentWriteSets(path)) {
+      state.insert(key, value);
+      allUpdatedKeys += key + " ";
     }
-
-    std::string data = response.value().as_string();
-    std::istringstream ss(data);
-    std::string pair;
-    std::string updatedKeys;
-
-    while (std::getline(ss, pair, ';')) {
-      auto delimiterPos = pair.find('=');
-      if (delimiterPos == std::string::npos) continue;
-
-      std::string key = pair.substr(0, delimiterPos);
-      std::string value = pair.substr(delimiterPos + 1);
-      tmp.insert(key, value);
-      // Value can be parsed too if needed, but we're just collecting keys
-      updatedKeys += key + " ";
+    state.updateTree(allUpdatedKeys);
+    if (!state.commitOverlay()) {
+      BOOST_LOG_TRIVIAL(error) << "Failed to commit state for: " << path;
     }
-
-    return updatedKeys;
   }
 
-
-void saveData(const std::string& path, int clusterSize) {
-    std::vector<std::thread> threads;
-    GlobalState state;
-    std::vector<std::string> results(clusterSize);
-
-    for (int i = 0; i < clusterSize; ++i) {
-        threads.emplace_back(
-            [&, i]() { results[i] = fetchAndParseKeys(path, i, state); });
+  // Distributed form of saveData: fully inserts and hashes only the
+  // partitions the leader assigned to this member, publishes their hashes
+  // under <path>/partial/<digit> in one transaction guarded on term, and
+  // adopts the other owners' hashes once the leader has merged them into
+  // <path>/stateRoot. Returns false, with the overlay discarded, when the
+  // term was superseded.
+  bool saveDataDistributed(const std::string& path, const std::string& term) {
+    PrefixWatch published(path + "/partial/");
+    PrefixWatch merged(path + "/stateRoot");
+    etcd::Response response = etcdClient.get(path + "/partitions").get();
+    std::vector<int> owners =
+        parseMembers(response.is_ok() ? response.value().as_string() : "");
+    int self = std::stoi(node_id.substr(1));
+
+    std::string allOwnedKeys;
+    for (const auto& [key, value] : componentWriteSets(path)) {
+      char digit = state.computeHash(key)[0];
+      if (partitionOwner(digit, owners) == self) {
+        state.insert(key, value);
+        allOwnedKeys += key + " ";
+      } else {
+        state.insertDeferred(key, value);
+      }
     }
-
-    for (auto& t : threads) {
-        t.join();
+    state.updateTree(allOwnedKeys);
+    ControlTxn partialPhase(term, "partial");
+    bool owner = false;
+    for (char digit : kHexDigits) {
+      if (partitionOwner(digit, owners) != self) continue;
+      partialPhase.put(path + "/partial/" + digit,
+                       state.getPartitionHash(digit));
+      owner = true;
+    }
+    if (owner && !partialPhase.commit() && partialPhase.superseded()) {
+      state.discardOverlay();
+      return false;
     }
 
-    std::string allUpdatedKeys;
-    for (const auto& result : results) {
-        allUpdatedKeys += result;
+    // The leader publishes the root only once every partial is in
+    std::string stateRoot;
+    std::map<char, std::string> others;
+    auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(30);
+    auto expired = [deadline]() {
+      return leaderCrashed.load() ||
+             std::chrono::steady_clock::now() > deadline;
+    };
+    bool rooted =
+        merged.waitUntil(
+            [&stateRoot](const PrefixWatch::Values& values) {
+              if (values.empty()) return false;
+              stateRoot = values.begin()->second;
+              return true;
+            },
+            expired) &&
+        published.waitUntil(
+            [&](const PrefixWatch::Values& values) {
+              others.clear();
+              for (const auto& [key, hash] : values) {
+                char digit = key.back();
+                if (partitionOwner(digit, owners) != self) {
+                  others[digit] = hash;
+                }
+              }
+              return values.size() >= kHexDigits.size();
+            },
+            expired);
+    if (!rooted) {
+      // The leader could not merge: adopt the partials that did arrive and
+      // rebuild only the partitions whose owner never published
+      BOOST_LOG_TRIVIAL(error) << "No state root published for: " << path;
+      others.clear();
+      for (const auto& [key, hash] : published.current()) {
+        char digit = key.back();
+        if (partitionOwner(digit, owners) != self) others[digit] = hash;
+      }
+      std::string missing;
+      for (char digit : kHexDigits) {
+        if (partitionOwner(digit, owners) != self && !others.count(digit)) {
+          missing += digit;
+        }
+      }
+      state.adoptPartitionHashes(others);
+      state.refreshPartitions(missing);
+    } else {
+      state.adoptPartitionHashes(others);
+      if (state.getRootHash() != stateRoot) {
+        BOOST_LOG_TRIVIAL(error) << "State root mismatch for: " << path;
+      }
+    }
+    if (!state.commitOverlay()) {
+      BOOST_LOG_TRIVIAL(error) << "Failed to commit state for: " << path;
     }
-    tmp.updateTree(allUpdatedKeys);
-    state.replaceWith("globalState_tmp");
-    rocksdb::DestroyDB("globalState_tmp", rocksdb::Options());
-    std::filesystem::remove_all("globalState_tmp");
+    return true;
   }
-};
\ No newline at end of file
+};
@@ -0,0 +1,173 @@
+#pragma once
+#include <boost/log/trivial.hpp>
+#include <etcd/Client.hpp>
+#include <etcd/Response.hpp>
+#include <etcd/v3/Transaction.hpp>
+#include <map>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "addressList.pb.h"
+#include "controlTxn.h"
+#include "etcdGlobals.h"
+
+// Per-component progress of a block. A follower publishes each component
+// as soon as its last transaction completes, under
+// <block>/components/done/<compID>, with the component's write set. Like
+// other bulk values the write set goes through the data plane, so etcd
+// only holds its BlobRef. The leader copies each one to its own data plane
+// under <block>/components/mirror/<compID> as it arrives, so the write
+// sets outlive their writer until the block is committed, and finishes the
+// block once every component is mirrored. Commits read the write sets
+// back, and after a failover the new owner skips the components already
+// published, so only unfinished work is re-executed.
+
+// "static" (default): each member runs the components the leader assigned
+// it. "dynamic": the assignment is only where members start; a member that
+// runs out of ready work claims unstarted components from the block's
+// queue, its own first and then the others' from the back, so stragglers
+// lose their tail. node.cpp sets it from the "distribution" config key.
+inline std::string& defaultDistribution() {
+  static std::string mode = "static";
+  return mode;
+}
+
+// Executor threads the leader gives to the block as a member itself. 0
+// (default) keeps it coordinating only; above 0 it takes a share of the
+// components weighted against the followers' threads. node.cpp sets it
+// from the "leaderThreads" config key.
+inline int& defaultLeaderThreads() {
+  static int threads = 0;
+  return threads;
+}
+
+// How long the leader waits for a block's components before closing it
+// uncommitted. node.cpp sets it from the "componentTimeoutMs" config key.
+inline int& defaultComponentTimeoutMs() {
+  static int ms = 60000;
+  return ms;
+}
+
+// Components claimed per claim transaction in dynamic mode
+inline int& defaultClaimBatch() {
+  static int batch = 4;
+  return batch;
+}
+
+inline std::string componentDonePrefix(const std::string& blockPath) {
+  return blockPath + "/components/done/";
+}
+
+inline std::string componentDoneKey(const std::string& blockPath, int comp) {
+  return componentDonePrefix(blockPath) + std::to_string(comp);
+}
+
+inline std::string componentMirrorPrefix(const std::string& blockPath) {
+  return blockPath + "/components/mirror/";
+}
+
+// IDs of the block's components already published
+inline std::unordered_set<int> completedComponents(
+    const std::string& blockPath) {
+  std::unordered_set<int> done;
+  std::string prefix = componentDonePrefix(blockPath);
+  etcd::Response response = etcdClient.keys(prefix).get();
+  if (!response.is_ok()) return done;
+  for (const auto& key : response.keys()) {
+    done.insert(std::stoi(key.substr(prefix.size())));
+  }
+  return done;
+}
+
+// The write sets of every published component, fetched from their writer
+// or, when it is gone or is this node, from the leader's mirror
+inline std::vector<std::pair<std::string, std::string>> componentWriteSets(
+    const std::string& blockPath) {
+  std::vector<std::pair<std::string, std::string>> writeSet;
+  std::string donePrefix = componentDonePrefix(blockPath);
+  std::string mirrorPrefix = componentMirrorPrefix(blockPath);
+  etcd::Response response = etcdClient.ls(donePrefix).get();
+  if (!response.is_ok()) {
+    BOOST_LOG_TRIVIAL(error) << "Failed to read component write sets of "
+                             << blockPath << ": " << response.error_message();
+    return writeSet;
+  }
+  std::map<std::string, std::string> mirrors;  // mirror key -> stored
+  etcd::Response mirrored = etcdClient.ls(mirrorPrefix).get();
+  if (mirrored.is_ok()) {
+    for (size_t i = 0; i < mirrored.keys().size(); ++i) {
+      mirrors[mirrored.key(i)] = mirrored.value(i).as_string();
+    }
+  }
+  for (size_t i = 0; i < response.keys().size(); ++i) {
+    std::vector<std::pair<std::string, std::string>> sources = {
+        {response.key(i), response.value(i).as_string()}};
+    auto mirror =
+        mirrors.find(mirrorPrefix + response.key(i).substr(donePrefix.size()));
+    if (mirror != mirrors.end()) {
+      BlobRef ref;
+      bool local = ref.parse(mirror->second) && servedHere(ref);
+      sources.insert(local ? sources.begin() : sources.end(), *mirror);
+    }
+    std::string data;
+    bool fetched = false;
+    for (const auto& [key, stored] : sources) {
+      if ((fetched = resolveBlob(key, stored, &data))) break;
+    }
+    addressList::AddressValueList protoList;
+    if (!fetched || !protoList.ParseFromString(data)) {
+      BOOST_LOG_TRIVIAL(error)
+          << "Failed to read write set at: " << response.key(i);
+      continue;
+    }
+    for (const auto& pair : protoList.pairs()) {
+      writeSet.emplace_back(pair.address(), pair.value());
+    }
+  }
+  return writeSet;
+}
+
+inline std::string componentClaimPrefix(const std::string& blockPath) {
+  return blockPath + "/components/claim/";
+}
+
+// Claims comps for member in one transaction, all or none. A component can
+// only be claimed while it is neither claimed nor published, so each claim
+// is made exactly once; claims are bound to lease, so those of a member
+// that crashes return to the queue when its heartbeat lease expires.
+inline bool claimComponents(const std::string& blockPath,
+                            const std::vector<int>& comps,
+                            const std::string& member,
+                            const std::string& term, int64_t lease) {
+  etcdv3::Transaction txn;
+  txn.add_compare_value(kLeaderTermKey, termValue(term));
+  for (int comp : comps) {
+    std::string claimKey = componentClaimPrefix(blockPath) +
+                           std::to_string(comp);
+    txn.add_compare_version(claimKey, 0);
+    txn.add_compare_version(componentDoneKey(blockPath, comp), 0);
+    txn.add_success_put(claimKey, member, lease);
+  }
+  return etcdClient.txn(txn).get().is_ok();
+}
+
+// Components of a block of count components that nobody holds a claim on
+// and that are not published yet
+inline std::vector<int> unclaimedComponents(const std::string& blockPath,
+                                            int count) {
+  std::unordered_set<int> taken = completedComponents(blockPath);
+  std::string prefix = componentClaimPrefix(blockPath);
+  etcd::Response response = etcdClient.keys(prefix).get();
+  if (response.is_ok()) {
+    for (const auto& key : response.keys()) {
+      taken.insert(std::stoi(key.substr(prefix.size())));
+    }
+  }
+  std::vector<int> free;
+  for (int comp = 0; comp < count; ++comp) {
+    if (!taken.count(comp)) free.push_back(comp);
+  }
+  return free;
+}
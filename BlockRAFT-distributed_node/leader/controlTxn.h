@@ -0,0 +1,91 @@
+#pragma once
+#include <boost/log/trivial.hpp>
+#include <etcd/Client.hpp>
+#include <etcd/Response.hpp>
+#include <etcd/v3/Transaction.hpp>
+#include <etcd/v3/action_constants.hpp>
+#include <string>
+
+#include "../dataPlane/blobChannel.h"
+#include "etcdGlobals.h"
+
+// Raft term of the leader whose block keys are current. Control writes are
+// guarded on it, so a deposed leader, or a follower still executing its
+// block, cannot change keys once a later term has been claimed.
+const std::string kLeaderTermKey = "LeaderTerm";
+
+// Terms are stored zero-padded, so etcd's byte-wise value compares order
+// them numerically
+inline std::string termValue(const std::string& term) {
+  return std::string(term.size() < 20 ? 20 - term.size() : 0, '0') + term;
+}
+
+// Makes term the leader term unless a later one holds it already. Returns
+// whether term is the leader term afterwards.
+inline bool claimLeaderTerm(const std::string& term) {
+  std::string value = termValue(term);
+  etcdv3::Transaction txn;
+  txn.add_compare_version(kLeaderTermKey, 0);
+  txn.add_success_put(kLeaderTermKey, value);
+  if (etcdClient.txn(txn).get().is_ok()) return true;
+
+  etcdv3::Transaction later;
+  later.add_compare_value(kLeaderTermKey, value,
+                          etcdv3::CompareResult::LESS);
+  later.add_success_put(kLeaderTermKey, value);
+  if (etcdClient.txn(later).get().is_ok()) return true;
+
+  etcd::Response current = etcdClient.get(kLeaderTermKey).get();
+  return current.is_ok() && current.value().as_string() == value;
+}
+
+// The control keys one phase of a block writes, applied together in a
+// single etcd transaction guarded on the writer's term: one Raft round
+// trip for the phase, and watchers never see it half done.
+class ControlTxn {
+ private:
+  etcdv3::Transaction txn;
+  std::string phase;
+  bool termMismatch = false;
+
+ public:
+  ControlTxn(const std::string& term, const std::string& phase)
+      : phase(phase) {
+    txn.add_compare_value(kLeaderTermKey, termValue(term));
+  }
+
+  ControlTxn& put(const std::string& key, const std::string& value) {
+    txn.add_success_put(key, value);
+    return *this;
+  }
+
+  // Applies the phase only while key still holds value
+  ControlTxn& expect(const std::string& key, const std::string& value) {
+    txn.add_compare_value(key, value);
+    return *this;
+  }
+
+  ControlTxn& erase(const std::string& key) {
+    txn.add_success_delete(key);
+    return *this;
+  }
+
+  // Bulk values go through the data plane, as publishBlob does
+  ControlTxn& putBlob(const std::string& key, std::string value) {
+    return put(key, blobValue(key, std::move(value)));
+  }
+
+  // Applies the phase; false if etcd failed or the term was superseded
+  bool commit() {
+    etcd::Response response = etcdClient.txn(txn).get();
+    if (response.is_ok()) return true;
+    termMismatch = response.error_code() == etcdv3::ERROR_COMPARE_FAILED;
+    BOOST_LOG_TRIVIAL(error)
+        << "Control transaction (" << phase << ") failed: "
+        << (termMismatch ? "term superseded" : response.error_message());
+    return false;
+  }
+
+  // Whether the last commit failed because a later term was claimed
+  bool superseded() const { return termMismatch; }
+};
@@ -0,0 +1,483 @@
+#pragma once
+#include <rdkafka.h>
+
+#include <atomic>
+#include <boost/log/trivial.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <etcd/Client.hpp>
+#include <etcd/KeepAlive.hpp>
+#include <etcd/Response.hpp>
+#include <etcd/Watcher.hpp>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "etcdGlobals.h"
+
+// Failure detection settings: every node refreshes its heartbeat key each
+// heartbeat interval and is taken for dead once none has been seen for the
+// timeout. Members, raft status and Redpanda are re-read every check
+// interval. node.cpp sets them from "healthHeartbeatMs", "healthTimeoutMs"
+// and "healthCheckMs".
+inline int& defaultHeartbeatMs() {
+  static int ms = 200;
+  return ms;
+}
+
+inline int& defaultFailureTimeoutMs() {
+  static int ms = 800;
+  return ms;
+}
+
+inline int& defaultHealthCheckMs() {
+  static int ms = 1000;
+  return ms;
+}
+
+// Redpanda brokers probed for cluster health
+inline std::string& defaultRedpandaBrokers() {
+  static std::string brokers = "localhost:19092";
+  return brokers;
+}
+
+const std::string kHeartbeatPrefix = "health/";
+
+// When each node's heartbeat was last seen, and so which nodes are alive
+class Liveness {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  void seen(const std::string& name, Clock::time_point when) {
+    lastSeen[name] = when;
+  }
+
+  // The node's heartbeat key went away with its lease
+  void gone(const std::string& name) { lastSeen.erase(name); }
+
+  bool alive(const std::string& name, Clock::time_point now,
+             std::chrono::milliseconds timeout) const {
+    auto it = lastSeen.find(name);
+    return it != lastSeen.end() && now - it->second <= timeout;
+  }
+
+ private:
+  std::map<std::string, Clock::time_point> lastSeen;
+};
+
+// Cluster health for the leader, the node monitors and follower
+// assignment, kept in process instead of shelling out to etcdctl and rpk
+// on every check. Liveness comes from per-node heartbeat keys under
+// kHeartbeatPrefix, bound to a kept-alive lease so a crashed node's key
+// also disappears, and read through one watch. Membership and the raft
+// term come from the etcd client API; Redpanda is probed with a metadata
+// request.
+class HealthMonitor {
+ public:
+  struct Member {
+    std::string name;       // etcd member name, which is the node id
+    std::string clientURL;  // first client URL
+    bool alive = false;     // heartbeat seen within the failure timeout
+    bool reachable = false;  // its etcd endpoint answered the last check
+  };
+
+  struct Status {
+    bool reachable = false;  // the local etcd endpoint answered
+    bool leader = false;     // it is the raft leader
+    uint64_t raftTerm = 0;
+  };
+
+ private:
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::vector<Member> memberList;
+  Liveness liveness;
+  Status etcdStatus;
+  bool redpanda = true;
+  int redpandaBrokers = 0;
+  uint64_t changes = 0;
+
+  std::string self;
+  std::atomic<bool> stopping{false};
+  std::atomic<bool> leaseFailed{false};
+  // The current heartbeat lease; replaced by renewLease, so read it here
+  // rather than from keepAlive, which only the heartbeat thread touches
+  std::atomic<int64_t> heartbeatLease{0};
+  int leaseTTL = 1;
+  std::unique_ptr<etcd::KeepAlive> keepAlive;
+  std::unique_ptr<etcd::Watcher> watcher;
+  std::thread heartbeatThread, checkThread, expireThread;
+  rd_kafka_t* kafka = nullptr;
+  // One client per member endpoint, for the endpoint health checks
+  std::map<std::string, std::unique_ptr<etcd::Client>> endpoints;
+
+  static std::string nameOf(const std::string& key) {
+    return key.substr(kHeartbeatPrefix.size());
+  }
+
+  // Recomputes alive flags; true when one of them changed
+  bool updateAlive(Liveness::Clock::time_point now) {
+    bool flipped = false;
+    for (auto& member : memberList) {
+      bool alive = liveness.alive(
+          member.name, now,
+          std::chrono::milliseconds(defaultFailureTimeoutMs()));
+      flipped |= alive != member.alive;
+      member.alive = alive;
+    }
+    return flipped;
+  }
+
+  void publishChange() {
+    changes++;
+    changed.notify_all();
+  }
+
+  void onHeartbeat(const etcd::Response& response) {
+    if (!response.is_ok()) return;
+    auto now = Liveness::Clock::now();
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& event : response.events()) {
+      std::string name = nameOf(event.kv().key());
+      if (event.event_type() == etcd::Event::EventType::DELETE_) {
+        liveness.gone(name);
+      } else {
+        liveness.seen(name, now);
+      }
+    }
+    if (updateAlive(now)) publishChange();
+  }
+
+  // Keeps id alive; a failure only flags the lease, renewLease replaces
+  // it from the heartbeat thread. A keep-alive already replaced no longer
+  // flags anything.
+  std::unique_ptr<etcd::KeepAlive> keepLeaseAlive(int64_t id) {
+    return std::make_unique<etcd::KeepAlive>(
+        etcdClient,
+        [this, id](std::exception_ptr) {
+          if (heartbeatLease.load() != id) return;
+          leaseFailed.store(true);
+          BOOST_LOG_TRIVIAL(error) << "Heartbeat lease keep-alive failed";
+        },
+        leaseTTL, id);
+  }
+
+  // Grants a new lease once the old one was lost, e.g. to an etcd stall
+  // longer than its TTL, so the heartbeat and later claims are bound to a
+  // live lease again. Retried on the next beat when etcd does not answer.
+  void renewLease() {
+    try {
+      etcd::Response grant = etcdClient.leasegrant(leaseTTL).get();
+      if (!grant.is_ok()) {
+        BOOST_LOG_TRIVIAL(warning)
+            << "Heartbeat lease grant failed: " << grant.error_message();
+        return;
+      }
+      int64_t id = grant.value().lease();
+      if (keepAlive) keepAlive->Cancel();
+      heartbeatLease.store(id);
+      keepAlive = keepLeaseAlive(id);
+      leaseFailed.store(false);
+      BOOST_LOG_TRIVIAL(info) << "Heartbeat bound to new lease " << id;
+    } catch (const std::exception& e) {
+      BOOST_LOG_TRIVIAL(warning) << "Heartbeat lease grant failed: "
+                                 << e.what();
+    }
+  }
+
+  void heartbeatLoop() {
+    std::string key = kHeartbeatPrefix + self;
+    for (uint64_t beat = 0; !stopping.load(); ++beat) {
+      if (leaseFailed.load()) renewLease();
+      try {
+        etcd::Response put =
+            etcdClient.put(key, std::to_string(beat), heartbeatLease.load())
+                .get();
+        // etcd may drop the lease before the keep-alive reports it
+        if (put.error_message().find("lease not found") !=
+            std::string::npos) {
+          leaseFailed.store(true);
+        }
+      } catch (const std::exception& e) {
+        BOOST_LOG_TRIVIAL(warning) << "Heartbeat failed: " << e.what();
+      }
+      std::this_thread::sleep_for(
+          std::chrono::milliseconds(defaultHeartbeatMs()));
+    }
+  }
+
+  // What etcdctl endpoint health --cluster checks: each member's endpoint
+  // answers a read within the check interval
+  bool endpointHealthy(const std::string& url) {
+    if (url.empty()) return false;
+    auto& client = endpoints[url];
+    try {
+      if (!client) {
+        client = std::make_unique<etcd::Client>(url);
+        client->set_grpc_timeout(
+            std::chrono::milliseconds(defaultHealthCheckMs()));
+      }
+      // A missing key (100) is still an answer
+      int code = client->get("health").get().error_code();
+      return code == 0 || code == 100;
+    } catch (const std::exception&) {
+      client.reset();
+      return false;
+    }
+  }
+
+  // The client API has no maintenance Status call, so whether the local
+  // member leads is read from etcdctl. Leadership only changes with the
+  // raft term, so this runs once per term rather than per check.
+  static bool probeLeadership() {
+    FILE* pipe = popen("etcdctl endpoint status 2>/dev/null", "r");
+    if (!pipe) return false;
+    char buffer[256];
+    std::string output;
+    while (fgets(buffer, sizeof(buffer), pipe) != NULL) output += buffer;
+    pclose(pipe);
+    std::vector<std::string> values;
+    std::stringstream ss(output);
+    for (std::string item; getline(ss, item, ',');) {
+      item.erase(0, item.find_first_not_of(" \t"));
+      item.erase(item.find_last_not_of(" \t\n") + 1);
+      values.push_back(item);
+    }
+    return values.size() >= 7 && values[4] == "true";
+  }
+
+  void checkEtcd() {
+    Status status;
+    std::vector<Member> members;
+    try {
+      etcd::Response head = etcdClient.head().get();
+      status.reachable = head.is_ok();
+      status.raftTerm = head.raft_term();
+      etcd::Response list = etcdClient.list_member().get();
+      for (const auto& member : list.members()) {
+        std::string url = member.get_clientURLs().empty()
+                              ? ""
+                              : member.get_clientURLs()[0];
+        members.push_back({member.get_name(), url, false, false});
+      }
+      for (auto& member : members) {
+        member.reachable = endpointHealthy(member.clientURL);
+      }
+    } catch (const std::exception& e) {
+      status.reachable = false;
+    }
+    bool termChanged;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      termChanged = !etcdStatus.reachable ||
+                    status.raftTerm != etcdStatus.raftTerm;
+      status.leader = etcdStatus.leader;
+    }
+    if (status.reachable && termChanged) status.leader = probeLeadership();
+    if (!status.reachable) status.leader = false;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    bool different = status.reachable != etcdStatus.reachable ||
+                     status.leader != etcdStatus.leader ||
+                     status.raftTerm != etcdStatus.raftTerm;
+    etcdStatus = status;
+    if (status.reachable) {
+      bool sameMembers = members.size() == memberList.size();
+      for (size_t i = 0; sameMembers && i < members.size(); ++i) {
+        sameMembers = members[i].name == memberList[i].name &&
+                      members[i].clientURL == memberList[i].clientURL &&
+                      members[i].reachable == memberList[i].reachable;
+      }
+      if (!sameMembers) {
+        memberList = members;
+        updateAlive(Liveness::Clock::now());
+        different = true;
+      }
+    }
+    if (different) publishChange();
+  }
+
+  // Healthy while the brokers answer, none of them dropped out, and every
+  // partition has a leader, as rpk cluster health reports it
+  void checkRedpanda() {
+    if (!kafka) {
+      char errstr[512];
+      rd_kafka_conf_t* conf = rd_kafka_conf_new();
+      rd_kafka_conf_set(conf, "bootstrap.servers",
+                        defaultRedpandaBrokers().c_str(), errstr,
+                        sizeof(errstr));
+      kafka = rd_kafka_new(RD_KAFKA_PRODUCER, conf, errstr, sizeof(errstr));
+      if (!kafka) return;
+    }
+    const rd_kafka_metadata_t* metadata = nullptr;
+    rd_kafka_resp_err_t err =
+        rd_kafka_metadata(kafka, 1, nullptr, &metadata,
+                          defaultHealthCheckMs());
+    bool healthy = err == RD_KAFKA_RESP_ERR_NO_ERROR;
+    int brokers = 0;
+    if (healthy) {
+      brokers = metadata->broker_cnt;
+      for (int t = 0; t < metadata->topic_cnt; ++t) {
+        const auto& topic = metadata->topics[t];
+        for (int p = 0; p < topic.partition_cnt; ++p) {
+          healthy &= topic.partitions[p].leader >= 0;
+        }
+      }
+      rd_kafka_metadata_destroy(metadata);
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    redpandaBrokers = std::max(redpandaBrokers, brokers);
+    healthy &= brokers > 0 && brokers >= redpandaBrokers;
+    if (healthy != redpanda) {
+      redpanda = healthy;
+      publishChange();
+    }
+  }
+
+  void checkLoop() {
+    while (!stopping.load()) {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait_for(lock,
+                         std::chrono::milliseconds(defaultHealthCheckMs()),
+                         [this]() { return stopping.load(); });
+      }
+      if (stopping.load()) return;
+      checkEtcd();
+      checkRedpanda();
+    }
+  }
+
+  // Expires heartbeats that stopped without their key being deleted; runs
+  // on the heartbeat cadence so detection stays within the timeout
+  void expireLoop() {
+    while (!stopping.load()) {
+      std::this_thread::sleep_for(
+          std::chrono::milliseconds(defaultHeartbeatMs()));
+      std::lock_guard<std::mutex> lock(mutex);
+      if (updateAlive(Liveness::Clock::now())) publishChange();
+    }
+  }
+
+ public:
+  ~HealthMonitor() { stop(); }
+
+  // Starts heartbeating as node (when known) and watching the others. The
+  // first check runs before returning, so the cache is never empty.
+  void start(const std::string& node) {
+    if (watcher) return;
+    self = node;
+    watcher = std::make_unique<etcd::Watcher>(
+        etcdClient, kHeartbeatPrefix,
+        [this](etcd::Response response) { onHeartbeat(response); }, true);
+    etcd::Response seed = etcdClient.ls(kHeartbeatPrefix).get();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      for (size_t i = 0; i < seed.keys().size(); ++i) {
+        liveness.seen(nameOf(seed.key(i)), Liveness::Clock::now());
+      }
+    }
+    if (!self.empty()) {
+      leaseTTL = std::max(1, (defaultFailureTimeoutMs() + 999) / 1000);
+      etcd::Response grant = etcdClient.leasegrant(leaseTTL).get();
+      if (grant.is_ok()) {
+        heartbeatLease.store(grant.value().lease());
+        keepAlive = keepLeaseAlive(heartbeatLease.load());
+      } else {
+        // The heartbeat loop grants it once etcd answers
+        leaseFailed.store(true);
+      }
+      heartbeatThread = std::thread(&HealthMonitor::heartbeatLoop, this);
+    }
+    checkEtcd();
+    checkRedpanda();
+    checkThread = std::thread(&HealthMonitor::checkLoop, this);
+    expireThread = std::thread(&HealthMonitor::expireLoop, this);
+  }
+
+  bool running() { return watcher && !stopping.load(); }
+
+  // The heartbeat lease, for keys that should go away with this node; 0
+  // before start or without a node id. It changes when a lost lease is
+  // replaced, so callers read it again for each block.
+  int64_t lease() { return heartbeatLease.load(); }
+
+  // Whether the lease's keep-alive failed and no new lease was granted
+  // yet, so keys bound to it, this node's heartbeat and claims, may
+  // already be gone
+  bool leaseLost() { return leaseFailed.load(); }
+
+  void stop() {
+    if (stopping.exchange(true)) return;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      changed.notify_all();
+    }
+    for (auto* t : {&heartbeatThread, &checkThread, &expireThread}) {
+      if (t->joinable()) t->join();
+    }
+    if (watcher) watcher->Cancel();
+    if (keepAlive) keepAlive->Cancel();
+    if (kafka) rd_kafka_destroy(kafka);
+    kafka = nullptr;
+  }
+
+  std::vector<Member> members() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return memberList;
+  }
+
+  // Members whose heartbeat is current, other than this node
+  std::vector<Member> activeFollowers() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<Member> active;
+    for (const auto& member : memberList) {
+      if (member.alive && member.name != self) active.push_back(member);
+    }
+    return active;
+  }
+
+  Status status() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return etcdStatus;
+  }
+
+  // Whether no more than a third of the etcd endpoints are down, the bound
+  // the node tolerates before stopping
+  bool etcdQuorum() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!etcdStatus.reachable) return false;
+    int down = 0;
+    for (const auto& member : memberList) down += !member.reachable;
+    return down <= (int)memberList.size() / 3;
+  }
+
+  bool redpandaHealthy() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return redpanda;
+  }
+
+  // Counts changes to the cached health; waitForChange(seen) returns once
+  // it moves past seen or after timeout
+  uint64_t generation() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return changes;
+  }
+
+  uint64_t waitForChange(uint64_t seen, std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait_for(lock, timeout, [&]() { return changes != seen; });
+    return changes;
+  }
+};
+
+inline HealthMonitor& healthMonitor() {
+  static HealthMonitor monitor;
+  return monitor;
+}
@@ -11,18 +11,28 @@
 #include <etcd/Response.hpp>
 #include <etcd/Watcher.hpp>
 #include <iostream>
+#include <map>
 #include <nlohmann/json.hpp>
 #include <sstream>
 #include <string>
 #include <thread>
+#include <unordered_set>
 #include <vector>
 
 #include "../blockProducer/blockProducer.h"
 #include "../blocksDB/blocksDB.h"
 #include "../dagModule/DAGmodule.h"
+#include "../dataPlane/blobChannel.h"
+#include "../leader/componentProgress.h"
+#include "../leader/controlTxn.h"
 #include "../leader/etcdGlobals.h"
+#include "../leader/healthMonitor.h"
+#include "../leader/prefixWatch.h"
 #include "../leader/testingBlockProducer.h"
 #include "../merkleTree/globalState.h"
+#include "../merkleTree/snapshots.h"
+#include "../scheduler/scheduler.h"
+#include "addressList.pb.h"
 
 string etcdPort = "http://127.0.0.1:2379";
 using namespace std;
@@ -43,6 +53,7 @@ class leader {
   };
   std::vector<EtcdMember> memberList;
   blocksDB db;
+  std::string committedRoot;  // state root of the last block saved
   DAGmodule DAGObj;
   components::componentsTable table;
   int activeFollowers;
@@ -71,58 +82,52 @@ class leader {
     return result;
   };
 
+  // Members from the health monitor's cache; healthy marks the followers,
+  // i.e. the other members whose heartbeat is current
   void getEtcdMembers() {
-    etcd::Response res = etcdClient.list_member().get();
-    for (int i = 0; i < res.members().size(); i++) {
-      memberList.push_back(
-          {res.members()[i].get_clientURLs()[0], res.members()[i].get_name()});
+    memberList.clear();
+    for (const auto& member : healthMonitor().members()) {
+      memberList.push_back({member.clientURL, member.name,
+                            member.alive && member.name != node_id});
     }
   }
+
   int getActiveFollowers() {
-    string output, word;
+    getEtcdMembers();
     int count = 0;
-    bool health;
-    output = executeCommand("etcdctl endpoint health --cluster 2>&1");
-    std::istringstream stream(output);
-    std::string ip;
-    bool nextIsIP = false;
-
-    while (stream >> word) {
-      if (word.substr(0, 7) == "http://" &&
-          word.substr(7) != node_ip + ":2379") {
-        ip = word;
-        nextIsIP = true;
-      }
-      if (nextIsIP && word == "healthy:") {
-        // Find the member in the list and mark as healthy
-        for (auto& member : memberList) {
-          if (member.ipAddress == ip) {
-            member.healthy = true;
-            break;  // No need to check further
-          }
-        }
-        count++;  // Increment count for a healthy node
-        nextIsIP = false;
-      }
-    }
+    for (const auto& member : memberList) count += member.healthy;
     return count;
   };
 
-  void monitorComponents(string compKey) {
+  // Moves the components of followers that stop heartbeating to the ones
+  // still alive; woken by the health monitor instead of polling
+  void monitorComponents(string compKey, string term) {
+    // Dynamic claims return to the queue with a dead member's lease
+    if (defaultDistribution() == "dynamic") return;
     int count;
-    bool flag;
+    bool flag = false;
+    uint64_t seen = healthMonitor().generation();
     while (!stopMonitor.load()) {
+      seen = healthMonitor().waitForChange(
+          seen, std::chrono::milliseconds(defaultHeartbeatMs()));
       count = getActiveFollowers();
 
       if (count < activeFollowers && count > 0) {
         activeFollowers = count;
+        std::vector<int> aliveIds;
+        for (const auto& member : memberList) {
+          if (member.healthy) {
+            aliveIds.push_back(std::stoi(member.id.substr(1)));
+          }
+        }
         for (int i = 0; i < table.componentslist_size(); ++i) {
           components::componentsTable::component* comp =
               table.mutable_componentslist(i);
           int follower = comp->assignedfollower();
-          if (memberList[follower].healthy == false) {
+          // The leader's own share stays with it
+          if (follower != selfId() && memberList[follower].healthy == false) {
             int index = i % activeFollowers;
-            comp->set_assignedfollower(healthyMemberIds[index]);
+            comp->set_assignedfollower(aliveIds[index]);
             flag = true;
           }
         }
@@ -131,14 +136,48 @@ class leader {
           if (!table.SerializeToString(&serializedTable)) {
             return;
           }
-          etcd::Response response =
-              etcdClient.set(compKey, serializedTable).get();
+          ControlTxn reassign(term, "reassign");
+          reassign.putBlob(compKey, std::move(serializedTable));
+          if (!reassign.commit() && reassign.superseded()) return;
+        }
+      }
+    }
+  }
+
+  int selfId() { return std::stoi(node_id.substr(1)); }
+
+  // Assigns each component, largest first, to the member that would be
+  // done with it soonest, counting transactions per executor thread.
+  // members holds (id, threads) pairs.
+  void assignWeighted(const std::vector<std::pair<int, int>>& members) {
+    std::vector<std::pair<int, int>> bySize;  // (transactions, index)
+    for (int i = 0; i < table.componentslist_size(); ++i) {
+      bySize.push_back({(int)componentTxns(table.componentslist(i)).size(), i});
+    }
+    std::stable_sort(bySize.begin(), bySize.end(),
+                     [](const auto& a, const auto& b) {
+                       return a.first > b.first;
+                     });
+    std::vector<long long> load(members.size(), 0);
+    for (const auto& [size, i] : bySize) {
+      size_t best = 0;
+      for (size_t m = 1; m < members.size(); ++m) {
+        if ((load[m] + size) * members[best].second <
+            (load[best] + size) * members[m].second) {
+          best = m;
         }
       }
+      load[best] += size;
+      table.mutable_componentslist(i)->set_assignedfollower(
+          members[best].first);
     }
   }
 
-  bool assignFollowers(string compKey) {
+  // Publishes the assigned table, or stages it in phase when given. With
+  // defaultLeaderThreads() set, the leader takes a share against
+  // followerThreads per follower.
+  bool assignFollowers(string compKey, ControlTxn* phase = nullptr,
+                       int followerThreads = 1) {
     etcd::Response response;
     for (const auto& member : memberList) {
       if (member.healthy) {
@@ -147,22 +186,34 @@ class leader {
       }
     }
     activeFollowers = healthyMemberIds.size();
-    for (int i = 0; i < componentCount.load(std::memory_order_relaxed); ++i) {
-      components::componentsTable::component* comp =
-          table.mutable_componentslist(i);
-      if (activeFollowers > 0) {
-        // Assign a healthy follower in a round-robin fashion
-        int index = i % activeFollowers;
-        comp->set_assignedfollower(healthyMemberIds[index]);
-      } else {
-        return false;
+    if (defaultLeaderThreads() > 0) {
+      std::vector<std::pair<int, int>> members;
+      for (int id : healthyMemberIds) members.push_back({id, followerThreads});
+      members.push_back({selfId(), defaultLeaderThreads()});
+      assignWeighted(members);
+    } else {
+      for (int i = 0; i < componentCount.load(std::memory_order_relaxed);
+           ++i) {
+        components::componentsTable::component* comp =
+            table.mutable_componentslist(i);
+        if (activeFollowers > 0) {
+          // Assign a healthy follower in a round-robin fashion
+          int index = i % activeFollowers;
+          comp->set_assignedfollower(healthyMemberIds[index]);
+        } else {
+          return false;
+        }
       }
     }
     std::string serializedTable;
     if (!table.SerializeToString(&serializedTable)) {
       return false;  // Serialization failed
     }
-    response = etcdClient.set(compKey, serializedTable).get();
+    if (phase) {
+      phase->putBlob(compKey, std::move(serializedTable));
+    } else {
+      response = publishBlob(compKey, serializedTable);
+    }
     return true;
   }
 
@@ -171,25 +222,103 @@ class leader {
       str.pop_back();
     }
   }
-  bool checkComponents(const std::string& compStatusPath, int txnCount) {
-    while (true) {
-      int completed = 0;
-      for (int i = 0; i < memberList.size(); ++i) {
-        std::string key = compStatusPath + "/s" + std::to_string(i);
-        etcd::Response response = etcdClient.get(key).get();
-        if (response.is_ok()) {
-          int count = stoi(response.value().as_string());
-          completed = completed + count;
-        } else {
-        }
+  // Whether this node may still finish term's block: its heartbeat lease
+  // is alive and no later term has claimed kLeaderTermKey
+  bool stillLeading(PrefixWatch& termWatch, const std::string& term) {
+    if (healthMonitor().leaseLost()) return false;
+    PrefixWatch::Values values = termWatch.current();
+    auto current = values.find(kLeaderTermKey);
+    return current == values.end() || current->second == termValue(term);
+  }
+
+  // Copies the write sets of newly published components from their
+  // writers' data planes to this node's, see componentProgress.h, and adds
+  // their done keys to mirrored. Write sets kept inline in etcd or served
+  // here need no copy. A write set whose writer can no longer serve it is
+  // unpublished, so the component runs again on its next owner; a writer
+  // that is still alive keeps it as done and the block times out instead.
+  // Returns false once term is superseded.
+  bool mirrorWriteSets(const std::string& blockPath,
+                       const PrefixWatch::Values& published,
+                       const std::string& term,
+                       std::unordered_set<std::string>& mirrored) {
+    ControlTxn mirror(term, "mirror");
+    std::vector<std::string> copied;
+    for (const auto& [key, stored] : published) {
+      BlobRef ref;
+      if (!ref.parse(stored) || servedHere(ref)) {
+        mirrored.insert(key);
+        continue;
+      }
+      std::string data;
+      if (resolveBlob(key, stored, &data)) {
+        std::string comp = key.substr(componentDonePrefix(blockPath).size());
+        mirror.putBlob(componentMirrorPrefix(blockPath) + comp,
+                       std::move(data));
+        copied.push_back(key);
+        continue;
       }
+      BOOST_LOG_TRIVIAL(error) << "Write set at " << key
+                               << " is lost with its writer; rerunning it";
+      ControlTxn unpublish(term, "unpublish");
+      unpublish.expect(key, stored).erase(key);
+      if (!unpublish.commit() && unpublish.superseded()) return false;
+    }
+    if (copied.empty()) return true;
+    if (!mirror.commit()) return !mirror.superseded();
+    mirrored.insert(copied.begin(), copied.end());
+    return true;
+  }
 
-      if (txnCount == completed) {
-        BOOST_LOG_TRIVIAL(info) << "All components are done.";
-        stopMonitor.store(true);
-        return true;
+  // Waits until all count components of the block have been published
+  // as done and their write sets mirrored here, see componentProgress.h;
+  // driven by one prefix watch. Returns false once this node stops leading
+  // term or defaultComponentTimeoutMs() passes, so the block can be closed
+  // uncommitted.
+  bool checkComponents(const std::string& blockPath, int count,
+                       const std::string& term) {
+    PrefixWatch done(componentDonePrefix(blockPath));
+    PrefixWatch termWatch(kLeaderTermKey);
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(defaultComponentTimeoutMs());
+    auto stop = [&]() {
+      return !stillLeading(termWatch, term) ||
+             std::chrono::steady_clock::now() > deadline;
+    };
+    std::unordered_set<std::string> mirrored;
+    PrefixWatch::Values pending;
+    bool complete = false;
+    while (!complete) {
+      bool woken = done.waitUntil(
+          [&](const PrefixWatch::Values& published) {
+            pending.clear();
+            for (const auto& entry : published) {
+              if (!mirrored.count(entry.first)) pending.insert(entry);
+            }
+            return !pending.empty() || (int)mirrored.size() >= count;
+          },
+          stop);
+      if (!woken || !mirrorWriteSets(blockPath, pending, term, mirrored)) {
+        break;
+      }
+      complete = (int)mirrored.size() >= count;
+      // Back off while a write set fails to copy or to be unpublished
+      bool retry = false;
+      for (const auto& entry : pending) {
+        retry = retry || !mirrored.count(entry.first);
+      }
+      if (!complete && retry) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
       }
     }
+    stopMonitor.store(true);
+    if (!complete) {
+      BOOST_LOG_TRIVIAL(error) << "Components of " << blockPath
+                               << " not done; closing it uncommitted.";
+      return false;
+    }
+    BOOST_LOG_TRIVIAL(info) << "All components are done.";
+    return true;
   }
 
   bool nodeDetails() {
@@ -208,59 +337,60 @@ class leader {
     return false;
   }
 
-  std::string fetchAndParseKeys(const std::string& path, int i,
-                                GlobalState& state) {
-    std::string etcdKey = path + "/data/s" + std::to_string(i);
-    etcd::Response response = etcdClient.get(etcdKey).get();
-
-    if (!response.is_ok()) {
-      BOOST_LOG_TRIVIAL(error)
-          << "Failed to fetch data from etcd at: " << etcdKey;
-
-      return "";
+void saveData(const std::string& path, int blockNum) {
+    GlobalState state;
+    std::string allUpdatedKeys;
+    for (const auto& [key, value] : componentWriteSets(path)) {
+        state.insert(key, value);
+        allUpdatedKeys += key + " ";
     }
 
-    std::string data = response.value().as_string();
-    std::istringstream ss(data);
-    std::string pair;
-    std::string updatedKeys;
-
-    while (std::getline(ss, pair, ';')) {
-      auto delimiterPos = pair.find('=');
-      if (delimiterPos == std::string::npos) continue;
-
-      std::string key = pair.substr(0, delimiterPos);
-      std::string value = pair.substr(delimiterPos + 1);
-      state.insert(key, value);
-      // Value can be parsed too if needed, but we're just collecting keys
-      updatedKeys += key + " ";
+    // Update the global state tree
+    state.updateTree(allUpdatedKeys);
+    committedRoot = state.getRootHash();
+    if (!state.commitVersion(blockNum)) {
+        BOOST_LOG_TRIVIAL(error)
+            << "Failed to version state for block " << blockNum;
     }
+}
 
-    return updatedKeys;
-  }
-
-
-void saveData(const std::string& path, int clusterSize) {
-    std::vector<std::thread> threads;
+// Distributed commit: the owners of the 16 partitions publish their hashes
+// under <path>/partial/; the leader only stores the leaves, merges the
+// partition hashes into the root and publishes it as <path>/stateRoot,
+// guarded on its term so a deposed leader cannot publish a root.
+bool saveDataDistributed(const std::string& path, int blockNum,
+                         const std::string& term) {
+    PrefixWatch published(path + "/partial/");
     GlobalState state;
-    std::vector<std::string> results(clusterSize);
-
-    for (int i = 0; i < clusterSize; ++i) {
-        threads.emplace_back(
-            [&, i]() { results[i] = fetchAndParseKeys(path, i, state); });
+    for (const auto& [key, value] : componentWriteSets(path)) {
+        state.insertDeferred(key, value);
     }
 
-    for (auto& t : threads) {
-        t.join();
+    std::map<char, std::string> partials;
+    auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(30);
+    bool complete = published.waitUntil(
+        [&partials](const PrefixWatch::Values& values) {
+            partials.clear();
+            for (const auto& [key, hash] : values) partials[key.back()] = hash;
+            return partials.size() >= kHexDigits.size();
+        },
+        [deadline]() { return std::chrono::steady_clock::now() > deadline; });
+    if (!complete) {
+        BOOST_LOG_TRIVIAL(error) << "Missing partition hashes for: " << path;
+        return false;
     }
 
-    std::string allUpdatedKeys;
-    for (const auto& result : results) {
-        allUpdatedKeys += result;
+    state.adoptPartitionHashes(partials);
+    committedRoot = state.getRootHash();
+    ControlTxn rootPhase(term, "stateRoot");
+    rootPhase.put(path + "/stateRoot", committedRoot);
+    if (!rootPhase.commit()) return false;
+    if (!state.commitVersion(blockNum)) {
+        BOOST_LOG_TRIVIAL(error)
+            << "Failed to version state for block " << blockNum;
     }
-
-    // Update the global state tree
-    state.updateTree(allUpdatedKeys);
+    return true;
 }
 
 bool leaderProtocol(string raftTerm, int txnCount, int thCount, string mode, int count) {
@@ -283,6 +413,9 @@ bool leaderProtocol(string raftTerm, int txnCount, int thCount, string mode, int
 
   bool DAG = false;
 
+  // The previous block is committed, so nobody fetches its blobs anymore
+  retireBlobs();
+
   // Block generation
   if (count % 2 == 0) {
       BOOST_LOG_TRIVIAL(info) << "Setup File is running (even count)." << count;
@@ -302,6 +435,7 @@ bool leaderProtocol(string raftTerm, int txnCount, int thCount, string mode, int
   }
 
   std::string base_path, blockKey, compKey, runKey, commitKey;
+  bool opened = false;
 
   std::thread t1([&]() {
       if (!latestBlock.SerializeToString(&serializedBlock)) {
@@ -325,32 +459,24 @@ bool leaderProtocol(string raftTerm, int txnCount, int thCount, string mode, int
       commitKey = base_path + "/commit";
       cout<<"Base path: "<<base_path<<endl;
 
-      auto etcd_block_start = std::chrono::high_resolution_clock::now();
-      response = etcdClient.set(blockKey, serializedBlock).get();
-      auto etcd_block_end = std::chrono::high_resolution_clock::now();
+      if (!claimLeaderTerm(raftTerm)) {
+          BOOST_LOG_TRIVIAL(error) << "Term " << raftTerm << " was superseded.";
+          return;
+      }
+
+      // block, run=wait and commit=0/1 in one round trip
+      auto etcd_open_start = std::chrono::high_resolution_clock::now();
+      ControlTxn openPhase(raftTerm, "open");
+      openPhase.putBlob(blockKey, serializedBlock)
+          .put(runKey, "wait")
+          .put(commitKey, (mode == "validation") ? "1" : "0");
+      opened = openPhase.commit();
+      auto etcd_open_end = std::chrono::high_resolution_clock::now();
 
       BOOST_LOG_TRIVIAL(info)
-          << "ETCD write (block): "
-          << std::chrono::duration_cast<std::chrono::milliseconds>(etcd_block_end - etcd_block_start).count()
+          << "ETCD write (block, run=wait, commit=0/1): "
+          << std::chrono::duration_cast<std::chrono::milliseconds>(etcd_open_end - etcd_open_start).count()
           << " ms";
-          auto etcd_run_wait_start = std::chrono::high_resolution_clock::now();
-          response = etcdClient.set(runKey, "wait").get();
-          auto etcd_run_wait_end = std::chrono::high_resolution_clock::now();
-    
-          BOOST_LOG_TRIVIAL(info)
-              << "ETCD write (run=wait): "
-              << std::chrono::duration_cast<std::chrono::milliseconds>(etcd_run_wait_end - etcd_run_wait_start).count()
-              << " ms";
-    
-          auto etcd_commit0_start = std::chrono::high_resolution_clock::now();
-          response = etcdClient.set(commitKey, (mode == "validation") ? "1" : "0").get();
-          auto etcd_commit0_end = std::chrono::high_resolution_clock::now();
-    
-          BOOST_LOG_TRIVIAL(info)
-              << "ETCD write (commit=0/1): "
-              << std::chrono::duration_cast<std::chrono::milliseconds>(etcd_commit0_end - etcd_commit0_start).count()
-              << " ms";
-    
   });
   
   std::thread t2([&]() {
@@ -369,49 +495,110 @@ bool leaderProtocol(string raftTerm, int txnCount, int thCount, string mode, int
   t1.join();
   t2.join();
 
-  if (DAG) {
+  if (DAG && opened) {
       BOOST_LOG_TRIVIAL(info) << base_path;
 
-      componentsMonitor = std::thread(&leader::monitorComponents, this, compKey);
-
-
-      if (!assignFollowers(compKey)) return false;
+      // components, partitions and run=start in one round trip
+      ControlTxn startPhase(raftTerm, "start");
+      if (!assignFollowers(compKey, &startPhase, thCount)) {
+          resetBlock();
+          return false;
+      }
+      if (defaultCommitMode() == "distributed") {
+          // Partition owners for distributed commit, see partitions.h
+          startPhase.put(base_path + "/partitions",
+                         serializeMembers(healthyMemberIds));
+      }
+      startPhase.put(runKey, "start");
 
       exeS = std::chrono::high_resolution_clock::now();
 
       auto etcd_run_start_start = std::chrono::high_resolution_clock::now();
-      response = etcdClient.set(runKey, "start").get();
+      bool started = startPhase.commit();
       auto etcd_run_start_end = std::chrono::high_resolution_clock::now();
 
       BOOST_LOG_TRIVIAL(info)
-          << "ETCD write (run=start): "
+          << "ETCD write (components, run=start): "
           << std::chrono::duration_cast<std::chrono::milliseconds>(etcd_run_start_end - etcd_run_start_start).count()
           << " ms";
+      if (!started) {
+          resetBlock();
+          return false;
+      }
+
+      // The share reads a copy of the table, taken before the monitor
+      // starts reassigning its components
+      std::string shareTable;
+      if (defaultLeaderThreads() > 0 && !table.SerializeToString(&shareTable)) {
+          BOOST_LOG_TRIVIAL(error) << "Failed to serialize the leader's share.";
+          resetBlock();
+          return false;
+      }
+
+      componentsMonitor =
+          std::thread(&leader::monitorComponents, this, compKey, raftTerm);
+
+      // Hybrid mode: the leader executes its share next to coordinating
+      std::unique_ptr<GlobalState> shareState;
+      std::unique_ptr<scheduler> worker;
+      std::thread share;
+      if (defaultLeaderThreads() > 0) {
+          shareState = std::make_unique<GlobalState>();
+          worker = std::make_unique<scheduler>(*shareState);
+          share = std::thread(&leader::executeShare, this, std::ref(*worker),
+                              std::cref(serializedBlock),
+                              std::cref(shareTable), raftTerm,
+                              (int)header.block_num());
+      }
 
-      checkComponents(compKey + "/status", txnCount);
+      bool done = checkComponents(base_path, componentCount.load(), raftTerm);
 
+      // run=finish and commit=1 in one round trip; a block that did not
+      // finish is closed with commit=0, so the members drop its writes
       auto etcd_run_finish_start = std::chrono::high_resolution_clock::now();
-      response = etcdClient.set(runKey, "finish").get();
+      ControlTxn finishPhase(raftTerm, "finish");
+      finishPhase.put(runKey, "finish").put(commitKey, done ? "1" : "0");
+      bool finished = finishPhase.commit() && done;
       auto etcd_run_finish_end = std::chrono::high_resolution_clock::now();
 
       BOOST_LOG_TRIVIAL(info)
-          << "ETCD write (run=finish): "
+          << "ETCD write (run=finish, commit=1): "
           << std::chrono::duration_cast<std::chrono::milliseconds>(etcd_run_finish_end - etcd_run_finish_start).count()
           << " ms";
-
-      auto etcd_commit1_start = std::chrono::high_resolution_clock::now();
-      response = etcdClient.set(commitKey, "1").get();
-      auto etcd_commit1_end = std::chrono::high_resolution_clock::now();
-
-      BOOST_LOG_TRIVIAL(info)
-          << "ETCD write (commit=1): "
-          << std::chrono::duration_cast<std::chrono::milliseconds>(etcd_commit1_end - etcd_commit1_start).count()
-          << " ms";
+      if (share.joinable()) {
+          // Without run=finish the share has to be stopped by hand
+          if (!finished) worker->flag.store(false);
+          share.join();
+          // One open handle per store: close it before the commit opens one
+          worker.reset();
+          shareState.reset();
+      }
+      if (!finished) {
+          componentsMonitor.join();
+          resetBlock();
+          return false;
+      }
 
       exeE = std::chrono::high_resolution_clock::now();
 
-      saveData(base_path, memberList.size());
-      db.storeBlock("B" + to_string(header.block_num()), serializedBlock);
+      if (defaultCommitMode() == "distributed") {
+          if (!saveDataDistributed(base_path, header.block_num(), raftTerm)) {
+              componentsMonitor.join();
+              resetBlock();
+              return false;
+          }
+      } else {
+          saveData(base_path, header.block_num());
+      }
+      db.storeBlock("B" + to_string(header.block_num()), serializedBlock,
+                    committedRoot);
+      if (defaultSnapshotInterval() > 0) {
+          GlobalState state;
+          if (!snapshotIfDue(state, header.block_num(), serializedBlock)) {
+              BOOST_LOG_TRIVIAL(error) << "Failed to snapshot state at block "
+                                       << header.block_num();
+          }
+      }
 
       end = std::chrono::high_resolution_clock::now();
 
@@ -432,21 +619,43 @@ bool leaderProtocol(string raftTerm, int txnCount, int thCount, string mode, int
           << std::chrono::duration_cast<std::chrono::milliseconds>(end - blockC).count() << " ms";
 
       componentsMonitor.join();
-      DAGObj.dagClean();
-      componentCount.store(0, std::memory_order_relaxed);
-      table.Clear();
-      healthyMemberIds.clear();
-      memberList.clear();
-
-      if (count % 2 == 0) {
-          GlobalState state;
-          state.resetTree();
-      }
+      resetBlock();
 
       return true;
   }
 
+  resetBlock();
   return false;
 }
 
+// Runs the leader's share of the block with the followers' scheduler, on
+// defaultLeaderThreads() threads niced below coordination. serializedTable
+// is the assignment as published; the member table is left to
+// monitorComponents. Returns once the block is finished or worker.flag is
+// cleared.
+void executeShare(scheduler& worker, const std::string& serializedBlock,
+                  const std::string& serializedTable, const std::string& term,
+                  int blockNum) {
+    int threads = defaultLeaderThreads();
+    worker.threadCount = threads;
+    worker.workerNice = 10;
+    worker.claimLease = healthMonitor().lease();
+    worker.extractBlock(serializedBlock);
+    worker.ExtractComponents(serializedTable, selfId());
+    worker.prefetchReadSet(threads);
+    if (!worker.scheduleTxns(node_id, term, blockNum, threads)) {
+        BOOST_LOG_TRIVIAL(error) << "Leader share of block " << blockNum
+                                 << " stopped before finishing.";
+    }
+}
+
+// Drops the per-block state, whether or not the block went through
+void resetBlock() {
+  DAGObj.dagClean();
+  componentCount.store(0, std::memory_order_relaxed);
+  table.Clear();
+  healthyMemberIds.clear();
+  memberList.clear();
+}
+
 };
\ No newline at end of file
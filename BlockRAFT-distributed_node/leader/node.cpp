@@ -85,72 +85,43 @@ bool isEtcdClusterHealthy(const std::string &output, int memCount) {
   return isHealthy;
 }
 
+// The monitors below read the health monitor's cache and wake on its
+// changes, instead of running etcdctl and rpk every 10 seconds
 void etcdMonitorFunc() {
-  string output;
-  int count = 1;
-  bool health;
-  etcd::Response response = etcdClient.list_member().get();
-  int memCount = response.members().size();
-  clusterSize = memCount;
-  while (true) {
-    output = executeCommand("etcdctl endpoint health --cluster 2>&1");
-    health = isEtcdClusterHealthy(output, memCount);
-    if (!health) {
+  clusterSize = healthMonitor().members().size();
+  uint64_t seen = healthMonitor().generation();
+  while (healthMonitor().running()) {
+    if (!healthMonitor().etcdQuorum()) {
       etcdHealth.store(false);
       return;
     }
-    std::this_thread::sleep_for(std::chrono::seconds(10));
+    seen = healthMonitor().waitForChange(
+        seen, std::chrono::milliseconds(defaultHealthCheckMs()));
   }
-  return;
 }
 
 void redpandaMonitorFunc() {
-  string output, word;
-  while (true) {
-    output = executeCommand("rpk cluster health");
-    std::istringstream stream(output);
-    while (stream >> word) {
-      if (word == "false") {
-        redpandaHealth.store(false);
-      }
+  uint64_t seen = healthMonitor().generation();
+  while (healthMonitor().running()) {
+    if (!healthMonitor().redpandaHealthy()) {
+      redpandaHealth.store(false);
     }
-    std::this_thread::sleep_for(std::chrono::seconds(10));
+    seen = healthMonitor().waitForChange(
+        seen, std::chrono::milliseconds(defaultHealthCheckMs()));
   }
 }
 
 bool findLeader() {
-  vector<string> values;
-  string command = "etcdctl endpoint status ";
-  string output = executeCommand(command);
-
-  if (output.empty()) {
-    etcdHealth.store(false);
-    return false;
-  }
-
-  stringstream ss(output);
-  string item;
-  while (getline(ss, item, ',')) {
-    item.erase(0, item.find_first_not_of(" \t"));
-    item.erase(item.find_last_not_of(" \t") + 1);
-    values.push_back(item);
-  }
-
-  if (values.size() < 7) {
+  HealthMonitor::Status status = healthMonitor().status();
+  if (!status.reachable) {
     etcdHealth.store(false);
     return false;
   }
 
   etcdHealth.store(true);
-  raftTerm = values[6];
-
-  if (values[4] == "true") {
-    isLeader.store(true);
-    return true;
-  } else {
-    isLeader.store(false);
-    return false;
-  }
+  raftTerm = to_string(status.raftTerm);
+  isLeader.store(status.leader);
+  return status.leader;
 }
 
 std::string int64ToHex(int64_t leaseID) {
@@ -176,8 +147,6 @@ int main() {
   initFileLogging();
   etcd::Response response;
   thread etcdMonitor, leaderLease, redpandaMonitor;
-  etcdMonitor = thread(&etcdMonitorFunc);
-  redpandaMonitor = thread(&redpandaMonitorFunc);
   std::ifstream configFile("../config.json");
   if (!configFile.is_open()) {
     BOOST_LOG_TRIVIAL(error) << "Failed to open config.json";
@@ -192,11 +161,78 @@ int main() {
   int count=0, blocksCount = configJson["blocks"];
   std::string schedulerMode = configJson["scheduler"];
   std::string executionMode = configJson["mode"];
+  if (configJson.contains("blockCacheMB")) {
+    setBlockCacheMB(configJson["blockCacheMB"]);
+  }
+  if (configJson.contains("stateBackend")) {
+    defaultStateBackend() = configJson["stateBackend"];
+  }
+  if (configJson.contains("stateRetention")) {
+    defaultVersionRetention() = configJson["stateRetention"];
+  }
+  if (configJson.contains("commitMode")) {
+    defaultCommitMode() = configJson["commitMode"];
+  }
+  if (defaultCommitMode() == "distributed" && defaultVersionRetention() > 0) {
+    BOOST_LOG_TRIVIAL(error)
+        << "stateRetention needs commitMode \"replicated\"";
+    return 1;
+  }
+  if (configJson.contains("distribution")) {
+    defaultDistribution() = configJson["distribution"];
+  }
+  if (configJson.contains("claimBatch")) {
+    defaultClaimBatch() = configJson["claimBatch"];
+  }
+  if (configJson.contains("leaderThreads")) {
+    defaultLeaderThreads() = configJson["leaderThreads"];
+  }
+  if (configJson.contains("componentTimeoutMs")) {
+    defaultComponentTimeoutMs() = configJson["componentTimeoutMs"];
+  }
+  if (configJson.contains("addressFilterBitsPerKey")) {
+    defaultAddressFilterBitsPerKey() = configJson["addressFilterBitsPerKey"];
+  }
+  if (configJson.contains("dataPlanePort")) {
+    defaultDataPlanePort() = configJson["dataPlanePort"];
+  }
+  startDataPlane();
+  if (configJson.contains("healthHeartbeatMs")) {
+    defaultHeartbeatMs() = configJson["healthHeartbeatMs"];
+  }
+  if (configJson.contains("healthTimeoutMs")) {
+    defaultFailureTimeoutMs() = configJson["healthTimeoutMs"];
+  }
+  if (configJson.contains("healthCheckMs")) {
+    defaultHealthCheckMs() = configJson["healthCheckMs"];
+  }
+  leaderObj.nodeDetails();
+  healthMonitor().start(node_id);
+  etcdMonitor = thread(&etcdMonitorFunc);
+  redpandaMonitor = thread(&redpandaMonitorFunc);
+  if (configJson.contains("snapshotInterval")) {
+    defaultSnapshotInterval() = configJson["snapshotInterval"];
+  }
+  if (configJson.contains("snapshotsKept")) {
+    defaultSnapshotsKept() = configJson["snapshotsKept"];
+  }
+  // One follower runtime serves every block this node follows, keeping its
+  // state handle, scheduler and leader watch. It is dropped while the node
+  // leads, since the leader opens the same state store.
+  std::unique_ptr<follower> runtime;
+  if (defaultSnapshotInterval() > 0) {
+    runtime = std::make_unique<follower>();
+    int booted = runtime->bootFromSnapshot(leaderObj.db);
+    if (booted >= 0) {
+      BOOST_LOG_TRIVIAL(info) << "State restored up to block " << booted;
+    }
+  }
   // executeCommand("etcdctl del \"\" --prefix");
 
   while (etcdHealth.load() && redpandaHealth.load() && count< blocksCount) {
     if (leaderObj.nodeDetails()) {
       if (findLeader()) {
+        runtime.reset();
         if (!LLease.load()) {
           leaderLease = thread(&leaderTTL);
         }
@@ -211,7 +247,8 @@ int main() {
         }
       } else {
         // Follower branch:
-        follower f;
+        if (!runtime) runtime = std::make_unique<follower>();
+        follower& f = *runtime;
         std::string leader_id = f.getLeaderID();  // fetch initial leader
         if (leader_id.empty()) {
           // BOOST_LOG_TRIVIAL(warning)
@@ -244,9 +281,11 @@ int main() {
             continue;  // restart the main loop
           }
 
-          if (executionMode == "validation") {
+          // Every member keeps the blocks it committed, which a restart
+          // replays after the newest snapshot
+          if (f.committedBlock == block_num) {
             leaderObj.db.storeBlock("B" + to_string(block_num),
-                                    serializedBlock);
+                                    serializedBlock, f.committedRoot);
           }
         } else {
           // BOOST_LOG_TRIVIAL(info) << "No blocks found to execute as follower.";
@@ -255,7 +294,9 @@ int main() {
       BOOST_LOG_TRIVIAL(info) << "The block was successfully executed.";
     }
   }
-  leaderObj.db.destroyDB();
+  // Booting from a snapshot replays the stored chain, so it survives
+  if (defaultSnapshotInterval() == 0) leaderObj.db.destroyDB();
+  healthMonitor().stop();
   etcdMonitor.join();
   redpandaMonitor.join();
   if (findLeader()) {
@@ -0,0 +1,129 @@
+#pragma once
+#include <boost/log/trivial.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <etcd/Client.hpp>
+#include <etcd/Response.hpp>
+#include <etcd/Watcher.hpp>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "etcdGlobals.h"
+
+// Mirrors the keys under an etcd prefix (or a single key, which is its own
+// prefix) from one watch, so waiting for a block's run state or for
+// component counts costs one range read and the watch events instead of a
+// linearizable read per poll. The mirror keeps each key's latest revision,
+// so the seeding read and events racing with it settle on the newest value.
+class PrefixWatch {
+ public:
+  using Values = std::map<std::string, std::string>;
+
+ private:
+  struct Entry {
+    std::string value;
+    int64_t revision = 0;
+  };
+
+  std::string prefix;
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::map<std::string, Entry> entries;
+  std::unique_ptr<etcd::Watcher> watcher;
+
+  // Applies a value unless a newer revision of the key is already known;
+  // an empty value with deleted set removes the key
+  void apply(const std::string& key, const std::string& value,
+             int64_t revision, bool deleted) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(key);
+    if (it != entries.end() && revision != 0 &&
+        it->second.revision > revision) {
+      return;
+    }
+    if (deleted) {
+      entries.erase(key);
+    } else {
+      entries[key] = {value, revision};
+    }
+    changed.notify_all();
+  }
+
+  void onEvent(const etcd::Response& response) {
+    if (!response.is_ok()) {
+      BOOST_LOG_TRIVIAL(error) << "Watch on " << prefix
+                               << " failed: " << response.error_message();
+      return;
+    }
+    for (const auto& event : response.events()) {
+      const etcd::Value& kv = event.kv();
+      apply(kv.key(), kv.as_string(), kv.modified_index(),
+            event.event_type() == etcd::Event::EventType::DELETE_);
+    }
+  }
+
+  Values snapshot() {
+    Values values;
+    for (const auto& [key, entry] : entries) values[key] = entry.value;
+    return values;
+  }
+
+ public:
+  // The watch is started before the seeding read, so no update falls
+  // between them
+  explicit PrefixWatch(const std::string& prefix) : prefix(prefix) {
+    watcher = std::make_unique<etcd::Watcher>(
+        etcdClient, prefix,
+        [this](etcd::Response response) { onEvent(response); }, true);
+    seed();
+  }
+
+  ~PrefixWatch() { watcher->Cancel(); }
+
+  // Reads every key under the prefix once
+  void seed() {
+    etcd::Response response = etcdClient.ls(prefix).get();
+    if (!response.is_ok()) return;
+    for (size_t i = 0; i < response.keys().size(); ++i) {
+      const etcd::Value& value = response.value(i);
+      apply(response.key(i), value.as_string(), value.modified_index(),
+            false);
+    }
+  }
+
+  // The mirrored values right now
+  Values current() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return snapshot();
+  }
+
+  // Blocks until done() holds for the mirrored values, or until stop()
+  // does, checked every stopCheck. A missed event can only delay the
+  // wait, so the prefix is re-read every resync in case the watch dropped.
+  // Returns whether done() held.
+  bool waitUntil(const std::function<bool(const Values&)>& done,
+                 const std::function<bool()>& stop,
+                 std::chrono::milliseconds stopCheck =
+                     std::chrono::milliseconds(10),
+                 std::chrono::milliseconds resync = std::chrono::seconds(1)) {
+    auto nextResync = std::chrono::steady_clock::now() + resync;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (changed.wait_for(lock, stopCheck,
+                             [&]() { return done(snapshot()); })) {
+          return true;
+        }
+      }
+      if (stop()) return false;
+      if (std::chrono::steady_clock::now() >= nextResync) {
+        seed();
+        nextResync = std::chrono::steady_clock::now() + resync;
+      }
+    }
+  }
+};
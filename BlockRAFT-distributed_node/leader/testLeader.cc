@@ -30,6 +30,37 @@ TEST(LeaderTest, GetActiveFollowers) {
   EXPECT_TRUE(activeFollowers >= 2);
 }
 #endif
+TEST(HealthMonitorTest, LivenessTimesOut) {
+  using namespace std::chrono;
+  Liveness liveness;
+  auto start = Liveness::Clock::now();
+  liveness.seen("s1", start);
+  liveness.seen("s2", start);
+
+  EXPECT_TRUE(liveness.alive("s1", start + milliseconds(500),
+                             milliseconds(800)));
+  EXPECT_FALSE(liveness.alive("s3", start, milliseconds(800)));
+
+  // s2 keeps beating, s1 stops and is dead once the timeout passes
+  liveness.seen("s2", start + milliseconds(600));
+  EXPECT_FALSE(liveness.alive("s1", start + milliseconds(900),
+                              milliseconds(800)));
+  EXPECT_TRUE(liveness.alive("s2", start + milliseconds(900),
+                             milliseconds(800)));
+
+  // A deleted heartbeat key means dead right away
+  liveness.gone("s2");
+  EXPECT_FALSE(liveness.alive("s2", start + milliseconds(900),
+                              milliseconds(800)));
+}
+
+TEST(ControlTxnTest, TermValuesOrderNumerically) {
+  EXPECT_EQ(termValue("42").size(), 20);
+  EXPECT_LT(termValue("9"), termValue("10"));
+  EXPECT_LT(termValue("99"), termValue("100"));
+  EXPECT_EQ(termValue("7"), termValue("7"));
+}
+
 TEST(LeaderTest, RTrim) {
   leader leaderObj;
   std::string str = "Hello\n\n";
@@ -79,6 +110,29 @@ TEST(AssignFollowersTest, FollowersAssignedEqually) {
   }
 }
 
+TEST(AssignFollowersTest, LeaderShareFollowsThreads) {
+  leader leaderObj;
+
+  // Ten components of four transactions each
+  for (int i = 0; i < 10; ++i) {
+    components::componentsTable::component* comp =
+        leaderObj.table.add_componentslist();
+    for (int j = 0; j < 4; ++j) {
+      comp->add_transactionlist()->set_id(i * 4 + j);
+    }
+  }
+  // Two followers with 8 threads, the leader (s0) with 4 spare ones
+  leaderObj.assignWeighted({{1, 8}, {2, 8}, {0, 4}});
+
+  std::unordered_map<int, int> txns;
+  for (const auto& comp : leaderObj.table.componentslist()) {
+    txns[comp.assignedfollower()] += comp.transactionlist_size();
+  }
+  EXPECT_EQ(txns[1], 16);
+  EXPECT_EQ(txns[2], 16);
+  EXPECT_EQ(txns[0], 8);
+}
+
 // Main function to run all tests
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,198 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+
+using namespace std;
+
+// Filter bits per leaf key; 0 disables the filter. About 10 bits keep the
+// false-positive rate near 1%. node.cpp sets it from the
+// "addressFilterBitsPerKey" config key.
+inline size_t& defaultAddressFilterBitsPerKey() {
+  static size_t bits = 10;
+  return bits;
+}
+
+// Blocked bloom filter over the leaf keys of a state, so reads of
+// addresses that never existed (new accounts during setup, first votes)
+// are answered without a store lookup. Each key maps to one 512-bit block,
+// a cache line, and sets one bit in each of its eight words. Leaf keys are
+// already SHA-256 hex digests, so their digits index the filter directly.
+//
+// Keys are only ever added: erased leaves stay in the filter as false
+// positives until the next rebuild. add() and mayContain() are safe to call
+// concurrently; reset() is not, so a filter in use is never reset but
+// replaced (see SharedAddressFilter).
+class AddressFilter {
+ public:
+  struct Stats {
+    size_t keys = 0;
+    size_t capacity = 0;
+    size_t bytes = 0;
+    size_t skipped = 0;         // lookups the filter answered
+    size_t falsePositives = 0;  // lookups it passed that found nothing
+
+    double falsePositiveRate() const {
+      size_t absent = skipped + falsePositives;
+      return absent == 0 ? 0.0 : double(falsePositives) / absent;
+    }
+  };
+
+ private:
+  static const size_t kWordsPerBlock = 8;
+  static const size_t kBitsPerBlock = kWordsPerBlock * 64;
+  static const size_t kMinKeys = 1 << 16;
+
+  size_t bitsPerKey;
+  size_t blocks = 0;
+  size_t capacity = 0;
+  unique_ptr<atomic<uint64_t>[]> words;
+  atomic<size_t> keys{0};
+  mutable atomic<size_t> skipped{0};
+  atomic<size_t> falsePositives{0};
+
+  static uint64_t hexBits(const string& keyHash, size_t from) {
+    uint64_t bits = 0;
+    for (size_t i = from; i < from + 16; ++i) {
+      char c = keyHash[i];
+      bits = bits << 4 | (c <= '9' ? c - '0' : c - 'a' + 10);
+    }
+    return bits;
+  }
+
+  // The block of a key and, in `probes`, one bit offset per word
+  size_t locate(const string& keyHash, uint64_t& probes) const {
+    probes = hexBits(keyHash, 16);
+    return hexBits(keyHash, 0) % blocks;
+  }
+
+ public:
+  explicit AddressFilter(size_t bitsPerKey) : bitsPerKey(bitsPerKey) {
+    reset(0);
+  }
+
+  // Empties the filter and sizes it for expectedKeys with room to double
+  void reset(size_t expectedKeys) {
+    capacity = max(expectedKeys * 2, kMinKeys);
+    blocks = max<size_t>(
+        (capacity * bitsPerKey + kBitsPerBlock - 1) / kBitsPerBlock, 1);
+    words.reset(new atomic<uint64_t>[blocks * kWordsPerBlock]);
+    for (size_t i = 0; i < blocks * kWordsPerBlock; ++i) {
+      words[i].store(0, memory_order_relaxed);
+    }
+    keys.store(0);
+    skipped.store(0);
+    falsePositives.store(0);
+  }
+
+  // keyHash is a 64-character leaf key
+  void add(const string& keyHash) {
+    uint64_t probes;
+    atomic<uint64_t>* block =
+        &words[locate(keyHash, probes) * kWordsPerBlock];
+    bool added = false;
+    for (size_t i = 0; i < kWordsPerBlock; ++i, probes >>= 6) {
+      uint64_t bit = uint64_t(1) << (probes & 63);
+      added |= !(block[i].fetch_or(bit, memory_order_relaxed) & bit);
+    }
+    if (added) keys.fetch_add(1, memory_order_relaxed);
+  }
+
+  // False means the key was never added
+  bool mayContain(const string& keyHash) const {
+    uint64_t probes;
+    const atomic<uint64_t>* block =
+        &words[locate(keyHash, probes) * kWordsPerBlock];
+    for (size_t i = 0; i < kWordsPerBlock; ++i, probes >>= 6) {
+      uint64_t bit = uint64_t(1) << (probes & 63);
+      if (!(block[i].load(memory_order_relaxed) & bit)) {
+        skipped.fetch_add(1, memory_order_relaxed);
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Called when a key the filter passed turned out to be absent
+  void recordFalsePositive() {
+    falsePositives.fetch_add(1, memory_order_relaxed);
+  }
+
+  // More keys than the filter was sized for; the rate climbs from here
+  bool overloaded() const { return keys.load() > capacity; }
+
+  Stats stats() const {
+    Stats s;
+    s.keys = keys.load();
+    s.capacity = capacity;
+    s.bytes = blocks * kBitsPerBlock / 8;
+    s.skipped = skipped.load();
+    s.falsePositives = falsePositives.load();
+    return s;
+  }
+};
+
+// The filter of one state path, shared by the instances open on it.
+// Rebuilding fills a new filter and publishes it with an atomic swap, so
+// a reader keeps the filter it loaded until it is done with it. Writers
+// hold writing() from their store write through add(), so a rebuild's scan
+// either sees the stored key or the add lands in the new filter.
+class SharedAddressFilter {
+ private:
+  shared_ptr<AddressFilter> filter;  // read and replaced atomically
+  shared_mutex rebuildMutex;
+
+  static map<string, shared_ptr<SharedAddressFilter>>& registry() {
+    static map<string, shared_ptr<SharedAddressFilter>> filters;
+    return filters;
+  }
+  static mutex& registryMutex() {
+    static mutex lock;
+    return lock;
+  }
+
+ public:
+  explicit SharedAddressFilter(const function<void(AddressFilter&)>& build) {
+    rebuild(build);
+  }
+
+  shared_ptr<AddressFilter> current() const { return atomic_load(&filter); }
+
+  shared_lock<shared_mutex> writing() {
+    return shared_lock<shared_mutex>(rebuildMutex);
+  }
+
+  // Adds to the current filter; the caller holds writing()
+  void add(const string& keyHash) { current()->add(keyHash); }
+
+  void rebuild(const function<void(AddressFilter&)>& build) {
+    unique_lock<shared_mutex> lock(rebuildMutex);
+    auto next = make_shared<AddressFilter>(defaultAddressFilterBitsPerKey());
+    build(*next);
+    atomic_store(&filter, next);
+  }
+
+  // One filter per state path in the process, like the stores themselves,
+  // so the instances a node opens block after block share a filter built
+  // once, by `build`, when the first of them opens.
+  static shared_ptr<SharedAddressFilter> forPath(
+      const string& path, const function<void(AddressFilter&)>& build) {
+    lock_guard<mutex> lock(registryMutex());
+    auto& filter = registry()[path];
+    if (!filter) filter = make_shared<SharedAddressFilter>(build);
+    return filter;
+  }
+
+  // Forgets the filter of a store written behind GlobalState's back (e.g.
+  // by SST ingestion); the next GlobalState opened on it builds a new one.
+  static void drop(const string& path) {
+    lock_guard<mutex> lock(registryMutex());
+    registry().erase(path);
+  }
+};
@@ -0,0 +1,45 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include "bulkLoadInput.h"
+#include "bulkLoader.h"
+#include "globalState.h"
+
+// Usage: bulkLoad <dbPath> <input> [--setup]
+// Builds the initial state at dbPath, which must hold an empty trie, from
+// "address value" lines sorted by address (e.g. LC_ALL=C sort -s -k1,1) or,
+// with --setup, from a wallet setup file. Run it while no node has the
+// store open.
+int main(int argc, char* argv[]) {
+  bool setup = argc == 4 && std::string(argv[3]) == "--setup";
+  if (argc != 3 && !setup) {
+    std::cerr << "Usage: bulkLoad <dbPath> <input> [--setup]" << std::endl;
+    return 1;
+  }
+  std::string dbPath = argv[1];
+
+  auto start = std::chrono::high_resolution_clock::now();
+  BulkLoader loader(dbPath + "_bulk");
+  bool read = setup ? readSetupFile(argv[2], loader)
+                    : readPairs(argv[2], loader);
+  if (!read) {
+    std::cerr << "Cannot read " << argv[2] << std::endl;
+    return 1;
+  }
+  {
+    RocksDBBackend backend(dbPath);
+    if (!loader.loadInto(backend)) {
+      std::cerr << "Bulk load failed" << std::endl;
+      return 1;
+    }
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+
+  GlobalState state(dbPath);
+  std::cout << "Loaded " << loader.lastLoad().addresses << " addresses ("
+            << loader.lastLoad().interiorNodes << " interior nodes) in "
+            << std::chrono::duration<double>(end - start).count()
+            << " s, root " << state.getRootHash() << std::endl;
+  return 0;
+}
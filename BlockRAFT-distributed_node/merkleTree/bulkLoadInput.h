@@ -0,0 +1,53 @@
+#pragma once
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+
+#include "bulkLoader.h"
+
+// Input formats of the bulkLoad tool
+
+// Streams "address value" lines, sorted by address, into the loader
+inline bool readPairs(const std::string& path, BulkLoader& loader) {
+  std::ifstream in(path);
+  if (!in) return false;
+  std::string line, address, value;
+  while (std::getline(in, line)) {
+    std::istringstream iss(line);
+    if (iss >> address >> value && !loader.add(address, value)) return false;
+  }
+  return true;
+}
+
+// Folds the deposits of a setup file (e.g. leader/setupFile.txt) into the
+// balances the wallet contract would hold after running it. Wallets are
+// stored under "wallet" + client + key, as walletClient addresses them.
+inline bool readSetupFile(const std::string& path, BulkLoader& loader) {
+  std::ifstream in(path);
+  if (!in) return false;
+  std::map<std::string, long long> balances;
+  size_t skipped = 0;
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream iss(line);
+    std::string client, verb, name, password, amount;
+    if (iss >> client >> verb >> name >> password >> amount &&
+        client.find("walletClientMain") != std::string::npos &&
+        verb == "deposit") {
+      balances["wallet" + name + password] += std::stoll(amount);
+    } else if (!line.empty()) {
+      ++skipped;
+    }
+  }
+  // The map hands the wallets over in address order
+  for (const auto& [address, balance] : balances) {
+    loader.add(address, std::to_string(balance));
+  }
+  if (skipped > 0) {
+    std::cerr << "Skipped " << skipped << " lines that are not wallet deposits"
+              << std::endl;
+  }
+  return true;
+}
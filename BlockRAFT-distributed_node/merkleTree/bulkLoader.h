@@ -0,0 +1,346 @@
+#pragma once
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "hashEngine.h"
+#include "merkleProof.h"
+#include "rocksDBBackend.h"
+#include "rocksdb/sst_file_writer.h"
+#include "storageProfile.h"
+
+using namespace std;
+
+// Offline loader for genesis and setup state. Instead of one insert and one
+// path rehash per account, it takes the accounts as a stream sorted by
+// address, builds every trie level bottom-up in a single pass and writes
+// each column family as one sorted SST file that RocksDB ingests without
+// going through the memtable. The result is the trie GlobalState would
+// have built from the same inserts, including the raw-address index.
+//
+// Memory stays bounded whatever the input size. The address index is
+// written as the stream arrives; the leaves, which the trie needs in
+// key-hash order, are sorted in runs of runRecords spilled under workDir
+// and merged. Interior nodes are finished deepest-first, which is not key
+// order, so each depth is spilled to its own (sorted) file and the depths
+// are merged into the interior SST.
+class BulkLoader {
+ public:
+  struct Stats {
+    size_t addresses = 0;
+    size_t interiorNodes = 0;
+    string rootHash;
+  };
+
+ private:
+  static const size_t kDepth = 64;        // hex characters in a leaf key
+  static const size_t kHashChunk = 4096;  // leaf values hashed per batch
+
+  // Children collected so far for the open node at one depth
+  struct Frame {
+    string childKeys;    // ",child1,child2" as serialized in the node
+    string childHashes;  // labels and hashes, the node's hash input
+  };
+
+  // Merges files of "key\tvalue" lines, each sorted by key, into one
+  // key-ordered stream
+  class FileMerge {
+   private:
+    using Head = pair<string, size_t>;  // key, file
+    vector<ifstream> files;
+    vector<string> values;
+    priority_queue<Head, vector<Head>, greater<Head>> heads;
+
+    void advance(size_t file) {
+      string line;
+      if (!getline(files[file], line)) return;
+      size_t tab = line.find('\t');
+      values[file] = line.substr(tab + 1);
+      heads.emplace(line.substr(0, tab), file);
+    }
+
+   public:
+    explicit FileMerge(const vector<string>& paths)
+        : files(paths.size()), values(paths.size()) {
+      for (size_t i = 0; i < paths.size(); ++i) {
+        files[i].open(paths[i]);
+        advance(i);
+      }
+    }
+
+    bool next(string& key, string& value) {
+      if (heads.empty()) return false;
+      Head head = heads.top();
+      heads.pop();
+      key = move(head.first);
+      value = move(values[head.second]);
+      advance(head.second);
+      return true;
+    }
+  };
+
+  string workDir;
+  size_t runRecords;  // leaves sorted in memory at a time
+  Stats stats;
+
+  // The stream being added: the last address is held back until the next
+  // one shows it is not repeated
+  bool pending = false;
+  bool failed = false;
+  string pendingAddress;
+  string pendingValue;
+  unique_ptr<rocksdb::SstFileWriter> addressWriter;
+  vector<pair<string, string>> run;  // key hash, "address\tvalue"
+  vector<string> runPaths;
+
+  static rocksdb::Options familyOptions(TrieFamily family) {
+    return rocksdb::Options(profileDBOptions(),
+                            trieColumnFamilies()[family].options);
+  }
+
+  string sstPath(const string& name) const {
+    return workDir + "/" + name + ".sst";
+  }
+
+  string depthPath(size_t depth) const {
+    return workDir + "/depth" + to_string(depth);
+  }
+
+  using Put = function<bool(const string&, const string&)>;
+
+  // Writes the entries `produce` passes to put, in key order, to one SST
+  bool writeSst(TrieFamily family, const string& path,
+                const function<bool(const Put&)>& produce) {
+    rocksdb::SstFileWriter writer(rocksdb::EnvOptions(),
+                                  familyOptions(family));
+    if (!writer.Open(path).ok()) return false;
+    bool ok = produce([&](const string& key, const string& value) {
+      return writer.Put(key, value).ok();
+    });
+    return ok && writer.Finish().ok();
+  }
+
+  // Sorts the buffered leaves by key hash into a run file
+  bool spillRun() {
+    if (run.empty()) return true;
+    sort(run.begin(), run.end());
+    runPaths.push_back(workDir + "/run" + to_string(runPaths.size()));
+    ofstream out(runPaths.back());
+    for (const auto& [keyHash, value] : run) {
+      out << keyHash << '\t' << value << '\n';
+    }
+    run.clear();
+    return bool(out);
+  }
+
+  // Writes the held-back address to the index and buffers its leaf
+  bool flushPending() {
+    if (!pending) return true;
+    pending = false;
+    if (!addressWriter) {
+      filesystem::remove_all(workDir);
+      filesystem::create_directories(workDir);
+      stats = Stats();
+      addressWriter = make_unique<rocksdb::SstFileWriter>(
+          rocksdb::EnvOptions(), familyOptions(kAddressFamily));
+      if (!addressWriter->Open(sstPath("addresses")).ok()) return false;
+    }
+    if (!addressWriter->Put(kAddressPrefix + pendingAddress, pendingValue)
+             .ok()) {
+      return false;
+    }
+    ++stats.addresses;
+    run.emplace_back(HashEngine::hash(pendingAddress),
+                     pendingAddress + '\t' + pendingValue);
+    return run.size() < runRecords || spillRun();
+  }
+
+  // Drops the stream and its files, ready for the next one
+  void reset() {
+    pending = failed = false;
+    addressWriter.reset();
+    run.clear();
+    runPaths.clear();
+    filesystem::remove_all(workDir);
+  }
+
+  // Builds leaves and interior levels from the merged runs, in key-hash
+  // order. Leaves and their addresses go straight to their SSTs; every
+  // interior node is finished once the next key leaves its prefix and
+  // spilled to the file of its depth.
+  bool buildTrie(string& rootEntry) {
+    rocksdb::SstFileWriter leafAddresses(rocksdb::EnvOptions(),
+                                         familyOptions(kMetaFamily));
+    if (!leafAddresses.Open(sstPath("leafAddresses")).ok()) return false;
+    vector<ofstream> depthFiles(kDepth);
+    for (size_t depth = 1; depth < kDepth; ++depth) {
+      depthFiles[depth].open(depthPath(depth));
+      if (!depthFiles[depth]) return false;
+    }
+    vector<Frame> frames(kDepth);
+    string previous;
+
+    auto closeFrame = [&](size_t depth) {
+      string prefix = previous.substr(0, depth);
+      string hash = HashEngine::hash(frames[depth].childHashes);
+      depthFiles[depth] << prefix << '\t' << hash << ','
+                        << frames[depth].childKeys << '\n';
+      frames[depth - 1].childKeys += "," + prefix;
+      appendChildHash(frames[depth - 1].childHashes, prefix.back(), hash);
+      frames[depth] = Frame();
+      ++stats.interiorNodes;
+    };
+
+    FileMerge leaves(runPaths);
+    auto writeLeaves = [&](const Put& put) {
+      vector<string> keyHashes, addresses, values;
+      bool more = true;
+      while (more) {
+        keyHashes.clear();
+        addresses.clear();
+        values.clear();
+        string nextKey, nextValue;
+        while (keyHashes.size() < kHashChunk &&
+               (more = leaves.next(nextKey, nextValue))) {
+          size_t tab = nextValue.find('\t');
+          keyHashes.push_back(move(nextKey));
+          addresses.push_back(nextValue.substr(0, tab));
+          values.push_back(nextValue.substr(tab + 1));
+        }
+        vector<string> hashes = HashEngine::hashBatch(values);
+
+        for (size_t i = 0; i < keyHashes.size(); ++i) {
+          const string& keyHash = keyHashes[i];
+          if (!previous.empty()) {
+            size_t common = 0;
+            while (previous[common] == keyHash[common]) ++common;
+            for (size_t depth = kDepth - 1; depth > common; --depth) {
+              closeFrame(depth);
+            }
+          }
+          if (!put(keyHash, hashes[i] + "," + values[i]) ||
+              !leafAddresses.Put(kLeafAddressPrefix + keyHash, addresses[i])
+                   .ok()) {
+            return false;
+          }
+          frames[kDepth - 1].childKeys += "," + keyHash;
+          appendChildHash(frames[kDepth - 1].childHashes, keyHash.back(),
+                          hashes[i]);
+          previous = keyHash;
+        }
+      }
+      return true;
+    };
+    if (!writeSst(kLeafFamily, sstPath("leaves"), writeLeaves) ||
+        !leafAddresses.Finish().ok()) {
+      return false;
+    }
+    for (size_t depth = kDepth - 1; depth > 0; --depth) closeFrame(depth);
+
+    stats.rootHash = HashEngine::hash(frames[0].childHashes);
+    rootEntry = stats.rootHash + "," + frames[0].childKeys;
+    for (auto& file : depthFiles) file.close();
+    return true;
+  }
+
+  // Merges the per-depth files, each sorted, into the interior SST
+  bool writeInterior() {
+    vector<string> paths;
+    for (size_t depth = 1; depth < kDepth; ++depth) {
+      paths.push_back(depthPath(depth));
+    }
+    FileMerge nodes(paths);
+    auto merge = [&](const Put& put) {
+      string key, value;
+      while (nodes.next(key, value)) {
+        if (!put(key, value)) return false;
+      }
+      return true;
+    };
+    return writeSst(kInteriorFamily, sstPath("interior"), merge);
+  }
+
+ public:
+  explicit BulkLoader(const string& workDir, size_t runRecords = 1 << 18)
+      : workDir(workDir), runRecords(max<size_t>(runRecords, 1)) {}
+
+  ~BulkLoader() {
+    if (addressWriter) reset();
+  }
+
+  // Addresses arrive in ascending order; for a repeated address the last
+  // value wins. Values may not contain commas, as for GlobalState::insert(),
+  // nor newlines. Returns false, and fails the load, when the stream goes
+  // out of order.
+  bool add(const string& address, const string& value) {
+    if (failed) return false;
+    if (pending && address == pendingAddress) {
+      pendingValue = value;
+      return true;
+    }
+    if (pending && address < pendingAddress) {
+      cerr << "Bulk load input is not sorted: " << address << " after "
+           << pendingAddress << endl;
+      failed = true;
+      return false;
+    }
+    if (!flushPending()) {
+      failed = true;
+      return false;
+    }
+    pending = true;
+    pendingAddress = address;
+    pendingValue = value;
+    return true;
+  }
+
+  // Distinct addresses added so far
+  size_t size() const {
+    return (addressWriter ? stats.addresses : 0) + (pending ? 1 : 0);
+  }
+
+  // Builds the trie from the stream added so far and ingests it into
+  // `backend`, whose trie must be empty. The stream is used up either way.
+  // The root node is ingested last, so an interrupted load leaves an empty
+  // root and can simply be run again.
+  bool loadInto(RocksDBBackend& backend) {
+    string existing;
+    // An empty root serializes as "hash," and any child adds a comma
+    if (backend.get("rootNode", &existing) &&
+        count(existing.begin(), existing.end(), ',') > 1) {
+      cerr << "Bulk load needs an empty state" << endl;
+      reset();
+      return false;
+    }
+    bool ok = !failed && flushPending();
+    if (!addressWriter) {
+      stats = Stats();
+      reset();
+      return ok;
+    }
+
+    string rootEntry;
+    ok = ok && addressWriter->Finish().ok() && spillRun() &&
+         buildTrie(rootEntry) && writeInterior() &&
+         writeSst(kMetaFamily, sstPath("meta"), [&](const Put& put) {
+           return put("rootNode", rootEntry);
+         });
+
+    ok = ok && backend.ingest(kLeafFamily, {sstPath("leaves")}) &&
+         backend.ingest(kInteriorFamily, {sstPath("interior")}) &&
+         backend.ingest(kAddressFamily, {sstPath("addresses")}) &&
+         backend.ingest(kMetaFamily, {sstPath("leafAddresses")}) &&
+         backend.ingest(kMetaFamily, {sstPath("meta")});
+    reset();
+    return ok;
+  }
+
+  const Stats& lastLoad() const { return stats; }
+};
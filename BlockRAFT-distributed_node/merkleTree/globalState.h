@@ -1,17 +1,27 @@
 #pragma once
-#include <openssl/evp.h>
-
+#include <algorithm>
+#include <array>
 #include <filesystem>
 #include <functional>
 #include <iomanip>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <sstream>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
-#include "rocksdb/db.h"
+#include "addressFilter.h"
+#include "hashEngine.h"
+#include "memoryBackend.h"
+#include "merkleProof.h"
+#include "partitions.h"
+#include "rocksDBBackend.h"
+#include "versionStore.h"
 
 using namespace std;
 
@@ -23,69 +33,141 @@ class GlobalState {
     vector<string> children;
   };
 
-  rocksdb::DB* db;
+  unique_ptr<StateBackend> backend;
+  unique_ptr<VersionStore> versions;  // declared after backend, which it uses
   string dbPath;
   Node rootNode;
 
- public:
-  GlobalState(const string& path = "globalState", bool fresh = false)
-      : db(nullptr), dbPath(path) {
-    if (fresh && filesystem::exists(dbPath)) {
-      rocksdb::DestroyDB(dbPath, rocksdb::Options());
+  // Leaf keys known to exist, shared by the writable instances on dbPath;
+  // null when disabled or read-only, as another process does the writing.
+  shared_ptr<SharedAddressFilter> leafFilter;
+
+  // Copy-on-write overlay. While it is open, node writes are staged here and
+  // reads see them before RocksDB; commitOverlay() flushes them in a single
+  // WriteBatch and discardOverlay() drops them. An empty value stages an
+  // erasure.
+  bool overlayActive = false;
+  unordered_map<string, string> overlayNodes;
+  shared_mutex overlayMutex;  // concurrent inserts stage into the overlay
+
+  // Partitions (leading hex digits) whose subtree below depth 1 is not
+  // maintained locally: under distributed commit this member stored their
+  // leaves and adopted the owner's hash. Persisted under "stalePartitions".
+  string stalePartitions;
+  mutex staleMutex;
+
+  // insert() locks the stripe of each node it rewrites, so concurrent
+  // inserts sharing a prefix cannot drop each other's children.
+  static const size_t kInsertStripes = 256;
+  array<mutex, kInsertStripes> insertStripes;
+
+  mutex& stripeFor(const string& key) {
+    return insertStripes[std::hash<string>{}(key) % kInsertStripes];
+  }
+
+  // Children are kept sorted so the trie, and its root hash, depend only on
+  // the keys inserted and not on the order in which writers got there.
+  static bool addChild(vector<string>& children, const string& child) {
+    if (find(children.begin(), children.end(), child) != children.end()) {
+      return false;
     }
+    children.insert(lower_bound(children.begin(), children.end(), child),
+                    child);
+    return true;
+  }
 
+ public:
+  // A secondary instance follows a state opened by another process (e.g.
+  // the RestAPI serving proofs next to a node) and is read-only. The
+  // backend is the one named by defaultStateBackend().
+  GlobalState(const string& path = "globalState", bool fresh = false,
+              bool secondary = false)
+      : GlobalState(makeBackend(path, fresh, secondary), path, !secondary) {}
+
+  GlobalState(unique_ptr<StateBackend> backend,
+              const string& path = "globalState", bool writable = true)
+      : backend(move(backend)), dbPath(path) {
     rootNode.value = "";
     rootNode.children = {};
     rootNode.hash = computeHash(rootNode.value);
-
-    rocksdb::Options options;
-    options.create_if_missing = true;
-    rocksdb::Status status = rocksdb::DB::Open(options, dbPath, &db);
-    if (!status.ok()) {
-      throw runtime_error("Failed to open rocksDB at path: " + dbPath);
+    if (writable) ensureRootNode();
+    loadStalePartitions();
+    enableVersions(writable ? defaultVersionRetention() : 0);
+    if (writable && defaultAddressFilterBitsPerKey() > 0) {
+      leafFilter = SharedAddressFilter::forPath(
+          dbPath, [this](AddressFilter& filter) { fillLeafFilter(filter); });
     }
+  }
 
-    string existing;
-    if (!db->Get(rocksdb::ReadOptions(), "rootNode", &existing).ok()) {
-      string serializedNode = serializeNode(rootNode);
-      status = db->Put(rocksdb::WriteOptions(), "rootNode", serializedNode);
-      if (!status.ok()) {
-        throw runtime_error("Failed to insert root node");
-      }
-    }
+  // Sizes the filter for the stored leaves and adds them
+  void fillLeafFilter(AddressFilter& filter) {
+    size_t leaves = 0;
+    backend->forEachLeaf([&](const string&) { ++leaves; });
+    filter.reset(leaves);
+    backend->forEachLeaf([&](const string& key) { filter.add(key); });
   }
 
-  ~GlobalState() {
-    if (db) delete db;
+  // Replaces the shared filter with one filled from the store; reads on
+  // other threads finish on the filter they loaded. Leaves staged in an
+  // open overlay are not in the store, so call it with none open.
+  void rebuildLeafFilter() {
+    if (!leafFilter) return;
+    leafFilter->rebuild([this](AddressFilter& filter) {
+      fillLeafFilter(filter);
+    });
   }
 
-  string computeHash(const string& input) {
-    EVP_MD_CTX* mdctx;
-    unsigned char hash[EVP_MAX_MD_SIZE];
-    unsigned int hashLength = 0;
+  // The filter to read through, null when disabled
+  shared_ptr<AddressFilter> readFilter() const {
+    return leafFilter ? leafFilter->current() : nullptr;
+  }
 
-    if ((mdctx = EVP_MD_CTX_new()) == NULL)
-      throw runtime_error("Error in EVP_MD_CTX creation");
+  AddressFilter::Stats addressFilterStats() const {
+    shared_ptr<AddressFilter> filter = readFilter();
+    return filter ? filter->stats() : AddressFilter::Stats();
+  }
 
-    if (1 != EVP_DigestInit_ex(mdctx, EVP_sha256(), NULL))
-      throw runtime_error("Error in EVP_MD_CTX digest");
+  // Keeps the state of the last `retention` committed blocks queryable;
+  // 0 only allows reading versions committed elsewhere.
+  void enableVersions(size_t retention) {
+    versions.reset();
+    versions = make_unique<VersionStore>(*backend, retention);
+  }
 
-    if (1 != EVP_DigestUpdate(mdctx, input.data(), input.size()))
-      throw runtime_error("Error in EVP_MD_CTX digest update");
+  static unique_ptr<StateBackend> makeBackend(const string& path, bool fresh,
+                                              bool secondary,
+                                              bool readOnly = false) {
+    if (defaultStateBackend() == "memory") {
+      return make_unique<MemoryBackend>(path, fresh);
+    }
+    return make_unique<RocksDBBackend>(path, fresh, secondary, readOnly);
+  }
 
-    if (EVP_DigestFinal_ex(mdctx, hash, &hashLength) != 1) {
-      EVP_MD_CTX_free(mdctx);
-      throw runtime_error("Error in EVP_sha256 creation");
+  void loadStalePartitions() {
+    lock_guard<mutex> lock(staleMutex);
+    if (!backend->get("stalePartitions", &stalePartitions)) {
+      stalePartitions.clear();
     }
+  }
+
+  void markStale(char digit) {
+    lock_guard<mutex> lock(staleMutex);
+    if (stalePartitions.find(digit) != string::npos) return;
+    stalePartitions += digit;
+    putRaw("stalePartitions", stalePartitions);
+  }
 
-    EVP_MD_CTX_free(mdctx);
-    stringstream ss;
-    for (unsigned int i = 0; i < hashLength; i++) {
-      ss << hex << setw(2) << setfill('0') << static_cast<int>(hash[i]);
+  void ensureRootNode() {
+    string existing;
+    if (!backend->get("rootNode", &existing)) {
+      if (!backend->put("rootNode", serializeNode(rootNode))) {
+        throw runtime_error("Failed to insert root node");
+      }
     }
-    return ss.str();
   }
 
+  string computeHash(const string& input) { return HashEngine::hash(input); }
+
   string getRootHash() {
     Node root = getNode("rootNode");
     return root.hash;
@@ -106,6 +188,8 @@ class GlobalState {
     pos = nextPos + 1;
     nextPos = data.find(',', pos);
     node.value = data.substr(pos, nextPos - pos);
+    // Leaves serialize as "hash,value" with no child list
+    if (nextPos == string::npos) return node;
     pos = nextPos + 1;
     while ((nextPos = data.find(',', pos)) != string::npos) {
       node.children.push_back(data.substr(pos, nextPos - pos));
@@ -115,95 +199,519 @@ class GlobalState {
     return node;
   }
 
+  // Safe to call from several threads at once; hashes are left to
+  // updateTree() once all writers are done.
   bool insert(const string& key, const string& value) {
     string keyHash = computeHash(key);
-    string valueHash = computeHash(value);
-    Node newNode = {value, valueHash, {}};
-    string serializedNode = serializeNode(newNode);
-    rocksdb::Status status =
-        db->Put(rocksdb::WriteOptions(), keyHash, serializedNode);
-    if (!status.ok()) return false;
+    if (!putLeaf(key, keyHash, value)) return false;
+    linkLeaf(keyHash);
+    return true;
+  }
+
+  // Stores only the leaf and leaves its partition stale, for keys in a
+  // partition another member hashes under distributed commit.
+  bool insertDeferred(const string& key, const string& value) {
+    string keyHash = computeHash(key);
+    if (!putLeaf(key, keyHash, value)) return false;
+    markStale(keyHash[0]);
+    return true;
+  }
+
+  // Writes the leaf and its address index entries in one batch, so a scan
+  // never sees a value the trie does not hold
+  bool putLeaf(const string& key, const string& keyHash,
+               const string& value) {
+    Node leaf = {value, computeHash(value), {}};
+    shared_lock<shared_mutex> writing;
+    if (leafFilter) writing = leafFilter->writing();
+    lock_guard<mutex> lock(stripeFor(keyHash));
+    refreshCached(keyHash, leaf);
+    versions->markDirty(keyHash);
+    vector<pair<string, string>> entries = {
+        {keyHash, serializeNode(leaf)},
+        {kAddressPrefix + key, value},
+        {kLeafAddressPrefix + keyHash, key}};
+    bool written = true;
+    if (overlayActive) {
+      unique_lock<shared_mutex> overlayLock(overlayMutex);
+      for (auto& [entryKey, data] : entries) {
+        overlayNodes[entryKey] = move(data);
+      }
+    } else {
+      written = backend->write(entries, {});
+    }
+    if (leafFilter) leafFilter->add(keyHash);
+    return written;
+  }
+
+  // Adds the path from the root down to a stored leaf
+  void linkLeaf(const string& keyHash) {
     string currentHash = "";
     string parentKey = "";
     currentHash += keyHash[0];
-    Node root = getNode("rootNode");
-    if (find(root.children.begin(), root.children.end(), currentHash) ==
-        root.children.end()) {
-      root.children.push_back(currentHash);
-      db->Put(rocksdb::WriteOptions(), "rootNode", serializeNode(root));
+    {
+      lock_guard<mutex> lock(stripeFor("rootNode"));
+      Node root = getNode("rootNode");
+      if (addChild(root.children, currentHash)) putNode("rootNode", root);
     }
     for (size_t i = 1; i < keyHash.size(); ++i) {
-      Node parentNode = getNode(currentHash);
       parentKey = currentHash;
       currentHash += keyHash[i];
-      if (find(parentNode.children.begin(), parentNode.children.end(),
-               currentHash) == parentNode.children.end()) {
-        parentNode.children.push_back(currentHash);
-        db->Put(rocksdb::WriteOptions(), parentKey, serializeNode(parentNode));
+      lock_guard<mutex> lock(stripeFor(parentKey));
+      Node parentNode = getNode(parentKey);
+      if (addChild(parentNode.children, currentHash)) {
+        putNode(parentKey, parentNode);
       }
     }
-    // updateParentHashes(keyHash);
-    return true;
   }
 
   string getValue(const string& key) {
     string keyHash = computeHash(key);
+    shared_ptr<AddressFilter> filter = readFilter();
+    if (filter && !filter->mayContain(keyHash)) return "";
     Node node = getNode(keyHash);
+    if (filter && node.hash.empty()) filter->recordFalsePositive();
     return node.value;
   }
 
+  // Batched form of getValue: one MultiGet for all leaves, "" for misses.
+  vector<string> multiGetValues(const vector<string>& keys) {
+    vector<string> keyHashes;
+    vector<size_t> positions;  // of the keys the filter lets through
+    keyHashes.reserve(keys.size());
+    shared_ptr<AddressFilter> filter = readFilter();
+    for (size_t i = 0; i < keys.size(); ++i) {
+      string keyHash = computeHash(keys[i]);
+      if (filter && !filter->mayContain(keyHash)) continue;
+      keyHashes.push_back(move(keyHash));
+      positions.push_back(i);
+    }
+
+    vector<Node> nodes = getNodes(keyHashes);
+    vector<string> values(keys.size());
+    for (size_t i = 0; i < nodes.size(); ++i) {
+      if (filter && nodes[i].hash.empty()) filter->recordFalsePositive();
+      values[positions[i]] = nodes[i].value;
+    }
+    return values;
+  }
+
+  // Streams the raw addresses starting with prefix, and their values, in
+  // address order without touching the trie. Stops after `limit` entries
+  // (0: no limit) or when visit returns false; startAfter resumes after an
+  // address a previous scan ended on. Reads committed writes only, not an
+  // open overlay. Returns the number of entries visited.
+  size_t scan(const string& prefix, size_t limit,
+              const function<bool(const string&, const string&)>& visit,
+              const string& startAfter = "") {
+    size_t visited = 0;
+    string from =
+        startAfter.empty() ? "" : kAddressPrefix + startAfter + '\0';
+    backend->scan(kAddressPrefix + prefix, from,
+                  [&](const string& key, const string& value) {
+                    ++visited;
+                    bool more =
+                        visit(key.substr(kAddressPrefix.size()), value);
+                    return more && (limit == 0 || visited < limit);
+                  });
+    return visited;
+  }
+
+  // Raw address of each leaf key hash, "" when unknown. Reads committed
+  // writes only.
+  vector<string> addressesOf(const vector<string>& keyHashes) {
+    vector<string> keys;
+    keys.reserve(keyHashes.size());
+    for (const auto& keyHash : keyHashes) {
+      keys.push_back(kLeafAddressPrefix + keyHash);
+    }
+    return backend->multiGet(keys);
+  }
+
+  // Indexes a leaf copied by key hash, e.g. from a state sync peer, under
+  // its raw address
+  bool indexLeaf(const string& address, const string& keyHash,
+                 const string& value) {
+    return putRaw(kAddressPrefix + address, value) &&
+           putRaw(kLeafAddressPrefix + keyHash, address);
+  }
+
+  // Catches a secondary instance up with the primary's latest writes,
+  // including the partitions it has rebuilt since.
+  bool catchUp() {
+    bool caughtUp = backend->catchUp();
+    loadStalePartitions();
+    return caughtUp;
+  }
+
+  MerkleProof getProof(const string& key) { return getMultiProof({key}); }
+
+  // Proof for several keys at once. Nodes on any key's path are included
+  // whole and only once; their other children contribute just a hash. Never
+  // writes, so it can serve concurrent queries on a secondary. Throws when a
+  // key falls in a stale partition, whose nodes below depth 1 are not
+  // maintained here; its owner, or this node once the partition has been
+  // rebuilt, can prove it.
+  MerkleProof getMultiProof(const vector<string>& keys) {
+    string stale = getStalePartitions();
+    for (const auto& key : keys) {
+      if (stale.find(computeHash(key)[0]) != string::npos) {
+        throw runtime_error("Partition of " + key +
+                            " is not maintained on this node");
+      }
+    }
+
+    MerkleProof proof;
+    map<string, Node> pathNodes;  // proof path -> node
+    for (const auto& key : keys) {
+      string keyHash = computeHash(key);
+      string path;
+      while (true) {
+        auto known = pathNodes.find(path);
+        if (known == pathNodes.end()) {
+          Node node = getNode(path.empty() ? "rootNode" : path);
+          if (node.hash.empty()) break;
+          known = pathNodes.emplace(path, node).first;
+        }
+        if (path.size() == keyHash.size()) break;
+        string next = path + keyHash[path.size()];
+        const auto& children = known->second.children;
+        if (find(children.begin(), children.end(), next) == children.end()) {
+          break;
+        }
+        path = next;
+      }
+    }
+
+    vector<string> siblings;
+    for (const auto& [path, node] : pathNodes) {
+      for (const auto& child : node.children) {
+        if (!pathNodes.count(child)) siblings.push_back(child);
+      }
+    }
+    vector<Node> siblingNodes = getNodes(siblings);
+    unordered_map<string, string> siblingHashes;
+    for (size_t i = 0; i < siblings.size(); ++i) {
+      siblingHashes[siblings[i]] = siblingNodes[i].hash;
+    }
+
+    for (const auto& [path, node] : pathNodes) {
+      ProofNode proofNode;
+      proofNode.path = path;
+      proofNode.value = node.value;
+      for (const auto& child : node.children) {
+        proofNode.labels += child.back();
+        proofNode.childHashes.push_back(
+            pathNodes.count(child) ? "" : siblingHashes[child]);
+      }
+      proof.nodes[path] = proofNode;
+    }
+    auto root = pathNodes.find("");
+    if (root != pathNodes.end()) proof.rootHash = root->second.hash;
+    return proof;
+  }
+
   Node getNode(const string& key) {
     string data;
     Node node = {"", "", {}};
-    rocksdb::Status status = db->Get(rocksdb::ReadOptions(), key, &data);
-    if (status.ok()) return deserializeNode(data);
+    if (overlayActive) {
+      shared_lock<shared_mutex> lock(overlayMutex);
+      auto it = overlayNodes.find(key);
+      if (it != overlayNodes.end()) {
+        return it->second.empty() ? node : deserializeNode(it->second);
+      }
+    }
+    if (backend->get(key, &data)) return deserializeNode(data);
     return node;
   }
+
+  // Single write path for trie nodes; keeps nodeCache coherent.
+  bool putNode(const string& key, const Node& node) {
+    bool leaf = leafFilter && key.size() == 64;
+    shared_lock<shared_mutex> writing;
+    if (leaf) writing = leafFilter->writing();
+    refreshCached(key, node);
+    versions->markDirty(key);
+    bool written = putRaw(key, serializeNode(node));
+    if (leaf) leafFilter->add(key);
+    return written;
+  }
+
+  // Removes a node and everything below it, with their version mappings
+  // and the address index entries of its leaves, through the overlay.
+  // Returns the number of nodes removed.
+  size_t eraseSubtree(const string& key) {
+    size_t removed = 1;
+    for (const auto& child : getNode(key).children) {
+      removed += eraseSubtree(child);
+    }
+    {
+      lock_guard<mutex> lock(nodeCacheMutex);
+      nodeCache.erase(key);
+    }
+    vector<string> erased = {key, VersionStore::mappingKey(key)};
+    string address;
+    if (key.size() == 64 && backend->get(kLeafAddressPrefix + key, &address)) {
+      erased.push_back(kAddressPrefix + address);
+    }
+    if (overlayActive) {
+      unique_lock<shared_mutex> lock(overlayMutex);
+      for (const auto& erasedKey : erased) overlayNodes[erasedKey].clear();
+    } else {
+      backend->write({}, erased);
+    }
+    return removed;
+  }
+
+  // Writes an already serialized value through the overlay
+  bool putRaw(const string& key, string data) {
+    if (overlayActive) {
+      unique_lock<shared_mutex> lock(overlayMutex);
+      overlayNodes[key] = move(data);
+      return true;
+    }
+    return backend->put(key, data);
+  }
+
+  void beginOverlay() {
+    overlayNodes.clear();
+    overlayActive = true;
+  }
+
+  bool commitOverlay() {
+    if (!overlayActive) return true;
+    vector<pair<string, string>> batch;
+    vector<string> erased;
+    for (auto& [key, data] : overlayNodes) {
+      if (data.empty()) {
+        erased.push_back(key);
+      } else {
+        batch.emplace_back(key, move(data));
+      }
+    }
+    bool written = backend->write(batch, erased);
+    overlayNodes.clear();
+    overlayActive = false;
+    return written;
+  }
+
+  void discardOverlay() {
+    overlayNodes.clear();
+    overlayActive = false;
+    clearNodeCache();  // may hold nodes that were only staged
+    loadStalePartitions();
+  }
+
+  size_t overlaySize() const { return overlayNodes.size(); }
+
+  // Nodes read while rehashing, kept coherent by every node write. Inserts
+  // on several threads update it, so it is guarded; commitVersion clears
+  // it, so an instance kept across blocks holds one block's paths at most.
   unordered_map<string, Node> nodeCache;
+  mutex nodeCacheMutex;
+
+  void refreshCached(const string& key, const Node& node) {
+    lock_guard<mutex> lock(nodeCacheMutex);
+    auto cached = nodeCache.find(key);
+    if (cached != nodeCache.end()) cached->second = node;
+  }
+
+  void clearNodeCache() {
+    lock_guard<mutex> lock(nodeCacheMutex);
+    nodeCache.clear();
+  }
+
+  // Batched form of getNode.
+  vector<Node> getNodes(const vector<string>& keys) {
+    vector<string> data = backend->multiGet(keys);
+
+    vector<Node> nodes(keys.size());
+    shared_lock<shared_mutex> lock(overlayMutex);
+    for (size_t i = 0; i < keys.size(); ++i) {
+      auto staged =
+          overlayActive ? overlayNodes.find(keys[i]) : overlayNodes.end();
+      if (staged != overlayNodes.end()) {
+        if (!staged->second.empty()) {
+          nodes[i] = deserializeNode(staged->second);
+        }
+      } else if (!data[i].empty()) {
+        nodes[i] = deserializeNode(data[i]);
+      }
+    }
+    return nodes;
+  }
 
   Node getCachedNode(const string& key) {
-    if (nodeCache.count(key)) return nodeCache[key];
+    {
+      lock_guard<mutex> lock(nodeCacheMutex);
+      auto cached = nodeCache.find(key);
+      if (cached != nodeCache.end()) return cached->second;
+    }
     Node node = getNode(key);
-    nodeCache[key] = node;
-    return node;
+    lock_guard<mutex> lock(nodeCacheMutex);
+    // A write that raced with the read has already cached a newer node
+    return nodeCache.emplace(key, move(node)).first->second;
   }
   void updateTree(const string& spaceSeparatedKeys) {
-    unordered_set<string> visited;
+    vector<string> keyHashes;
     istringstream iss(spaceSeparatedKeys);
     string key;
+    while (iss >> key) keyHashes.push_back(computeHash(key));
+
+    // Incremental hashing needs up-to-date siblings
+    string stale = getStalePartitions();
+    string touched;
+    for (const auto& keyHash : keyHashes) {
+      if (stale.find(keyHash[0]) != string::npos &&
+          touched.find(keyHash[0]) == string::npos) {
+        touched += keyHash[0];
+      }
+    }
+    refreshPartitions(touched);
 
-    while (iss >> key) {
-      string currentKey = computeHash(key);
+    rehashPaths(keyHashes);
+    rehashRoot();
+  }
 
-      while (!currentKey.empty() && !visited.count(currentKey)) {
-        visited.insert(currentKey);
-        Node node = getCachedNode(currentKey);
+  void rehashPaths(const vector<string>& keyHashes) {
+    // Collect every node on the updated paths by depth, then rehash the
+    // deepest level first so a parent always sees its children's new hashes.
+    vector<vector<string>> levels;
+    unordered_set<string> visited;
 
-        ostringstream oss;
+    for (const auto& keyHash : keyHashes) {
+      string currentKey = keyHash;
+      if (levels.size() <= currentKey.size()) {
+        levels.resize(currentKey.size() + 1);
+      }
+
+      while (!currentKey.empty() && visited.insert(currentKey).second) {
+        levels[currentKey.size()].push_back(currentKey);
+        currentKey.pop_back();
+      }
+    }
+
+    // A level's nodes are independent of each other, so each level is
+    // hashed as one batch.
+    for (size_t depth = levels.size(); depth-- > 1;) {
+      vector<Node> nodes;
+      vector<string> inputs;
+      nodes.reserve(levels[depth].size());
+      inputs.reserve(levels[depth].size());
+      for (const auto& currentKey : levels[depth]) {
+        Node node = getCachedNode(currentKey);
+        string input;
         for (const auto& childKey : node.children) {
-          Node child = getCachedNode(childKey);
-          oss << child.hash;
+          appendChildHash(input, childKey.back(),
+                          getCachedNode(childKey).hash);
         }
-        oss << node.value;
-        string newHash = computeHash(oss.str());
+        input += node.value;
+        nodes.push_back(move(node));
+        inputs.push_back(move(input));
+      }
 
-        if (node.hash != newHash) {
-          node.hash = newHash;
-          db->Put(rocksdb::WriteOptions(), currentKey, serializeNode(node));
+      vector<string> hashes = HashEngine::hashBatch(inputs);
+      for (size_t i = 0; i < nodes.size(); ++i) {
+        if (nodes[i].hash != hashes[i]) {
+          nodes[i].hash = hashes[i];
+          putNode(levels[depth][i], nodes[i]);
         }
-
-        currentKey.pop_back();
       }
     }
-    // Recompute rootNode hash
+  }
+
+  void rehashRoot() {
     Node root = getNode("rootNode");
     string combinedHash;
     for (const auto& childKey : root.children) {
       Node child = getNode(childKey);
-      combinedHash += child.hash;
+      appendChildHash(combinedHash, childKey.back(), child.hash);
     }
     root.hash = computeHash(combinedHash);
-    db->Put(rocksdb::WriteOptions(), "rootNode", serializeNode(root));
+    putNode("rootNode", root);
+  }
+
+  // Hash of the subtree under a leading hex digit, "" when it is empty
+  string getPartitionHash(char digit) { return getNode(string(1, digit)).hash; }
+
+  // Takes the hashes other members computed for their partitions and
+  // recomputes the root from them.
+  void adoptPartitionHashes(const map<char, string>& hashes) {
+    Node root = getNode("rootNode");
+    bool rootChanged = false;
+    for (const auto& [digit, hash] : hashes) {
+      if (hash.empty()) continue;
+      string key(1, digit);
+      Node node = getNode(key);
+      if (node.hash == hash) continue;
+      node.hash = hash;
+      putNode(key, node);
+      markStale(digit);
+      rootChanged = addChild(root.children, key) || rootChanged;
+    }
+    if (rootChanged) putNode("rootNode", root);
+    rehashRoot();
+  }
+
+  string getStalePartitions() {
+    lock_guard<mutex> lock(staleMutex);
+    return stalePartitions;
+  }
+
+  // Rebuilds partitions from their leaves: links every leaf stored under
+  // them and rehashes their subtrees. Reads and rehashes every leaf of the
+  // partitions, so it is meant for the rare writes that need exact hashes
+  // inside a stale partition.
+  void refreshPartitions(const string& digits) {
+    if (digits.empty()) return;
+    unordered_set<string> leaves;
+    for (char digit : digits) {
+      backend->scanLeaves(string(1, digit), [&](const string& key) {
+        leaves.insert(key);
+      });
+    }
+    if (overlayActive) {
+      shared_lock<shared_mutex> lock(overlayMutex);
+      for (const auto& entry : overlayNodes) {
+        if (trieFamilyOf(entry.first) != kLeafFamily ||
+            digits.find(entry.first[0]) == string::npos) {
+          continue;
+        }
+        if (entry.second.empty()) {
+          leaves.erase(entry.first);
+        } else {
+          leaves.insert(entry.first);
+        }
+      }
+    }
+
+    vector<string> keyHashes(leaves.begin(), leaves.end());
+    for (const auto& keyHash : keyHashes) linkLeaf(keyHash);
+    rehashPaths(keyHashes);
+    rehashRoot();
+
+    lock_guard<mutex> lock(staleMutex);
+    string remaining;
+    for (char digit : stalePartitions) {
+      if (digits.find(digit) == string::npos) remaining += digit;
+    }
+    stalePartitions = remaining;
+    putRaw("stalePartitions", stalePartitions);
+  }
+
+  void refreshStalePartitions() { refreshPartitions(getStalePartitions()); }
+
+  // Partitions a state sync started rewriting and has not finished. Their
+  // nodes may carry the remote hash over a subtree only partly copied, so
+  // the next sync walks them in full. Persisted under "syncingPartitions";
+  // setting it goes through the overlay, and "" stages its removal.
+  string getSyncingPartitions() {
+    string digits;
+    return backend->get("syncingPartitions", &digits) ? digits : "";
+  }
+
+  bool setSyncingPartitions(const string& digits) {
+    return putRaw("syncingPartitions", digits);
   }
 
   void updateParentHashes(const string& keyHash) {
@@ -214,66 +722,204 @@ class GlobalState {
       string combinedHash = "";
       for (const string& childKey : currentNode.children) {
         Node childNode = getNode(childKey);
-        combinedHash += childNode.hash;
+        appendChildHash(combinedHash, childKey.back(), childNode.hash);
       }
       combinedHash += currentNode.value;
       currentNode.hash = computeHash(combinedHash);
-      db->Put(rocksdb::WriteOptions(), currentHashKey,
-              serializeNode(currentNode));
+      putNode(currentHashKey, currentNode);
       currentHashKey.pop_back();
     }
     Node currentNode = getNode("rootNode");
     string combinedHash = "";
     for (const string& childKey : currentNode.children) {
       Node childNode = getNode(childKey);
-      combinedHash += childNode.hash;
+      appendChildHash(combinedHash, childKey.back(), childNode.hash);
     }
     currentNode.hash = computeHash(combinedHash);
-    db->Put(rocksdb::WriteOptions(), "rootNode", serializeNode(currentNode));
+    putNode("rootNode", currentNode);
   }
 
   bool duplicateState(const string& targetPath = "globalState_tmp") {
-    rocksdb::Options options;
-    options.create_if_missing = true;
+    return backend->copyTo(targetPath);
+  }
 
-    rocksdb::DB* newDb;
-    rocksdb::Status status = rocksdb::DB::Open(options, targetPath, &newDb);
-    if (!status.ok()) return false;
+  void resetTree() {
+    backend->clear();
+    overlayNodes.clear();
+    overlayActive = false;
+    clearNodeCache();
+    ensureRootNode();
+    loadStalePartitions();
+    rebuildLeafFilter();
+  }
 
-    rocksdb::Iterator* it = db->NewIterator(rocksdb::ReadOptions());
-    for (it->SeekToFirst(); it->Valid(); it->Next()) {
-      newDb->Put(rocksdb::WriteOptions(), it->key(), it->value());
-    }
-    bool success = it->status().ok();
-    delete it;
-    delete newDb;
-    return success;
+  // Point-in-time copy of the committed state at targetPath
+  bool checkpoint(const string& targetPath) {
+    return backend->checkpoint(targetPath);
   }
 
-  void resetTree() {
-    delete db;
-    rocksdb::DestroyDB(dbPath, rocksdb::Options());
-    new (this) GlobalState(dbPath, true);  // Placement new to re-init
+  // Replaces the state with a copy of the checkpoint at sourcePath, which
+  // is left intact for later restores
+  bool restoreFrom(const string& sourcePath) {
+    string staging = dbPath + "_restore";
+    filesystem::remove_all(staging);
+    {
+      unique_ptr<StateBackend> source = makeBackend(sourcePath, false, false);
+      if (!source->checkpoint(staging)) return false;
+    }
+    versions->clearDirty();
+    return replaceWith(staging);
   }
 
   bool replaceWith(const string& sourcePath) {
-    delete db;
-    rocksdb::DestroyDB(dbPath, rocksdb::Options());
-    filesystem::remove_all(dbPath);
-    filesystem::rename(sourcePath, dbPath);
-    new (this) GlobalState(dbPath, false);  // Reload
-    return true;
+    overlayNodes.clear();
+    overlayActive = false;
+    clearNodeCache();
+    bool replaced = backend->replaceWith(sourcePath);
+    loadStalePartitions();
+    rebuildLeafFilter();
+    return replaced;
+  }
+
+  // Pins the current state as the version of `block`. Call after the
+  // block's writes are committed and hashed; staged overlay writes are not
+  // versioned. Stale partitions cannot be versioned without rebuilding
+  // them, so retention and distributed commit do not mix and a state with
+  // stale partitions fails to version.
+  bool commitVersion(int block) {
+    if (overlayActive) return false;
+    clearNodeCache();
+    shared_ptr<AddressFilter> filter = readFilter();
+    if (filter && filter->overloaded()) rebuildLeafFilter();
+    if (versions->enabled() && !getStalePartitions().empty()) return false;
+    return versions->commit(block, [this](const string& key) {
+      Node node = getNode(key);
+      return VersionStore::TrieNode{node.hash, node.value, node.children};
+    });
+  }
+
+  string getRootHashAt(int block) { return versions->getRootAt(block); }
+
+  string getValueAt(const string& key, int block) {
+    return versions->getValueAt(computeHash(key), block);
+  }
+
+  void pruneVersions() { versions->pruneExpired(); }
+
+  // Restores the working trie to a retained version, rewriting only the
+  // nodes that differ from it.
+  bool rollbackTo(int block) {
+    if (overlayActive) return false;
+    // Leaves stored without their path would survive the rollback
+    refreshStalePartitions();
+    vector<pair<string, string>> puts;
+    vector<string> erased;
+    function<void(const string&)> eraseSubtree = [&](const string& key) {
+      erased.push_back(key);
+      for (const auto& child : getNode(key).children) eraseSubtree(child);
+    };
+
+    bool found = versions->walkDiff(
+        block, [&](const string& key, const string& id, const string& hash,
+                   const string& value, const vector<string>& children) {
+          for (const auto& child : getNode(key).children) {
+            if (find(children.begin(), children.end(), child) ==
+                children.end()) {
+              eraseSubtree(child);
+            }
+          }
+          puts.emplace_back(key, serializeNode({value, hash, children}));
+          puts.emplace_back(VersionStore::mappingKey(key), id);
+        });
+    if (!found) return false;
+    for (size_t i = 0, n = erased.size(); i < n; ++i) {
+      erased.push_back(VersionStore::mappingKey(erased[i]));
+    }
+    clearNodeCache();
+    versions->clearDirty();
+    {
+      shared_lock<shared_mutex> writing;
+      if (leafFilter) writing = leafFilter->writing();
+      if (!backend->write(puts, erased)) return false;
+      for (const auto& put : puts) {
+        if (leafFilter && put.first.size() == 64) leafFilter->add(put.first);
+      }
+    }
+    return reconcileAddressIndex();
+  }
+
+  // Brings the address index in line with the leaves after they were
+  // rewritten underneath it, e.g. by a rollback: drops addresses whose leaf
+  // is gone and restores values that changed. Works through the index a
+  // chunk at a time.
+  bool reconcileAddressIndex() {
+    const size_t kChunk = 1024;
+    string startAfter;
+    while (true) {
+      vector<pair<string, string>> entries;
+      scan("", kChunk,
+           [&](const string& address, const string& value) {
+             entries.emplace_back(address, value);
+             return true;
+           },
+           startAfter);
+      if (entries.empty()) return true;
+
+      vector<string> keyHashes;
+      keyHashes.reserve(entries.size());
+      for (const auto& entry : entries) {
+        keyHashes.push_back(computeHash(entry.first));
+      }
+      vector<Node> leaves = getNodes(keyHashes);
+      vector<pair<string, string>> puts;
+      vector<string> erased;
+      for (size_t i = 0; i < entries.size(); ++i) {
+        string indexKey = kAddressPrefix + entries[i].first;
+        if (leaves[i].hash.empty()) {
+          erased.push_back(indexKey);
+        } else if (leaves[i].value != entries[i].second) {
+          puts.emplace_back(indexKey, leaves[i].value);
+        }
+      }
+      if ((!puts.empty() || !erased.empty()) &&
+          !backend->write(puts, erased)) {
+        return false;
+      }
+      if (entries.size() < kChunk) return true;
+      startAfter = entries.back().first;
+    }
+  }
+
+  // Recomputes the root hash from the stored values and links without
+  // writing, so a node corrupted after it was hashed shows up as a
+  // mismatch. Stale partitions are not maintained below depth 1 and differ
+  // until refreshed.
+  string computeRootHash() {
+    function<string(const string&)> hashOf = [&](const string& key) {
+      Node node = getNode(key);
+      string input;
+      for (const auto& child : node.children) {
+        appendChildHash(input, child.back(), hashOf(child));
+      }
+      input += node.value;
+      return computeHash(input);
+    };
+    return hashOf("rootNode");
   }
 
   void updateAllNonLeafHashes() {
+    refreshStalePartitions();
     unordered_map<string, vector<string>> parentToChildren;
     unordered_set<string> allNodes;
     unordered_set<string> leafNodes;
 
-    rocksdb::Iterator* it = db->NewIterator(rocksdb::ReadOptions());
-    for (it->SeekToFirst(); it->Valid(); it->Next()) {
-      string key = it->key().ToString();
-      Node node = deserializeNode(it->value().ToString());
+    backend->forEach([&](const string& key, const string& data) {
+      TrieFamily family = trieFamilyOf(key);
+      if (key != "rootNode" && family != kLeafFamily &&
+          family != kInteriorFamily) {
+        return;
+      }
+      Node node = deserializeNode(data);
       allNodes.insert(key);
       if (!node.children.empty()) {
         for (const auto& child : node.children) {
@@ -282,8 +928,7 @@ class GlobalState {
       } else {
         leafNodes.insert(key);
       }
-    }
-    delete it;
+    });
 
     // DFS post-order from root
     unordered_set<string> visited;
@@ -296,12 +941,12 @@ class GlobalState {
       string combinedHash = "";
       for (const auto& child : node.children) {
         string childHash = dfs(child);
-        combinedHash += childHash;
+        appendChildHash(combinedHash, child.back(), childHash);
       }
       combinedHash += node.value;
 
       node.hash = computeHash(combinedHash);
-      db->Put(rocksdb::WriteOptions(), key, serializeNode(node));
+      putNode(key, node);
       return node.hash;
     };
 
@@ -0,0 +1,98 @@
+#include <openssl/evp.h>
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "hashEngine.h"
+
+// The per-call path GlobalState used before HashEngine: a fresh EVP context
+// per hash and stream-based hex encoding.
+std::string legacyHash(const std::string& input) {
+  EVP_MD_CTX* mdctx = EVP_MD_CTX_new();
+  unsigned char hash[EVP_MAX_MD_SIZE];
+  unsigned int hashLength = 0;
+  EVP_DigestInit_ex(mdctx, EVP_sha256(), NULL);
+  EVP_DigestUpdate(mdctx, input.data(), input.size());
+  EVP_DigestFinal_ex(mdctx, hash, &hashLength);
+  EVP_MD_CTX_free(mdctx);
+  std::stringstream ss;
+  for (unsigned int i = 0; i < hashLength; i++) {
+    ss << std::hex << std::setw(2) << std::setfill('0')
+       << static_cast<int>(hash[i]);
+  }
+  return ss.str();
+}
+
+// Trie-shaped inputs: `children` concatenated 64-character hashes plus a
+// short value, as updateTree hashes them.
+std::vector<std::string> makeInputs(size_t count, int children) {
+  std::mt19937 rng(7);
+  std::vector<std::string> inputs(count);
+  for (auto& input : inputs) {
+    for (int c = 0; c < children; ++c) {
+      input += HashEngine::hash(std::to_string(rng()));
+    }
+    input += "value" + std::to_string(rng() % 1000);
+  }
+  return inputs;
+}
+
+template <typename Fn>
+double measure(Fn&& fn) {
+  auto start = std::chrono::high_resolution_clock::now();
+  fn();
+  auto end = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration<double>(end - start).count();
+}
+
+// Usage: hashBenchmark [inputsPerWorkload]
+int main(int argc, char* argv[]) {
+  size_t count = argc > 1 ? std::stoul(argv[1]) : 200000;
+  std::cout << "AVX2: " << (HashEngine::avx2Supported() ? "yes" : "no")
+            << ", SHA-NI: " << (HashEngine::shaNISupported() ? "yes" : "no")
+            << std::endl;
+  std::cout << "workload,inputs,legacy,engine,batchEVP,batchAVX2,batchAuto "
+               "(Mhash/s)"
+            << std::endl;
+
+  // 0 children: keys and values from insert(); 1-2: sparse deep levels;
+  // 16: full levels near the root
+  for (int children : {0, 1, 2, 16}) {
+    std::vector<std::string> inputs = makeInputs(count, children);
+    std::vector<std::string> expected(inputs.size());
+    double legacy = measure([&]() {
+      for (size_t i = 0; i < inputs.size(); ++i) {
+        expected[i] = legacyHash(inputs[i]);
+      }
+    });
+    double engine = measure([&]() {
+      for (const auto& input : inputs) HashEngine::hash(input);
+    });
+    std::vector<std::string> evp, avx2, automatic;
+    double batchEVP = measure(
+        [&]() { evp = HashEngine::hashBatch(inputs, HashEngine::kEVP); });
+    double batchAVX2 = measure(
+        [&]() { avx2 = HashEngine::hashBatch(inputs, HashEngine::kAVX2); });
+    double batchAuto = measure([&]() {
+      automatic = HashEngine::hashBatch(inputs, HashEngine::kAuto);
+    });
+    if (evp != expected || avx2 != expected || automatic != expected) {
+      std::cerr << "Hash mismatch for " << children << " children"
+                << std::endl;
+      return 1;
+    }
+
+    double millions = inputs.size() / 1e6;
+    std::cout << std::fixed << std::setprecision(2) << "children=" << children
+              << "," << inputs.size() << "," << millions / legacy << ","
+              << millions / engine << "," << millions / batchEVP << ","
+              << millions / batchAVX2 << "," << millions / batchAuto
+              << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,278 @@
+#pragma once
+#include <openssl/evp.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <cpuid.h>
+#include <immintrin.h>
+#define HASH_ENGINE_AVX2 1
+#endif
+
+using namespace std;
+
+// SHA-256 for trie commits, which hash tens of thousands of small inputs
+// per block. Single inputs go through a thread-local EVP context that is
+// reused across calls; OpenSSL dispatches to SHA-NI or AVX2 inside it.
+// Batches of independent inputs (one trie level at a time) can also run
+// through an 8-lane AVX2 implementation that hashes eight messages per
+// instruction stream. SHA-NI through EVP beats the lanes, so they are only
+// the default on CPUs with AVX2 and without SHA-NI (hashBenchmark compares
+// the paths).
+class HashEngine {
+ public:
+  // kAuto: AVX2 lanes unless the CPU has SHA-NI
+  enum Path { kEVP, kAVX2, kAuto };
+
+  // Path used by hashBatch(); tests and benchmarks may override it.
+  static Path& batchPath() {
+    static Path path = avx2Supported() ? kAuto : kEVP;
+    return path;
+  }
+
+  static bool avx2Supported() {
+#ifdef HASH_ENGINE_AVX2
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+  }
+
+  // Lowercase hex sha256 of input
+  static string hash(const string& input) {
+    unsigned char digest[32];
+    digestEVP(input, digest);
+    return toHex(digest);
+  }
+
+  static vector<string> hashBatch(const vector<string>& inputs) {
+    return hashBatch(inputs, batchPath());
+  }
+
+  static vector<string> hashBatch(const vector<string>& inputs, Path path) {
+    vector<string> hashes(inputs.size());
+#ifdef HASH_ENGINE_AVX2
+    if (useLanes(path)) {
+      hashLanes(inputs, hashes);
+      return hashes;
+    }
+#endif
+    unsigned char digest[32];
+    for (size_t i = 0; i < inputs.size(); ++i) {
+      digestEVP(inputs[i], digest);
+      hashes[i] = toHex(digest);
+    }
+    return hashes;
+  }
+
+  static bool shaNISupported() {
+#ifdef HASH_ENGINE_AVX2
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    return __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) &&
+           (ebx & (1u << 29));
+#else
+    return false;
+#endif
+  }
+
+ private:
+  static bool useLanes(Path path) {
+    static const bool avx2 = avx2Supported();
+    static const bool shaNI = shaNISupported();
+    if (!avx2 || path == kEVP) return false;
+    return path == kAVX2 || !shaNI;
+  }
+
+  struct Context {
+    EVP_MD_CTX* ctx;
+    Context() : ctx(EVP_MD_CTX_new()) {
+      if (!ctx) throw runtime_error("Error in EVP_MD_CTX creation");
+    }
+    ~Context() { EVP_MD_CTX_free(ctx); }
+  };
+
+  // Fetched once; with OpenSSL 3 EVP_sha256() would look the
+  // implementation up again on every init.
+  static const EVP_MD* sha256() {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    static EVP_MD* md = EVP_MD_fetch(nullptr, "SHA256", nullptr);
+    if (md) return md;
+#endif
+    return EVP_sha256();
+  }
+
+  static void digestEVP(const string& input, unsigned char* digest) {
+    static thread_local Context context;
+    unsigned int length = 0;
+    if (EVP_DigestInit_ex(context.ctx, sha256(), nullptr) != 1 ||
+        EVP_DigestUpdate(context.ctx, input.data(), input.size()) != 1 ||
+        EVP_DigestFinal_ex(context.ctx, digest, &length) != 1) {
+      throw runtime_error("Error in EVP_sha256 digest");
+    }
+  }
+
+  static string toHex(const unsigned char* digest) {
+    static const char digits[] = "0123456789abcdef";
+    string hex(64, '0');
+    for (int i = 0; i < 32; ++i) {
+      hex[2 * i] = digits[digest[i] >> 4];
+      hex[2 * i + 1] = digits[digest[i] & 0xf];
+    }
+    return hex;
+  }
+
+#ifdef HASH_ENGINE_AVX2
+  static constexpr uint32_t kRound[64] = {
+      0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+      0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+      0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+      0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+      0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+      0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+      0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+      0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+      0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+      0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+      0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+  static constexpr uint32_t kInitial[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372,
+                                           0xa54ff53a, 0x510e527f, 0x9b05688c,
+                                           0x1f83d9ab, 0x5be0cd19};
+
+  // A lane's message with SHA-256 padding, split into 64-byte blocks
+  static void pad(const string& input, vector<unsigned char>& padded) {
+    size_t blocks = (input.size() + 9 + 63) / 64;
+    padded.assign(blocks * 64, 0);
+    memcpy(padded.data(), input.data(), input.size());
+    padded[input.size()] = 0x80;
+    uint64_t bits = static_cast<uint64_t>(input.size()) * 8;
+    for (int i = 0; i < 8; ++i) {
+      padded[padded.size() - 1 - i] =
+          static_cast<unsigned char>(bits >> (8 * i));
+    }
+  }
+
+  __attribute__((target("avx2"))) static __m256i rotr(__m256i x, int n) {
+    return _mm256_or_si256(_mm256_srli_epi32(x, n),
+                           _mm256_slli_epi32(x, 32 - n));
+  }
+
+  // Hashes inputs eight at a time. Inputs are grouped by block count so
+  // lanes in a group finish together; shorter lanes in a group keep their
+  // state through a blend mask.
+  __attribute__((target("avx2"))) static void hashLanes(
+      const vector<string>& inputs, vector<string>& hashes) {
+    vector<size_t> order(inputs.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+      return inputs[a].size() < inputs[b].size();
+    });
+
+    static thread_local vector<unsigned char> padded[8];
+    for (size_t group = 0; group < order.size(); group += 8) {
+      size_t lanes = min<size_t>(8, order.size() - group);
+      size_t blocks[8] = {};
+      size_t maxBlocks = 0;
+      for (size_t lane = 0; lane < lanes; ++lane) {
+        pad(inputs[order[group + lane]], padded[lane]);
+        blocks[lane] = padded[lane].size() / 64;
+        maxBlocks = max(maxBlocks, blocks[lane]);
+      }
+
+      __m256i state[8];
+      for (int i = 0; i < 8; ++i) {
+        state[i] = _mm256_set1_epi32(static_cast<int>(kInitial[i]));
+      }
+      for (size_t block = 0; block < maxBlocks; ++block) {
+        uint32_t words[16][8] = {};
+        int32_t active[8] = {};
+        for (size_t lane = 0; lane < lanes; ++lane) {
+          if (block >= blocks[lane]) continue;
+          active[lane] = -1;
+          const unsigned char* data = padded[lane].data() + block * 64;
+          for (int t = 0; t < 16; ++t) {
+            words[t][lane] = (uint32_t(data[4 * t]) << 24) |
+                             (uint32_t(data[4 * t + 1]) << 16) |
+                             (uint32_t(data[4 * t + 2]) << 8) |
+                             uint32_t(data[4 * t + 3]);
+          }
+        }
+        compress(state, words, _mm256_loadu_si256(
+                                   reinterpret_cast<const __m256i*>(active)));
+      }
+
+      uint32_t out[8][8];
+      for (int i = 0; i < 8; ++i) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out[i]), state[i]);
+      }
+      for (size_t lane = 0; lane < lanes; ++lane) {
+        unsigned char digest[32];
+        for (int i = 0; i < 8; ++i) {
+          digest[4 * i] = static_cast<unsigned char>(out[i][lane] >> 24);
+          digest[4 * i + 1] = static_cast<unsigned char>(out[i][lane] >> 16);
+          digest[4 * i + 2] = static_cast<unsigned char>(out[i][lane] >> 8);
+          digest[4 * i + 3] = static_cast<unsigned char>(out[i][lane]);
+        }
+        hashes[order[group + lane]] = toHex(digest);
+      }
+    }
+  }
+
+  // One SHA-256 compression across eight lanes; lanes outside `active`
+  // keep their previous state.
+  __attribute__((target("avx2"))) static void compress(
+      __m256i state[8], const uint32_t words[16][8], __m256i active) {
+    __m256i w[64];
+    for (int t = 0; t < 16; ++t) {
+      w[t] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words[t]));
+    }
+    for (int t = 16; t < 64; ++t) {
+      __m256i s0 = _mm256_xor_si256(
+          _mm256_xor_si256(rotr(w[t - 15], 7), rotr(w[t - 15], 18)),
+          _mm256_srli_epi32(w[t - 15], 3));
+      __m256i s1 = _mm256_xor_si256(
+          _mm256_xor_si256(rotr(w[t - 2], 17), rotr(w[t - 2], 19)),
+          _mm256_srli_epi32(w[t - 2], 10));
+      w[t] = _mm256_add_epi32(_mm256_add_epi32(w[t - 16], s0),
+                              _mm256_add_epi32(w[t - 7], s1));
+    }
+
+    __m256i a = state[0], b = state[1], c = state[2], d = state[3];
+    __m256i e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int t = 0; t < 64; ++t) {
+      __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(rotr(e, 6), rotr(e, 11)),
+                                    rotr(e, 25));
+      __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f),
+                                    _mm256_andnot_si256(e, g));
+      __m256i temp1 = _mm256_add_epi32(
+          _mm256_add_epi32(_mm256_add_epi32(h, s1), ch),
+          _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(kRound[t])),
+                           w[t]));
+      __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(rotr(a, 2), rotr(a, 13)),
+                                    rotr(a, 22));
+      __m256i maj = _mm256_xor_si256(
+          _mm256_xor_si256(_mm256_and_si256(a, b), _mm256_and_si256(a, c)),
+          _mm256_and_si256(b, c));
+      __m256i temp2 = _mm256_add_epi32(s0, maj);
+      h = g;
+      g = f;
+      f = e;
+      e = _mm256_add_epi32(d, temp1);
+      d = c;
+      c = b;
+      b = a;
+      a = _mm256_add_epi32(temp1, temp2);
+    }
+
+    __m256i next[8] = {a, b, c, d, e, f, g, h};
+    for (int i = 0; i < 8; ++i) {
+      state[i] = _mm256_blendv_epi8(
+          state[i], _mm256_add_epi32(state[i], next[i]), active);
+    }
+  }
+#endif
+};
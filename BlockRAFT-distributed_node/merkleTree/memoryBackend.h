@@ -0,0 +1,167 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+#include "stateBackend.h"
+
+using namespace std;
+
+// In-memory store for experiments that should not pay disk or compaction
+// costs. Keys live in sorted maps sharded by their first hex digit, so all
+// keys under a trie prefix share a shard. Stores are kept per path for the
+// life of the process, like RocksDB directories: two instances opened on
+// the same path see the same data.
+class MemoryBackend : public StateBackend {
+ private:
+  static const size_t kShards = 16;
+
+  struct Shard {
+    shared_mutex mutex;
+    map<string, string> data;
+  };
+  using Store = array<Shard, kShards>;
+
+  static map<string, shared_ptr<Store>>& registry() {
+    static map<string, shared_ptr<Store>> stores;
+    return stores;
+  }
+  static mutex& registryMutex() {
+    static mutex lock;
+    return lock;
+  }
+  static shared_ptr<Store> storeAt(const string& path) {
+    lock_guard<mutex> lock(registryMutex());
+    auto& store = registry()[path];
+    if (!store) store = make_shared<Store>();
+    return store;
+  }
+
+  shared_ptr<Store> store;
+  string storePath;
+
+  static size_t shardOf(const string& key) {
+    if (key.empty()) return 0;
+    char c = key[0];
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return static_cast<unsigned char>(c) % kShards;
+  }
+
+ public:
+  MemoryBackend(const string& path, bool fresh = false)
+      : store(storeAt(path)), storePath(path) {
+    if (fresh) clear();
+  }
+
+  bool get(const string& key, string* value) override {
+    Shard& shard = (*store)[shardOf(key)];
+    shared_lock<shared_mutex> lock(shard.mutex);
+    auto it = shard.data.find(key);
+    if (it == shard.data.end()) return false;
+    *value = it->second;
+    return true;
+  }
+
+  bool put(const string& key, const string& value) override {
+    Shard& shard = (*store)[shardOf(key)];
+    unique_lock<shared_mutex> lock(shard.mutex);
+    shard.data[key] = value;
+    return true;
+  }
+
+  vector<string> multiGet(const vector<string>& keys) override {
+    vector<string> values(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) get(keys[i], &values[i]);
+    return values;
+  }
+
+  bool write(const vector<pair<string, string>>& batch,
+             const vector<string>& erased) override {
+    // Lock the touched shards in index order so the batch lands atomically
+    array<bool, kShards> touched{};
+    for (const auto& entry : batch) touched[shardOf(entry.first)] = true;
+    for (const auto& key : erased) touched[shardOf(key)] = true;
+    vector<unique_lock<shared_mutex>> locks;
+    for (size_t i = 0; i < kShards; ++i) {
+      if (touched[i]) locks.emplace_back((*store)[i].mutex);
+    }
+    for (const auto& [key, value] : batch) {
+      (*store)[shardOf(key)].data[key] = value;
+    }
+    for (const auto& key : erased) (*store)[shardOf(key)].data.erase(key);
+    return true;
+  }
+
+  void forEach(
+      const function<void(const string&, const string&)>& visit) override {
+    for (auto& shard : *store) {
+      shared_lock<shared_mutex> lock(shard.mutex);
+      for (const auto& [key, value] : shard.data) visit(key, value);
+    }
+  }
+
+  // Keys sharing a first character share a shard, so one shard holds the
+  // whole range
+  void scan(const string& prefix, const string& from,
+            const function<bool(const string&, const string&)>& visit)
+      override {
+    Shard& shard = (*store)[shardOf(prefix)];
+    shared_lock<shared_mutex> lock(shard.mutex);
+    for (auto it = shard.data.lower_bound(max(prefix, from));
+         it != shard.data.end(); ++it) {
+      if (it->first.compare(0, prefix.size(), prefix) != 0) break;
+      if (!visit(it->first, it->second)) break;
+    }
+  }
+
+  void scanLeaves(const string& prefix,
+                  const function<void(const string&)>& visit) override {
+    if (prefix.empty()) return StateBackend::scanLeaves(prefix, visit);
+    scan(prefix, "", [&](const string& key, const string&) {
+      if (key.size() == 64 &&
+          key.find_first_not_of("0123456789abcdef") == string::npos) {
+        visit(key);
+      }
+      return true;
+    });
+  }
+
+  bool clear() override {
+    for (auto& shard : *store) {
+      unique_lock<shared_mutex> lock(shard.mutex);
+      shard.data.clear();
+    }
+    return true;
+  }
+
+  bool copyTo(const string& targetPath) override {
+    shared_ptr<Store> target = storeAt(targetPath);
+    if (target == store) return true;
+    for (size_t i = 0; i < kShards; ++i) {
+      shared_lock<shared_mutex> source((*store)[i].mutex);
+      unique_lock<shared_mutex> lock((*target)[i].mutex);
+      (*target)[i].data = (*store)[i].data;
+    }
+    return true;
+  }
+
+  bool replaceWith(const string& sourcePath) override {
+    shared_ptr<Store> source = storeAt(sourcePath);
+    if (source == store) return true;
+    for (size_t i = 0; i < kShards; ++i) {
+      unique_lock<shared_mutex> lock((*store)[i].mutex);
+      unique_lock<shared_mutex> sourceLock((*source)[i].mutex);
+      (*store)[i].data.swap((*source)[i].data);
+      (*source)[i].data.clear();
+    }
+    lock_guard<mutex> lock(registryMutex());
+    registry().erase(sourcePath);
+    return true;
+  }
+};
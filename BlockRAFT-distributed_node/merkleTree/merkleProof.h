@@ -0,0 +1,93 @@
+#pragma once
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "hashEngine.h"
+
+using namespace std;
+
+// Merkle proofs over the GlobalState trie. A node's hash is sha256 of each
+// child's label and hash, in stored order, then its value (see
+// appendChildHash), and a leaf lives at the 64-character hex hash of its
+// key. The root is stored under "rootNode" and appears here with the empty
+// path. This header has no RocksDB dependency,
+// so light clients can verify proofs against a root hash they trust.
+
+struct ProofNode {
+  string path;                // trie prefix of the node, "" for the root
+  string labels;              // last character of each child, in order
+  vector<string> childHashes; // "" for children that are also in the proof
+  string value;
+};
+
+// Single and multi-key proofs share this shape. Nodes on the paths of
+// several keys appear once.
+struct MerkleProof {
+  string rootHash;
+  map<string, ProofNode> nodes;
+};
+
+inline string proofHash(const string& input) { return HashEngine::hash(input); }
+
+// Adds a child to its parent's hash input. The label, the last character
+// of the child's path, is hashed with it, so the root commits to every key
+// path and the edges of a proof cannot be relabelled to spell another key.
+inline void appendChildHash(string& input, char label,
+                            const string& childHash) {
+  input += label;
+  input += childHash;
+}
+
+// Recomputes the root from the proof nodes. Returns "" when the proof is
+// malformed, for example when a node is missing a child hash.
+inline string computeProofRoot(const MerkleProof& proof) {
+  map<string, string> computed;
+  function<string(const string&)> hashOf = [&](const string& path) {
+    auto done = computed.find(path);
+    if (done != computed.end()) return done->second;
+    const ProofNode& node = proof.nodes.at(path);
+    if (node.labels.size() != node.childHashes.size()) return string();
+    string combined;
+    for (size_t i = 0; i < node.labels.size(); ++i) {
+      // Children are stored sorted and unique
+      if (i > 0 && node.labels[i] <= node.labels[i - 1]) return string();
+      string childPath = path + node.labels[i];
+      if (proof.nodes.count(childPath)) {
+        string childHash = hashOf(childPath);
+        if (childHash.empty()) return string();
+        appendChildHash(combined, node.labels[i], childHash);
+      } else if (!node.childHashes[i].empty()) {
+        appendChildHash(combined, node.labels[i], node.childHashes[i]);
+      } else {
+        return string();
+      }
+    }
+    combined += node.value;
+    return computed[path] = proofHash(combined);
+  };
+  if (!proof.nodes.count("")) return "";
+  return hashOf("");
+}
+
+// Checks that `key` maps to `value` under `expectedRoot`. An empty value
+// also accepts a proof of absence: the deepest node on the key's path is
+// present and has no child for the next character.
+inline bool verifyProof(const MerkleProof& proof, const string& expectedRoot,
+                        const string& key, const string& value) {
+  if (proof.rootHash != expectedRoot) return false;
+  if (computeProofRoot(proof) != expectedRoot) return false;
+
+  // Walk from the root so every node used is linked to the recomputed root
+  string keyHash = proofHash(key);
+  string path;
+  while (true) {
+    auto node = proof.nodes.find(path);
+    if (node == proof.nodes.end()) return false;
+    if (path.size() == keyHash.size()) return node->second.value == value;
+    char next = keyHash[path.size()];
+    if (node->second.labels.find(next) == string::npos) return value.empty();
+    path += next;
+  }
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Distributed commit splits the trie into the 16 subtrees under the root,
+// one per leading hex digit of the key hash. Each partition is owned by one
+// executing member, which inserts and hashes the block's writes under it;
+// every other member only stores the leaves and adopts the owner's
+// partition hash, and the leader merges the 16 hashes into the state root.
+const string kHexDigits = "0123456789abcdef";
+
+// "replicated" (default): every member rehashes the whole block.
+// "distributed": members hash only their partitions, and leave the others
+// stale, so it cannot be combined with state retention. node.cpp sets it
+// from the "commitMode" config key.
+inline string& defaultCommitMode() {
+  static string mode = "replicated";
+  return mode;
+}
+
+// Member id owning the partition of `digit`, or -1 without members
+inline int partitionOwner(char digit, const vector<int>& members) {
+  size_t index = kHexDigits.find(digit);
+  if (members.empty() || index == string::npos) return -1;
+  return members[index % members.size()];
+}
+
+// Owner lists travel through etcd as comma-separated member ids
+inline string serializeMembers(const vector<int>& members) {
+  string serialized;
+  for (size_t i = 0; i < members.size(); ++i) {
+    if (i > 0) serialized += ",";
+    serialized += to_string(members[i]);
+  }
+  return serialized;
+}
+
+inline vector<int> parseMembers(const string& serialized) {
+  vector<int> members;
+  stringstream ss(serialized);
+  string item;
+  while (getline(ss, item, ',')) {
+    if (!item.empty()) members.push_back(stoi(item));
+  }
+  return members;
+}
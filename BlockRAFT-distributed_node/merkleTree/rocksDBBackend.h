@@ -0,0 +1,204 @@
+#pragma once
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "addressFilter.h"
+#include "rocksdb/db.h"
+#include "rocksdb/sst_file_writer.h"
+#include "rocksdb/utilities/checkpoint.h"
+#include "stateBackend.h"
+#include "storageProfile.h"
+
+using namespace std;
+
+// RocksDB store using the shared storage profile and the trie column
+// family layout.
+class RocksDBBackend : public StateBackend {
+ private:
+  rocksdb::DB* db;
+  vector<rocksdb::ColumnFamilyHandle*> families;  // indexed by TrieFamily
+  string dbPath;
+  bool secondary;
+  bool readOnly;
+
+  void open() {
+    rocksdb::DBOptions options = profileDBOptions();
+    rocksdb::Status status;
+    if (secondary) {
+      options.max_open_files = -1;
+      status = rocksdb::DB::OpenAsSecondary(options, dbPath,
+                                            dbPath + "_secondary",
+                                            trieColumnFamilies(), &families,
+                                            &db);
+    } else if (readOnly) {
+      status = rocksdb::DB::OpenForReadOnly(options, dbPath,
+                                            trieColumnFamilies(), &families,
+                                            &db);
+    } else {
+      status = rocksdb::DB::Open(options, dbPath, trieColumnFamilies(),
+                                 &families, &db);
+    }
+    if (!status.ok()) {
+      throw runtime_error("Failed to open rocksDB at path: " + dbPath);
+    }
+  }
+
+  void close() {
+    if (!db) return;
+    for (auto* family : families) db->DestroyColumnFamilyHandle(family);
+    families.clear();
+    delete db;
+    db = nullptr;
+  }
+
+  rocksdb::ColumnFamilyHandle* familyFor(const string& key) {
+    return families[trieFamilyOf(key)];
+  }
+
+ public:
+  // A secondary instance follows a store opened by another process and is
+  // read-only. A read-only instance opens a store no process writes, such
+  // as a snapshot checkpoint, and leaves its files untouched.
+  RocksDBBackend(const string& path, bool fresh = false,
+                 bool secondary = false, bool readOnly = false)
+      : db(nullptr), dbPath(path), secondary(secondary), readOnly(readOnly) {
+    if (fresh && filesystem::exists(dbPath)) {
+      rocksdb::DestroyDB(dbPath, rocksdb::Options());
+    }
+    open();
+  }
+
+  ~RocksDBBackend() { close(); }
+
+  bool get(const string& key, string* value) override {
+    return db->Get(rocksdb::ReadOptions(), familyFor(key), key, value).ok();
+  }
+
+  bool put(const string& key, const string& value) override {
+    return db->Put(rocksdb::WriteOptions(), familyFor(key), key, value).ok();
+  }
+
+  vector<string> multiGet(const vector<string>& keys) override {
+    vector<rocksdb::Slice> slices(keys.begin(), keys.end());
+    vector<rocksdb::ColumnFamilyHandle*> keyFamilies;
+    keyFamilies.reserve(keys.size());
+    for (const auto& key : keys) keyFamilies.push_back(familyFor(key));
+    vector<string> data;
+    vector<rocksdb::Status> statuses =
+        db->MultiGet(rocksdb::ReadOptions(), keyFamilies, slices, &data);
+    for (size_t i = 0; i < keys.size(); ++i) {
+      if (!statuses[i].ok()) data[i].clear();
+    }
+    return data;
+  }
+
+  bool write(const vector<pair<string, string>>& batch,
+             const vector<string>& erased) override {
+    rocksdb::WriteBatch writeBatch;
+    for (const auto& [key, value] : batch) {
+      writeBatch.Put(familyFor(key), key, value);
+    }
+    for (const auto& key : erased) writeBatch.Delete(familyFor(key), key);
+    return db->Write(rocksdb::WriteOptions(), &writeBatch).ok();
+  }
+
+  void forEach(
+      const function<void(const string&, const string&)>& visit) override {
+    for (auto* family : families) {
+      rocksdb::Iterator* it = db->NewIterator(rocksdb::ReadOptions(), family);
+      for (it->SeekToFirst(); it->Valid(); it->Next()) {
+        visit(it->key().ToString(), it->value().ToString());
+      }
+      delete it;
+    }
+  }
+
+  void forEachLeaf(const function<void(const string&)>& visit) override {
+    rocksdb::Iterator* it =
+        db->NewIterator(rocksdb::ReadOptions(), families[kLeafFamily]);
+    for (it->SeekToFirst(); it->Valid(); it->Next()) {
+      visit(it->key().ToString());
+    }
+    delete it;
+  }
+
+  void scanLeaves(const string& prefix,
+                  const function<void(const string&)>& visit) override {
+    rocksdb::Iterator* it =
+        db->NewIterator(rocksdb::ReadOptions(), families[kLeafFamily]);
+    for (it->Seek(prefix); it->Valid(); it->Next()) {
+      string key = it->key().ToString();
+      if (key.compare(0, prefix.size(), prefix) != 0) break;
+      visit(key);
+    }
+    delete it;
+  }
+
+  void scan(const string& prefix, const string& from,
+            const function<bool(const string&, const string&)>& visit)
+      override {
+    rocksdb::Iterator* it =
+        db->NewIterator(rocksdb::ReadOptions(), familyFor(prefix));
+    for (it->Seek(max(prefix, from)); it->Valid(); it->Next()) {
+      string key = it->key().ToString();
+      if (key.compare(0, prefix.size(), prefix) != 0) break;
+      if (!visit(key, it->value().ToString())) break;
+    }
+    delete it;
+  }
+
+  bool clear() override {
+    close();
+    rocksdb::DestroyDB(dbPath, rocksdb::Options());
+    open();
+    return true;
+  }
+
+  bool copyTo(const string& targetPath) override {
+    RocksDBBackend target(targetPath);
+    bool success = true;
+    for (size_t i = 0; i < families.size(); ++i) {
+      rocksdb::Iterator* it =
+          db->NewIterator(rocksdb::ReadOptions(), families[i]);
+      for (it->SeekToFirst(); it->Valid(); it->Next()) {
+        target.db->Put(rocksdb::WriteOptions(), target.families[i], it->key(),
+                       it->value());
+      }
+      success = success && it->status().ok();
+      delete it;
+    }
+    return success;
+  }
+
+  // Hard-links the live SST files, so a checkpoint costs little more than
+  // a memtable flush
+  bool checkpoint(const string& targetPath) override {
+    rocksdb::Checkpoint* checkpoint = nullptr;
+    if (!rocksdb::Checkpoint::Create(db, &checkpoint).ok()) return false;
+    bool created = checkpoint->CreateCheckpoint(targetPath).ok();
+    delete checkpoint;
+    return created;
+  }
+
+  bool replaceWith(const string& sourcePath) override {
+    close();
+    rocksdb::DestroyDB(dbPath, rocksdb::Options());
+    filesystem::remove_all(dbPath);
+    filesystem::rename(sourcePath, dbPath);
+    open();
+    return true;
+  }
+
+  // Moves SST files built offline (see BulkLoader) into a family
+  bool ingest(TrieFamily family, const vector<string>& files) {
+    rocksdb::IngestExternalFileOptions options;
+    options.move_files = true;
+    if (family == kLeafFamily) SharedAddressFilter::drop(dbPath);
+    return db->IngestExternalFile(families[family], files, options).ok();
+  }
+
+  bool catchUp() override { return db->TryCatchUpWithPrimary().ok(); }
+};
@@ -0,0 +1,186 @@
+#pragma once
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "globalState.h"
+
+using namespace std;
+
+// Take a snapshot every this many blocks; 0 disables snapshots. node.cpp
+// sets it from the "snapshotInterval" config key.
+inline int& defaultSnapshotInterval() {
+  static int interval = 0;
+  return interval;
+}
+
+// Snapshots kept on disk; older ones are removed after each new snapshot.
+// node.cpp sets it from the "snapshotsKept" config key.
+inline size_t& defaultSnapshotsKept() {
+  static size_t kept = 2;
+  return kept;
+}
+
+inline string& defaultSnapshotDir() {
+  static string dir = "snapshots";
+  return dir;
+}
+
+// What a snapshot holds: the state after `block` was committed, whose root
+// is stateRoot. blockHash is the sha256 of the serialized block as stored
+// in blocksDB, so a node can check that its chain is the one the snapshot
+// was taken from before replaying the blocks after it.
+struct SnapshotManifest {
+  int block = -1;
+  string stateRoot;
+  string blockHash;
+
+  string serialize() const {
+    return "block " + to_string(block) + "\nstateRoot " + stateRoot +
+           "\nblockHash " + blockHash + "\n";
+  }
+
+  bool parse(const string& data) {
+    istringstream in(data);
+    string field, value;
+    block = -1;
+    while (in >> field) {
+      if (!(in >> value)) value.clear();
+      if (field == "block") {
+        block = stoi(value);
+      } else if (field == "stateRoot") {
+        stateRoot = value;
+      } else if (field == "blockHash") {
+        blockHash = value;
+      }
+    }
+    return block >= 0 && !stateRoot.empty();
+  }
+};
+
+// Snapshots under dir, one directory per block: "<block>/state" is a
+// checkpoint of the state store and "<block>/manifest" describes it. The
+// manifest is written last, so a snapshot without one is incomplete and
+// ignored.
+class SnapshotStore {
+ private:
+  string dir;
+
+ public:
+  explicit SnapshotStore(const string& dir = defaultSnapshotDir())
+      : dir(dir) {}
+
+  string snapshotPath(int block) const {
+    return dir + "/" + to_string(block);
+  }
+  string statePath(int block) const { return snapshotPath(block) + "/state"; }
+  string manifestPath(int block) const {
+    return snapshotPath(block) + "/manifest";
+  }
+
+  // Checkpoints the committed state of `block`; call at a block boundary,
+  // with no overlay open. Stale partitions are rebuilt first, so the
+  // snapshot's root can be recomputed from its leaves.
+  bool take(GlobalState& state, int block, const string& blockHash) {
+    filesystem::remove_all(snapshotPath(block));
+    filesystem::create_directories(snapshotPath(block));
+    state.refreshStalePartitions();
+    if (!state.checkpoint(statePath(block))) return false;
+    SnapshotManifest manifest{block, state.getRootHash(), blockHash};
+    if (!writeManifest(manifest)) return false;
+    prune(defaultSnapshotsKept());
+    return true;
+  }
+
+  // Writes the manifest through a rename, completing the snapshot
+  bool writeManifest(const SnapshotManifest& manifest) {
+    string path = manifestPath(manifest.block);
+    {
+      ofstream out(path + ".tmp");
+      out << manifest.serialize();
+      if (!out) return false;
+    }
+    error_code ec;
+    filesystem::rename(path + ".tmp", path, ec);
+    return !ec;
+  }
+
+  bool read(int block, SnapshotManifest* manifest) const {
+    ifstream in(manifestPath(block));
+    if (!in) return false;
+    stringstream data;
+    data << in.rdbuf();
+    return manifest->parse(data.str()) && manifest->block == block;
+  }
+
+  // Complete snapshots, oldest first
+  vector<SnapshotManifest> list() const {
+    vector<SnapshotManifest> manifests;
+    error_code ec;
+    for (const auto& entry : filesystem::directory_iterator(dir, ec)) {
+      string name = entry.path().filename().string();
+      if (name.empty() ||
+          name.find_first_not_of("0123456789") != string::npos) {
+        continue;
+      }
+      SnapshotManifest manifest;
+      if (read(stoi(name), &manifest)) manifests.push_back(manifest);
+    }
+    sort(manifests.begin(), manifests.end(),
+         [](const SnapshotManifest& a, const SnapshotManifest& b) {
+           return a.block < b.block;
+         });
+    return manifests;
+  }
+
+  bool latest(SnapshotManifest* manifest) const {
+    vector<SnapshotManifest> manifests = list();
+    if (manifests.empty()) return false;
+    *manifest = manifests.back();
+    return true;
+  }
+
+  // Whether the state of the snapshot hashes to manifest.stateRoot, with
+  // the root recomputed from every stored value rather than read back. The
+  // checkpoint is opened read-only and left as it is.
+  bool verify(const SnapshotManifest& manifest) const {
+    try {
+      GlobalState snapshot(
+          GlobalState::makeBackend(statePath(manifest.block), false, false,
+                                   true),
+          statePath(manifest.block), false);
+      return snapshot.computeRootHash() == manifest.stateRoot;
+    } catch (const exception&) {
+      return false;
+    }
+  }
+
+  // Replaces the state with the snapshot of `block` once its root checks
+  // out, so a corrupted snapshot leaves the state untouched
+  bool restore(GlobalState& state, int block) {
+    SnapshotManifest manifest;
+    if (!read(block, &manifest) || !verify(manifest)) return false;
+    if (!state.restoreFrom(statePath(block))) return false;
+    return state.getRootHash() == manifest.stateRoot;
+  }
+
+  // Keeps the newest `kept` snapshots
+  void prune(size_t kept) {
+    vector<SnapshotManifest> manifests = list();
+    for (size_t i = 0; i + kept < manifests.size(); ++i) {
+      filesystem::remove_all(snapshotPath(manifests[i].block));
+    }
+  }
+};
+
+// Snapshots `state` after `block` when snapshots are enabled and the block
+// falls on the interval; serializedBlock is the block as stored in blocksDB.
+inline bool snapshotIfDue(GlobalState& state, int block,
+                          const string& serializedBlock) {
+  int interval = defaultSnapshotInterval();
+  if (interval <= 0 || block % interval != 0) return true;
+  return SnapshotStore().take(state, block, HashEngine::hash(serializedBlock));
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Key-value store under GlobalState. Keys are trie node keys ("rootNode",
+// hex prefixes and 64-character leaf keys), values are serialized nodes.
+class StateBackend {
+ public:
+  virtual ~StateBackend() {}
+
+  virtual bool get(const string& key, string* value) = 0;
+  virtual bool put(const string& key, const string& value) = 0;
+  // One value per key, "" when the key is missing
+  virtual vector<string> multiGet(const vector<string>& keys) = 0;
+  // Applies all puts and erasures atomically
+  virtual bool write(const vector<pair<string, string>>& batch,
+                     const vector<string>& erased) = 0;
+  // Visits every key; visit must not write to the backend
+  virtual void forEach(
+      const function<void(const string&, const string&)>& visit) = 0;
+  // Visits every leaf key (64 hex characters); stores that keep leaves
+  // apart override it to skip the rest
+  virtual void forEachLeaf(const function<void(const string&)>& visit) {
+    forEach([&](const string& key, const string&) {
+      if (key.size() == 64 &&
+          key.find_first_not_of("0123456789abcdef") == string::npos) {
+        visit(key);
+      }
+    });
+  }
+  // Visits the leaf keys starting with prefix, e.g. one partition's
+  virtual void scanLeaves(const string& prefix,
+                          const function<void(const string&)>& visit) {
+    forEachLeaf([&](const string& key) {
+      if (key.compare(0, prefix.size(), prefix) == 0) visit(key);
+    });
+  }
+  // Visits the keys starting with a non-empty prefix, from the first one
+  // not below `from` and in key order, until visit returns false; visit
+  // must not write to the backend
+  virtual void scan(
+      const string& prefix, const string& from,
+      const function<bool(const string&, const string&)>& visit) = 0;
+
+  // Drops every key
+  virtual bool clear() = 0;
+  // Copies the contents to a new store at targetPath
+  virtual bool copyTo(const string& targetPath) = 0;
+  // Consistent point-in-time copy at targetPath, which must not exist yet;
+  // stores that can share immutable files with the copy override it
+  virtual bool checkpoint(const string& targetPath) {
+    return copyTo(targetPath);
+  }
+  // Takes over the store at sourcePath, which is removed
+  virtual bool replaceWith(const string& sourcePath) = 0;
+  // Refreshes a read-only follower of another process's store
+  virtual bool catchUp() { return true; }
+};
+
+// Backend used when GlobalState is not given one explicitly: "rocksdb"
+// (default) or "memory". node.cpp sets it from the "stateBackend" config key.
+inline string& defaultStateBackend() {
+  static string kind = "rocksdb";
+  return kind;
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "rocksdb/cache.h"
+#include "rocksdb/db.h"
+#include "rocksdb/filter_policy.h"
+#include "rocksdb/options.h"
+#include "rocksdb/slice_transform.h"
+#include "rocksdb/table.h"
+
+using namespace std;
+
+// RocksDB settings shared by every store the node opens. Set the fields
+// before the first store is opened; only the block cache size can still be
+// changed afterwards, through setBlockCacheMB().
+struct StorageProfile {
+  size_t blockCacheMB = 256;
+  int bloomBitsPerKey = 10;
+  size_t prefixLength = 8;  // trie prefixes are hex strings of 1-64 chars
+  bool pipelinedWrite = true;
+};
+
+inline StorageProfile& storageProfile() {
+  static StorageProfile profile;
+  return profile;
+}
+
+inline shared_ptr<rocksdb::Cache> sharedBlockCache() {
+  static shared_ptr<rocksdb::Cache> cache =
+      rocksdb::NewLRUCache(storageProfile().blockCacheMB << 20);
+  return cache;
+}
+
+inline void setBlockCacheMB(size_t megabytes) {
+  storageProfile().blockCacheMB = megabytes;
+  sharedBlockCache()->SetCapacity(megabytes << 20);
+}
+
+inline rocksdb::DBOptions profileDBOptions() {
+  rocksdb::DBOptions options;
+  options.create_if_missing = true;
+  options.create_missing_column_families = true;
+  options.enable_pipelined_write = storageProfile().pipelinedWrite;
+  return options;
+}
+
+// Bloom filters and the shared cache for every family. prefixKeys adds a
+// capped prefix extractor so prefix seeks over interior nodes stay within
+// one prefix bloom probe.
+inline rocksdb::ColumnFamilyOptions profileCFOptions(bool prefixKeys) {
+  rocksdb::BlockBasedTableOptions table;
+  table.block_cache = sharedBlockCache();
+  table.filter_policy.reset(
+      rocksdb::NewBloomFilterPolicy(storageProfile().bloomBitsPerKey, false));
+  table.cache_index_and_filter_blocks = true;
+  table.pin_l0_filter_and_index_blocks_in_cache = true;
+
+  rocksdb::ColumnFamilyOptions options;
+  options.table_factory.reset(rocksdb::NewBlockBasedTableFactory(table));
+  if (prefixKeys) {
+    options.prefix_extractor.reset(
+        rocksdb::NewCappedPrefixTransform(storageProfile().prefixLength));
+    options.memtable_prefix_bloom_size_ratio = 0.1;
+  }
+  return options;
+}
+
+inline rocksdb::Options profileOptions(bool prefixKeys = false) {
+  return rocksdb::Options(profileDBOptions(), profileCFOptions(prefixKeys));
+}
+
+// Trie key layout: metadata such as "rootNode" and anything else that is not
+// a hex prefix stays in the default family, 64-character leaf keys and
+// shorter interior prefixes get their own. The raw-address index
+// ("addr:<address>" -> value) is kept apart so prefix scans over it only
+// read index blocks. "leafAddr:<key hash>" -> address, in the default
+// family, names the address of each leaf for state sync; an address always
+// hashes to the same leaf, so the entry is never rewritten or erased.
+enum TrieFamily {
+  kMetaFamily = 0,
+  kLeafFamily = 1,
+  kInteriorFamily = 2,
+  kAddressFamily = 3
+};
+
+const string kAddressPrefix = "addr:";
+const string kLeafAddressPrefix = "leafAddr:";
+
+inline vector<rocksdb::ColumnFamilyDescriptor> trieColumnFamilies() {
+  return {{rocksdb::kDefaultColumnFamilyName, profileCFOptions(false)},
+          {"leaves", profileCFOptions(false)},
+          {"interior", profileCFOptions(true)},
+          {"addresses", profileCFOptions(false)}};
+}
+
+inline TrieFamily trieFamilyOf(const string& key) {
+  if (key.compare(0, kAddressPrefix.size(), kAddressPrefix) == 0) {
+    return kAddressFamily;
+  }
+  bool hexPrefix =
+      !key.empty() && key.find_first_not_of("0123456789abcdef") == string::npos;
+  if (!hexPrefix) return kMetaFamily;
+  return key.size() == 64 ? kLeafFamily : kInteriorFamily;
+}
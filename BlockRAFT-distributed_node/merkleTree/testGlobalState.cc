@@ -1,5 +1,11 @@
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <thread>
+
+#include "bulkLoader.h"
 #include "globalState.h"
 
 // Test case for inserting entries into GlobalState
@@ -62,7 +68,655 @@ TEST(GlobalStateTest, RetrieveAndVerifyTree) {
   EXPECT_EQ(state.getValue("key10"), "");
 }
 
+// Test case for batched lookups through MultiGet
+TEST(GlobalStateTest, MultiGetValues) {
+  GlobalState state;
+
+  state.insert("key1", "value1");
+  state.insert("key2", "value2");
+
+  std::vector<std::string> values =
+      state.multiGetValues({"key1", "key10", "key2"});
+  ASSERT_EQ(values.size(), 3);
+  EXPECT_EQ(values[0], "value1");
+  EXPECT_EQ(values[1], "");
+  EXPECT_EQ(values[2], "value2");
+}
+
+// Test case for committing and discarding the copy-on-write overlay
+TEST(GlobalStateTest, OverlayCommitAndDiscard) {
+  GlobalState state("overlayState", true);
+  state.insert("key1", "value1");
+  state.updateTree("key1");
+  std::string baseRoot = state.getRootHash();
+
+  // Staged writes are visible to reads but discarded without a trace
+  state.beginOverlay();
+  state.insert("key1", "staged");
+  state.insert("key2", "value2");
+  state.updateTree("key1 key2");
+  EXPECT_EQ(state.getValue("key1"), "staged");
+  EXPECT_GT(state.overlaySize(), 0);
+  state.discardOverlay();
+  EXPECT_EQ(state.getValue("key1"), "value1");
+  EXPECT_EQ(state.getValue("key2"), "");
+  EXPECT_EQ(state.getRootHash(), baseRoot);
+
+  // Committed writes match applying the same updates directly
+  state.beginOverlay();
+  state.insert("key2", "value2");
+  state.updateTree("key2");
+  EXPECT_TRUE(state.commitOverlay());
+  EXPECT_EQ(state.getValue("key2"), "value2");
+
+  GlobalState direct("overlayStateDirect", true);
+  direct.insert("key1", "value1");
+  direct.updateTree("key1");
+  direct.insert("key2", "value2");
+  direct.updateTree("key2");
+  EXPECT_EQ(state.getRootHash(), direct.getRootHash());
+}
+
+// Test updateTree against a full rehash after overlapping updates
+TEST(GlobalStateTest, UpdateTreeMatchesFullRehash) {
+  GlobalState state("updateTreeState", true);
+  std::string keys;
+  for (int i = 0; i < 200; ++i) {
+    std::string key = "key" + std::to_string(i);
+    state.insert(key, "value" + std::to_string(i));
+    keys += key + " ";
+  }
+  state.updateTree(keys);
+  std::string incremental = state.getRootHash();
+  state.updateAllNonLeafHashes();
+  EXPECT_EQ(state.getRootHash(), incremental);
+}
+
+// Test single, multi-key and absence proofs
+TEST(GlobalStateTest, MerkleProofs) {
+  GlobalState state("proofState", true);
+  std::string keys;
+  for (int i = 0; i < 50; ++i) {
+    std::string key = "key" + std::to_string(i);
+    state.insert(key, "value" + std::to_string(i));
+    keys += key + " ";
+  }
+  state.updateTree(keys);
+  std::string root = state.getRootHash();
+
+  MerkleProof proof = state.getProof("key7");
+  EXPECT_EQ(computeProofRoot(proof), root);
+  EXPECT_TRUE(verifyProof(proof, root, "key7", "value7"));
+  EXPECT_FALSE(verifyProof(proof, root, "key7", "value8"));
+
+  MerkleProof multi = state.getMultiProof({"key1", "key2", "key3", "absent"});
+  EXPECT_TRUE(verifyProof(multi, root, "key1", "value1"));
+  EXPECT_TRUE(verifyProof(multi, root, "key3", "value3"));
+  EXPECT_TRUE(verifyProof(multi, root, "absent", ""));
+  EXPECT_FALSE(verifyProof(multi, root, "key2", ""));
+
+  // Tampering with a sibling hash breaks the recomputed root
+  for (auto& [path, node] : proof.nodes) {
+    for (auto& hash : node.childHashes) {
+      if (!hash.empty()) hash[0] = hash[0] == '0' ? '1' : '0';
+    }
+  }
+  EXPECT_FALSE(verifyProof(proof, root, "key7", "value7"));
+}
+
+// Test that relabelling the edges of a valid proof to spell another key's
+// path is rejected
+TEST(GlobalStateTest, RelabelledProofRejected) {
+  GlobalState state("relabelState", true);
+  std::string keys;
+  for (int i = 0; i < 50; ++i) {
+    std::string key = "key" + std::to_string(i);
+    state.insert(key, "value" + std::to_string(i));
+    keys += key + " ";
+  }
+  state.updateTree(keys);
+  std::string root = state.getRootHash();
+  MerkleProof proof = state.getProof("key7");
+  ASSERT_TRUE(verifyProof(proof, root, "key7", "value7"));
+
+  // Move every node on key7's path onto the forged key's path, swapping
+  // labels in place so the child hashes keep their stored order
+  std::string from = proofHash("key7");
+  std::string to = proofHash("forged");
+  MerkleProof forged;
+  forged.rootHash = proof.rootHash;
+  for (size_t depth = 0; depth <= from.size(); ++depth) {
+    auto it = proof.nodes.find(from.substr(0, depth));
+    ASSERT_NE(it, proof.nodes.end());
+    ProofNode node = it->second;
+    node.path = to.substr(0, depth);
+    if (depth < from.size()) {
+      size_t own = node.labels.find(from[depth]);
+      size_t other = node.labels.find(to[depth]);
+      if (other == std::string::npos) {
+        node.labels[own] = to[depth];
+      } else {
+        std::swap(node.labels[own], node.labels[other]);
+      }
+    }
+    forged.nodes[node.path] = node;
+  }
+  EXPECT_FALSE(verifyProof(forged, root, "forged", "value7"));
+
+  // Claiming key7 is absent by renaming its edge fails the same way
+  MerkleProof absent = proof;
+  ProofNode& parent = absent.nodes.at(from.substr(0, from.size() - 1));
+  char unused = '0';
+  while (parent.labels.find(unused) != std::string::npos) ++unused;
+  parent.labels[parent.labels.find(from.back())] = unused;
+  EXPECT_FALSE(verifyProof(absent, root, "key7", ""));
+}
+
+// Test that an instance kept across blocks does not accumulate cached nodes
+TEST(GlobalStateTest, NodeCacheClearedPerBlock) {
+  GlobalState state(std::make_unique<MemoryBackend>("cacheState", true),
+                    "cacheState");
+  for (int block = 0; block < 3; ++block) {
+    std::string keys;
+    for (int i = 0; i < 100; ++i) {
+      std::string key = "block" + std::to_string(block) + "key" +
+                        std::to_string(i);
+      state.insert(key, "value");
+      keys += key + " ";
+    }
+    state.updateTree(keys);
+    EXPECT_GT(state.nodeCache.size(), 0);
+    ASSERT_TRUE(state.commitVersion(block));
+    EXPECT_EQ(state.nodeCache.size(), 0);
+  }
+}
+
+// Test that the in-memory backend builds the same tree as RocksDB
+TEST(GlobalStateTest, MemoryBackendMatchesRocksDB) {
+  GlobalState disk("backendDisk", true);
+  GlobalState memory(std::make_unique<MemoryBackend>("backendMemory", true),
+                     "backendMemory");
+  std::string keys;
+  for (int i = 0; i < 100; ++i) {
+    std::string key = "key" + std::to_string(i);
+    disk.insert(key, "value" + std::to_string(i));
+    memory.insert(key, "value" + std::to_string(i));
+    keys += key + " ";
+  }
+  disk.updateTree(keys);
+  memory.updateTree(keys);
+  EXPECT_EQ(memory.getRootHash(), disk.getRootHash());
+  EXPECT_EQ(memory.multiGetValues({"key5", "absent"}),
+            std::vector<std::string>({"value5", ""}));
+
+  // A second instance on the same path sees the same store
+  GlobalState reopened(std::make_unique<MemoryBackend>("backendMemory"),
+                       "backendMemory");
+  EXPECT_EQ(reopened.getRootHash(), disk.getRootHash());
+
+  // Resetting leaves only an empty root
+  memory.resetTree();
+  GlobalState empty(std::make_unique<MemoryBackend>("backendEmpty", true),
+                    "backendEmpty");
+  EXPECT_EQ(memory.getValue("key5"), "");
+  EXPECT_EQ(memory.getRootHash(), empty.getRootHash());
+}
+
+// Test historical reads, pruning and rollback with versioned state
+TEST(GlobalStateTest, VersionedState) {
+  GlobalState state(std::make_unique<MemoryBackend>("versionedState", true),
+                    "versionedState");
+  state.enableVersions(2);
+  std::vector<std::string> roots;
+  for (int block = 0; block < 4; ++block) {
+    std::string keys;
+    for (int i = 0; i < 20; ++i) {
+      std::string key = "key" + std::to_string(i);
+      state.insert(key, "value" + std::to_string(i + block));
+      keys += key + " ";
+    }
+    state.insert("block" + std::to_string(block), "new");
+    state.updateTree(keys + "block" + std::to_string(block));
+    EXPECT_TRUE(state.commitVersion(block));
+    roots.push_back(state.getRootHash());
+  }
+  state.pruneVersions();
+
+  EXPECT_EQ(state.getRootHashAt(3), roots[3]);
+  EXPECT_EQ(state.getValueAt("key1", 3), "value4");
+  EXPECT_EQ(state.getValueAt("key1", 2), "value3");
+  EXPECT_EQ(state.getValueAt("block3", 2), "");
+  // Versions outside the retention window are gone
+  EXPECT_EQ(state.getRootHashAt(1), "");
+  EXPECT_EQ(state.getValueAt("key1", 1), "");
+
+  // Rolling back restores the earlier root and values
+  EXPECT_TRUE(state.rollbackTo(2));
+  EXPECT_EQ(state.getRootHash(), roots[2]);
+  EXPECT_EQ(state.getValue("key1"), "value3");
+  EXPECT_EQ(state.getValue("block3"), "");
+  EXPECT_EQ(state.getValue("block2"), "new");
+  EXPECT_FALSE(state.rollbackTo(0));
+
+  // Pruning every version leaves no content-addressed nodes behind
+  state.enableVersions(1);
+  EXPECT_TRUE(state.commitVersion(10));
+  state.pruneVersions();
+  size_t versionedNodes = 0;
+  MemoryBackend("versionedState").forEach(
+      [&](const std::string& key, const std::string&) {
+        if (key.rfind("h:", 0) == 0) ++versionedNodes;
+      });
+  GlobalState copy(std::make_unique<MemoryBackend>("versionedCopy", true),
+                   "versionedCopy");
+  copy.enableVersions(1);
+  std::string keys;
+  for (int i = 0; i < 20; ++i) {
+    std::string key = "key" + std::to_string(i);
+    copy.insert(key, "value" + std::to_string(i + 2));
+    keys += key + " ";
+  }
+  copy.insert("block0", "new");
+  copy.insert("block1", "new");
+  copy.insert("block2", "new");
+  copy.updateTree(keys + "block0 block1 block2");
+  EXPECT_EQ(copy.getRootHash(), roots[2]);
+  EXPECT_TRUE(copy.commitVersion(0));
+  size_t expectedNodes = 0;
+  MemoryBackend("versionedCopy").forEach(
+      [&](const std::string& key, const std::string&) {
+        if (key.rfind("h:", 0) == 0) ++expectedNodes;
+      });
+  EXPECT_EQ(versionedNodes, expectedNodes);
+}
+
+// Concurrent writers must build the same trie as one writer inserting the
+// same keys, whatever the interleaving.
+TEST(GlobalStateTest, ConcurrentInsertMatchesSerial) {
+  const int kThreads = 8;
+  const int kKeysPerThread = 150;
+  std::vector<std::pair<std::string, std::string>> entries;
+  std::string keys;
+  for (int i = 0; i < kThreads * kKeysPerThread; ++i) {
+    std::string key = "key" + std::to_string(i);
+    entries.emplace_back(key, "value" + std::to_string(i));
+    keys += key + " ";
+  }
+
+  GlobalState serial("serialState", true);
+  std::vector<std::pair<std::string, std::string>> shuffled = entries;
+  std::shuffle(shuffled.begin(), shuffled.end(), std::mt19937(42));
+  for (const auto& [key, value] : shuffled) serial.insert(key, value);
+  serial.updateTree(keys);
+
+  for (bool staged : {false, true}) {
+    GlobalState concurrent("concurrentState", true);
+    if (staged) concurrent.beginOverlay();
+    std::vector<std::thread> writers;
+    for (int t = 0; t < kThreads; ++t) {
+      writers.emplace_back([&, t]() {
+        // Interleave so every thread writes under every prefix
+        for (size_t i = t; i < entries.size(); i += kThreads) {
+          concurrent.insert(entries[i].first, entries[i].second);
+        }
+      });
+    }
+    for (auto& writer : writers) writer.join();
+    concurrent.updateTree(keys);
+    EXPECT_TRUE(concurrent.commitOverlay());
+
+    EXPECT_EQ(concurrent.getRootHash(), serial.getRootHash());
+    for (size_t i = 0; i < entries.size(); i += 37) {
+      EXPECT_EQ(concurrent.getValue(entries[i].first), entries[i].second);
+    }
+  }
+}
+
+// Test that a state with stale partitions refuses to version instead of
+// rebuilding them, and that rebuilding touches only the named partitions
+TEST(GlobalStateTest, StalePartitionsNotVersioned) {
+  GlobalState serial(std::make_unique<MemoryBackend>("staleSerial", true),
+                     "staleSerial");
+  GlobalState state("staleVersioned", true);
+  state.enableVersions(2);
+  std::string keys;
+  for (int i = 0; i < 100; ++i) {
+    std::string key = "key" + std::to_string(i);
+    serial.insert(key, "value");
+    state.insertDeferred(key, "value");
+    keys += key + " ";
+  }
+  serial.updateTree(keys);
+  std::string stale = state.getStalePartitions();
+  ASSERT_FALSE(stale.empty());
+  EXPECT_FALSE(state.commitVersion(0));
+  EXPECT_EQ(state.getStalePartitions(), stale);
+
+  state.refreshPartitions(stale.substr(1));
+  EXPECT_EQ(state.getStalePartitions(), stale.substr(0, 1));
+  state.refreshPartitions(stale.substr(0, 1));
+  EXPECT_EQ(state.getRootHash(), serial.getRootHash());
+  EXPECT_TRUE(state.commitVersion(0));
+}
+
+// Members hash only the partitions they own and adopt the others' hashes;
+// every member and the merging leader must reach the serial root.
+TEST(GlobalStateTest, DistributedCommitMatchesSerial) {
+  const int kMembers = 3;
+  GlobalState serial(std::make_unique<MemoryBackend>("partitionSerial", true),
+                     "partitionSerial");
+  GlobalState leader(std::make_unique<MemoryBackend>("partitionLeader", true),
+                     "partitionLeader");
+  std::vector<std::unique_ptr<GlobalState>> members;
+  for (int m = 0; m < kMembers; ++m) {
+    std::string path = "partitionMember" + std::to_string(m);
+    members.push_back(std::make_unique<GlobalState>(
+        std::make_unique<MemoryBackend>(path, true), path));
+  }
+
+  // Ownership changes between blocks, as members fail or rejoin
+  std::vector<std::vector<int>> owners = {{0, 1, 2}, {0, 2}, {1}};
+  std::map<std::string, std::string> latest;
+  for (size_t block = 0; block < owners.size(); ++block) {
+    std::vector<std::pair<std::string, std::string>> writes;
+    std::string keys;
+    for (int i = 0; i < 300; ++i) {
+      std::string key = "key" + std::to_string((i * 7 + block * 50) % 500);
+      std::string value = "value" + std::to_string(block) + "_" +
+                          std::to_string(i);
+      writes.emplace_back(key, value);
+      latest[key] = value;
+      keys += key + " ";
+    }
+    for (const auto& [key, value] : writes) serial.insert(key, value);
+    serial.updateTree(keys);
+
+    std::map<char, std::string> partials;
+    for (int m = 0; m < kMembers; ++m) {
+      std::string ownedKeys;
+      for (const auto& [key, value] : writes) {
+        char digit = serial.computeHash(key)[0];
+        if (partitionOwner(digit, owners[block]) == m) {
+          members[m]->insert(key, value);
+          ownedKeys += key + " ";
+        } else {
+          members[m]->insertDeferred(key, value);
+        }
+      }
+      members[m]->updateTree(ownedKeys);
+      for (char digit : kHexDigits) {
+        if (partitionOwner(digit, owners[block]) == m) {
+          partials[digit] = members[m]->getPartitionHash(digit);
+        }
+      }
+    }
+
+    for (int m = 0; m < kMembers; ++m) {
+      std::map<char, std::string> others;
+      for (const auto& [digit, hash] : partials) {
+        if (partitionOwner(digit, owners[block]) != m) others[digit] = hash;
+      }
+      members[m]->adoptPartitionHashes(others);
+      EXPECT_EQ(members[m]->getRootHash(), serial.getRootHash());
+    }
+    for (const auto& [key, value] : writes) leader.insertDeferred(key, value);
+    leader.adoptPartitionHashes(partials);
+    EXPECT_EQ(leader.getRootHash(), serial.getRootHash());
+  }
+
+  // Values are readable everywhere; proofs come from the partition's owner
+  // and are refused where it is stale, without writing. Stale partitions
+  // rebuilt from their leaves match the serial trie node for node.
+  EXPECT_EQ(leader.getValue("key0"), latest["key0"]);
+  int owner = partitionOwner(serial.computeHash("key3")[0], owners.back());
+  MerkleProof proof = members[owner]->getProof("key3");
+  EXPECT_TRUE(verifyProof(proof, serial.getRootHash(), "key3", latest["key3"]));
+  EXPECT_EQ(proof.nodes.size(), serial.getProof("key3").nodes.size());
+  std::string staleBefore = leader.getStalePartitions();
+  EXPECT_THROW(leader.getProof("key3"), std::runtime_error);
+  EXPECT_EQ(leader.getStalePartitions(), staleBefore);
+  leader.refreshStalePartitions();
+  EXPECT_EQ(leader.getStalePartitions(), "");
+  EXPECT_EQ(leader.getRootHash(), serial.getRootHash());
+  leader.updateAllNonLeafHashes();
+  EXPECT_EQ(leader.getRootHash(), serial.getRootHash());
+}
+
+// Every batch path must agree with single hashing, including inputs around
+// the padding boundaries and batches that leave lanes empty
+TEST(GlobalStateTest, HashEngineBatchPaths) {
+  EXPECT_EQ(HashEngine::hash("abc"),
+            "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+  std::vector<std::string> inputs = {""};
+  for (size_t length : {1, 55, 56, 63, 64, 119, 120, 1100}) {
+    inputs.push_back(std::string(length, 'a' + length % 26));
+  }
+  for (int i = 0; i < 37; ++i) inputs.push_back("key" + std::to_string(i));
+
+  for (auto path :
+       {HashEngine::kEVP, HashEngine::kAVX2, HashEngine::kAuto}) {
+    std::vector<std::string> hashes = HashEngine::hashBatch(inputs, path);
+    ASSERT_EQ(hashes.size(), inputs.size());
+    for (size_t i = 0; i < inputs.size(); ++i) {
+      EXPECT_EQ(hashes[i], HashEngine::hash(inputs[i]));
+    }
+  }
+}
+
+// Test that the address filter answers misses without changing results
+TEST(GlobalStateTest, AddressFilter) {
+  GlobalState state(std::make_unique<MemoryBackend>("filterState", true),
+                    "filterState");
+  std::string keys;
+  for (int i = 0; i < 2000; ++i) {
+    std::string key = "account" + std::to_string(i);
+    state.insert(key, std::to_string(i));
+    keys += key + " ";
+  }
+  state.updateTree(keys);
+
+  AddressFilter::Stats before = state.addressFilterStats();
+  for (int i = 0; i < 2000; ++i) {
+    EXPECT_EQ(state.getValue("account" + std::to_string(i)),
+              std::to_string(i));
+    EXPECT_EQ(state.getValue("voter" + std::to_string(i)), "");
+  }
+  EXPECT_EQ(state.multiGetValues({"account5", "voter5"}),
+            std::vector<std::string>({"5", ""}));
+  AddressFilter::Stats after = state.addressFilterStats();
+  size_t misses = (after.skipped - before.skipped) +
+                  (after.falsePositives - before.falsePositives);
+  EXPECT_EQ(misses, 2001);
+  EXPECT_LT(after.falsePositiveRate(), 0.05);
+
+  // Another instance on the path shares the filter and sees the writes;
+  // so does one rebuilt from the store after a reset of the registry
+  GlobalState reopened(std::make_unique<MemoryBackend>("filterState"),
+                       "filterState");
+  reopened.insert("voter7", "1");
+  EXPECT_EQ(state.getValue("voter7"), "1");
+  SharedAddressFilter::drop("filterState");
+  GlobalState rebuilt(std::make_unique<MemoryBackend>("filterState"),
+                      "filterState");
+  EXPECT_EQ(rebuilt.addressFilterStats().keys, 2001);
+  EXPECT_EQ(rebuilt.getValue("account42"), "42");
+  EXPECT_EQ(rebuilt.getValue("voter7"), "1");
+}
+
+// Test that rebuilding the filter does not disturb reads on other threads
+TEST(GlobalStateTest, AddressFilterRebuildWhileReading) {
+  GlobalState state(std::make_unique<MemoryBackend>("filterRebuild", true),
+                    "filterRebuild");
+  std::string keys;
+  for (int i = 0; i < 500; ++i) {
+    std::string key = "account" + std::to_string(i);
+    state.insert(key, std::to_string(i));
+    keys += key + " ";
+  }
+  state.updateTree(keys);
+
+  std::atomic<bool> done{false};
+  std::atomic<int> wrong{0};
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 4; ++t) {
+    readers.emplace_back([&, t]() {
+      for (int i = t; !done; i = (i + 4) % 500) {
+        std::string value = state.getValue("account" + std::to_string(i));
+        if (value != std::to_string(i)) ++wrong;
+        if (state.getValue("voter" + std::to_string(i)) != "") ++wrong;
+      }
+    });
+  }
+  for (int i = 0; i < 50; ++i) state.rebuildLeafFilter();
+  done = true;
+  for (auto& reader : readers) reader.join();
+  EXPECT_EQ(wrong, 0);
+  EXPECT_EQ(state.addressFilterStats().keys, 500);
+}
+
+// Test paged prefix scans of the address index on both backends
+TEST(GlobalStateTest, AddressScan) {
+  for (const std::string kind : {"rocksdb", "memory"}) {
+    std::unique_ptr<StateBackend> backend;
+    if (kind == "memory") {
+      backend = std::make_unique<MemoryBackend>("scanState", true);
+    } else {
+      backend = std::make_unique<RocksDBBackend>("scanState", true);
+    }
+    GlobalState state(std::move(backend), "scanState");
+    state.enableVersions(2);
+    std::string keys;
+    for (int i = 0; i < 30; ++i) {
+      std::string wallet = "wallet" + std::to_string(100 + i);
+      state.insert(wallet, "balance" + std::to_string(i));
+      state.insert("item" + std::to_string(i), "stock" + std::to_string(i));
+      keys += wallet + " item" + std::to_string(i) + " ";
+    }
+    state.updateTree(keys);
+    EXPECT_TRUE(state.commitVersion(0));
+
+    // Only the prefix, in address order
+    std::vector<std::string> wallets;
+    size_t visited = state.scan(
+        "wallet", 0, [&](const std::string& address, const std::string&) {
+          wallets.push_back(address);
+          return true;
+        });
+    EXPECT_EQ(visited, 30u);
+    EXPECT_TRUE(std::is_sorted(wallets.begin(), wallets.end()));
+    EXPECT_EQ(wallets.front(), "wallet100");
+
+    // Pages of 8 resume where the previous one stopped
+    std::vector<std::string> paged;
+    std::string last;
+    while (true) {
+      size_t page = state.scan(
+          "wallet", 8,
+          [&](const std::string& address, const std::string&) {
+            paged.push_back(address);
+            last = address;
+            return true;
+          },
+          last);
+      if (page < 8) break;
+    }
+    EXPECT_EQ(paged, wallets);
+
+    // Updates replace the indexed value; staged writes show after commit
+    state.beginOverlay();
+    state.insert("wallet100", "updated");
+    state.insert("wallet999", "new");
+    std::string value;
+    state.scan("wallet100", 1, [&](const std::string&, const std::string& v) {
+      value = v;
+      return true;
+    });
+    EXPECT_EQ(value, "balance0");
+    EXPECT_TRUE(state.commitOverlay());
+    state.updateTree("wallet100 wallet999");
+    EXPECT_TRUE(state.commitVersion(1));
+    state.scan("wallet100", 1, [&](const std::string&, const std::string& v) {
+      value = v;
+      return true;
+    });
+    EXPECT_EQ(value, "updated");
+    EXPECT_EQ(state.scan("wallet", 0, [](auto&, auto&) { return true; }), 31u);
+
+    // A rollback brings the index back with the trie
+    EXPECT_TRUE(state.rollbackTo(0));
+    state.scan("wallet100", 1, [&](const std::string&, const std::string& v) {
+      value = v;
+      return true;
+    });
+    EXPECT_EQ(value, "balance0");
+    EXPECT_EQ(state.scan("wallet", 0, [](auto&, auto&) { return true; }), 30u);
+    EXPECT_EQ(state.scan("item", 0, [](auto&, auto&) { return true; }), 30u);
+  }
+}
+
+// Test that a bulk-loaded trie matches one built by inserts
+TEST(GlobalStateTest, BulkLoadMatchesInserts) {
+  GlobalState expected(std::make_unique<MemoryBackend>("bulkExpected", true),
+                       "bulkExpected");
+  BulkLoader loader("bulkState_work", 256);  // several runs to merge
+  std::mt19937 rng(11);
+  std::string keys;
+  std::vector<std::pair<std::string, std::string>> records;
+  for (int i = 0; i < 3000; ++i) {
+    // Some addresses repeat; the last value wins in both paths
+    std::string address = "acct" + std::to_string(rng() % 2500);
+    std::string value = std::to_string(rng() % 100000);
+    expected.insert(address, value);
+    records.emplace_back(address, value);
+    keys += address + " ";
+  }
+  expected.updateTree(keys);
+  // The loader takes a stream sorted by address
+  std::stable_sort(records.begin(), records.end(),
+                   [](const auto& a, const auto& b) {
+                     return a.first < b.first;
+                   });
+  for (const auto& [address, value] : records) {
+    EXPECT_TRUE(loader.add(address, value));
+  }
+
+  {
+    RocksDBBackend backend("bulkState", true);
+    EXPECT_TRUE(loader.loadInto(backend));
+  }
+  EXPECT_EQ(loader.lastLoad().rootHash, expected.getRootHash());
+  GlobalState state("bulkState");
+  EXPECT_EQ(state.getRootHash(), expected.getRootHash());
+  EXPECT_EQ(state.getValue("acct7"), expected.getValue("acct7"));
+  size_t indexed = state.scan("acct", 0, [](auto&, auto&) { return true; });
+  EXPECT_EQ(indexed, loader.lastLoad().addresses);
+  const std::string& loaded = records.front().first;
+  EXPECT_EQ(state.addressesOf({HashEngine::hash(loaded)})[0], loaded);
+
+  // The loaded trie takes ordinary updates
+  state.insert("acct7", "1");
+  state.insert("newAccount", "2");
+  expected.insert("acct7", "1");
+  expected.insert("newAccount", "2");
+  state.updateTree("acct7 newAccount");
+  expected.updateTree("acct7 newAccount");
+  EXPECT_EQ(state.getRootHash(), expected.getRootHash());
+
+  // Only an empty state can be bulk loaded
+  BulkLoader again("bulkState_work");
+  again.add("acct1", "5");
+  RocksDBBackend backend("bulkState");
+  EXPECT_FALSE(again.loadInto(backend));
+
+  // An out-of-order stream fails the load
+  RocksDBBackend empty("bulkUnsorted", true);
+  BulkLoader unsorted("bulkUnsorted_work");
+  EXPECT_TRUE(unsorted.add("acct2", "1"));
+  EXPECT_FALSE(unsorted.add("acct1", "1"));
+  EXPECT_FALSE(unsorted.loadInto(empty));
+}
+
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
-}
\ No newline at end of file
+}
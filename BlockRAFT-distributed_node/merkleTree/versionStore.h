@@ -0,0 +1,339 @@
+#pragma once
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "merkleProof.h"
+#include "stateBackend.h"
+
+using namespace std;
+
+// Number of past blocks whose state stays queryable; 0 disables versioning.
+// node.cpp sets it from the "stateRetention" config key.
+inline size_t& defaultVersionRetention() {
+  static size_t retention = 0;
+  return retention;
+}
+
+// Immutable, content-addressed copies of trie nodes next to the working
+// trie. A version is the node committed as the root for a block, and every
+// node reachable from it is stored under "h:<id>" with its children
+// referenced by id, so a version pins a full state without copying the
+// store. The id hashes the node's trie hash, child labels, child ids and
+// value; the trie hash alone does not cover the labels, so two different
+// subtrees can share it. Nodes are reference counted by their parents and
+// by version roots; pruning a version releases exactly the nodes no
+// retained version still reaches. "id:<key>" remembers the id of each
+// working node as of the last commit, so unchanged subtrees are skipped.
+class VersionStore {
+ public:
+  // View of a working trie node: children are the working keys
+  struct TrieNode {
+    string hash;
+    string value;
+    vector<string> children;
+  };
+
+ private:
+  struct Entry {
+    int refs = 0;
+    string hash;    // trie hash of the node
+    string labels;  // last character of each child's prefix
+    vector<string> childIds;
+    string value;
+    bool erased = false;
+  };
+
+  StateBackend& backend;
+  size_t retention;
+  mutex commitMutex;  // serializes commits, pruning and version reads
+
+  // Working keys written since the last commit
+  mutex dirtyMutex;
+  unordered_set<string> dirty;
+
+  thread gcThread;
+  mutex gcMutex;
+  condition_variable gcWake;
+  bool gcPending = false;
+  bool stopping = false;
+
+  static string entryKey(const string& id) { return "h:" + id; }
+  static string versionKey(int block) { return "version:" + to_string(block); }
+
+  // "hash,labels,childId...,value"; the value goes last since it may
+  // contain commas. The stored form prefixes the reference count.
+  static string entryContent(const Entry& entry) {
+    string content = entry.hash + "," + entry.labels;
+    for (const auto& childId : entry.childIds) content += "," + childId;
+    return content + "," + entry.value;
+  }
+
+  static Entry deserializeEntry(const string& data) {
+    Entry entry;
+    size_t pos = data.find(',');
+    entry.refs = stoi(data.substr(0, pos));
+    size_t next = data.find(',', pos + 1);
+    entry.hash = data.substr(pos + 1, next - pos - 1);
+    pos = next;
+    next = data.find(',', pos + 1);
+    entry.labels = data.substr(pos + 1, next - pos - 1);
+    pos = next;
+    for (size_t i = 0; i < entry.labels.size(); ++i) {
+      next = data.find(',', pos + 1);
+      entry.childIds.push_back(data.substr(pos + 1, next - pos - 1));
+      pos = next;
+    }
+    entry.value = data.substr(pos + 1);
+    return entry;
+  }
+
+  bool loadEntry(const string& id, Entry* entry) {
+    string data;
+    if (!backend.get(entryKey(id), &data)) return false;
+    *entry = deserializeEntry(data);
+    return true;
+  }
+
+  // Entries read or created during one commit or prune, written in one batch
+  using Pending = unordered_map<string, Entry>;
+
+  Entry* pendingEntry(Pending& pending, const string& id) {
+    auto it = pending.find(id);
+    if (it != pending.end()) return it->second.erased ? nullptr : &it->second;
+    Entry entry;
+    if (!loadEntry(id, &entry)) return nullptr;
+    return &(pending[id] = entry);
+  }
+
+  // Stores the node under `key` and everything below it that is not stored
+  // yet, and returns its id. Only dirty nodes and their direct children are
+  // read.
+  string materialize(const function<TrieNode(const string&)>& readNode,
+                     const string& key, Pending& pending,
+                     vector<pair<string, string>>& puts) {
+    string id;
+    if (!dirty.count(key) && backend.get(mappingKey(key), &id) &&
+        pendingEntry(pending, id)) {
+      return id;
+    }
+
+    TrieNode node = readNode(key);
+    Entry entry;
+    entry.hash = node.hash;
+    entry.value = node.value;
+    for (const auto& child : node.children) {
+      entry.labels += child.back();
+      entry.childIds.push_back(materialize(readNode, child, pending, puts));
+    }
+    id = proofHash(entryContent(entry));
+    puts.emplace_back(mappingKey(key), id);
+    if (pendingEntry(pending, id)) return id;
+
+    for (const auto& childId : entry.childIds) {
+      pendingEntry(pending, childId)->refs++;
+    }
+    pending[id] = entry;
+    return id;
+  }
+
+  void release(const string& id, Pending& pending) {
+    Entry* entry = pendingEntry(pending, id);
+    if (!entry || --entry->refs > 0) return;
+    entry->erased = true;
+    vector<string> children = entry->childIds;
+    for (const auto& childId : children) release(childId, pending);
+  }
+
+  bool flush(const Pending& pending, vector<pair<string, string>> puts,
+             vector<string> erased) {
+    for (const auto& [id, entry] : pending) {
+      if (entry.erased) {
+        erased.push_back(entryKey(id));
+      } else {
+        puts.emplace_back(entryKey(id),
+                          to_string(entry.refs) + "," + entryContent(entry));
+      }
+    }
+    return backend.write(puts, erased);
+  }
+
+  int readInt(const string& key, int fallback) {
+    string data;
+    return backend.get(key, &data) ? stoi(data) : fallback;
+  }
+
+  string rootIdAt(int block) {
+    string id;
+    return backend.get(versionKey(block), &id) ? id : "";
+  }
+
+  void runGC() {
+    while (true) {
+      unique_lock<mutex> lock(gcMutex);
+      gcWake.wait(lock, [this]() { return gcPending || stopping; });
+      if (stopping) return;
+      gcPending = false;
+      lock.unlock();
+      pruneExpired();
+    }
+  }
+
+ public:
+  // With retention 0 the store only serves reads of existing versions.
+  VersionStore(StateBackend& backend, size_t retention)
+      : backend(backend), retention(retention) {
+    if (enabled()) gcThread = thread(&VersionStore::runGC, this);
+  }
+
+  ~VersionStore() {
+    {
+      lock_guard<mutex> lock(gcMutex);
+      stopping = true;
+    }
+    gcWake.notify_one();
+    if (gcThread.joinable()) gcThread.join();
+  }
+
+  bool enabled() const { return retention > 0; }
+
+  static string mappingKey(const string& key) { return "id:" + key; }
+
+  void markDirty(const string& key) {
+    if (!enabled()) return;
+    lock_guard<mutex> lock(dirtyMutex);
+    dirty.insert(key);
+  }
+
+  // Pins the current working trie as the state of `block` and schedules
+  // pruning of versions that fell out of the retention window.
+  bool commit(int block, const function<TrieNode(const string&)>& readNode) {
+    if (!enabled()) return true;
+    {
+      lock_guard<mutex> lock(commitMutex);
+      lock_guard<mutex> dirtyLock(dirtyMutex);
+      Pending pending;
+      vector<pair<string, string>> puts;
+      string root = materialize(readNode, "rootNode", pending, puts);
+
+      puts.emplace_back(versionKey(block), root);
+      pendingEntry(pending, root)->refs++;
+      string previous = rootIdAt(block);
+      if (!previous.empty()) {
+        release(previous, pending);  // re-executed block replaces its root
+      }
+      if (readInt("versionOldest", -1) < 0) {
+        puts.emplace_back("versionOldest", to_string(block));
+      }
+      int latest = max(block, readInt("versionLatest", block));
+      puts.emplace_back("versionLatest", to_string(latest));
+      if (!flush(pending, puts, {})) return false;
+      dirty.clear();
+    }
+    {
+      lock_guard<mutex> lock(gcMutex);
+      gcPending = true;
+    }
+    gcWake.notify_one();
+    return true;
+  }
+
+  // Drops versions older than the retention window. Runs on the GC thread
+  // after each commit, and can be called directly.
+  void pruneExpired() {
+    lock_guard<mutex> lock(commitMutex);
+    int oldest = readInt("versionOldest", -1);
+    int latest = readInt("versionLatest", -1);
+    if (oldest < 0) return;
+    int firstKept = latest - static_cast<int>(retention) + 1;
+    if (oldest >= firstKept) return;
+
+    Pending pending;
+    vector<string> erased;
+    for (int block = oldest; block < firstKept; ++block) {
+      string root = rootIdAt(block);
+      if (root.empty()) continue;
+      release(root, pending);
+      erased.push_back(versionKey(block));
+    }
+    flush(pending, {{"versionOldest", to_string(firstKept)}}, erased);
+  }
+
+  // Trie root hash of the state of `block`, "" when it is not retained
+  string getRootAt(int block) {
+    lock_guard<mutex> lock(commitMutex);
+    Entry entry;
+    return loadEntry(rootIdAt(block), &entry) ? entry.hash : "";
+  }
+
+  // Value of the leaf at keyHash in the state of `block`, "" when the key
+  // or the version does not exist.
+  string getValueAt(const string& keyHash, int block) {
+    // The GC would otherwise release the version's nodes mid-walk
+    lock_guard<mutex> lock(commitMutex);
+    string id = rootIdAt(block);
+    if (id.empty()) return "";
+    Entry entry;
+    for (char label : keyHash) {
+      if (!loadEntry(id, &entry)) return "";
+      size_t child = entry.labels.find(label);
+      if (child == string::npos) return "";
+      id = entry.childIds[child];
+    }
+    return loadEntry(id, &entry) ? entry.value : "";
+  }
+
+  // Calls visit(key, id, hash, value, childKeys) top-down for each node of
+  // the version that differs from the working trie as of the last commit
+  // or is below an uncommitted write. Used to roll the working trie back in
+  // time proportional to the change; the caller applies the result and then
+  // calls clearDirty().
+  bool walkDiff(int block,
+                const function<void(const string&, const string&,
+                                    const string&, const string&,
+                                    const vector<string>&)>& visit) {
+    lock_guard<mutex> lock(commitMutex);
+    string root = rootIdAt(block);
+    if (root.empty()) return false;
+
+    unordered_set<string> touched;  // keys on the path of a dirty key
+    {
+      lock_guard<mutex> lock(dirtyMutex);
+      for (string key : dirty) {
+        if (key == "rootNode") continue;
+        for (; !key.empty(); key.pop_back()) touched.insert(key);
+      }
+      if (!dirty.empty()) touched.insert("rootNode");
+    }
+
+    function<bool(const string&, const string&)> walk =
+        [&](const string& prefix, const string& id) {
+          string key = prefix.empty() ? "rootNode" : prefix;
+          string committed;
+          if (!touched.count(key) && backend.get(mappingKey(key), &committed) &&
+              committed == id) {
+            return true;
+          }
+          Entry entry;
+          if (!loadEntry(id, &entry)) return false;
+          vector<string> childKeys;
+          for (char label : entry.labels) childKeys.push_back(prefix + label);
+          visit(key, id, entry.hash, entry.value, childKeys);
+          for (size_t i = 0; i < childKeys.size(); ++i) {
+            if (!walk(childKeys[i], entry.childIds[i])) return false;
+          }
+          return true;
+        };
+    return walk("", root);
+  }
+
+  void clearDirty() {
+    lock_guard<mutex> lock(dirtyMutex);
+    dirty.clear();
+  }
+};
@@ -0,0 +1,131 @@
+#pragma once
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include "components.pb.h"
+#include "matrix.pb.h"
+
+// Writers and readers for both wire versions of matrix::DirectedGraph and
+// of component membership in components::componentsTable. Version 1 sends
+// the dense n x n matrix and one transactionID message per member; version
+// 2 sends packed varint gaps, so a 10k-transaction block costs bytes in its
+// edges and members rather than n^2 ints and a submessage per ID. Readers
+// accept either version, so nodes can be upgraded one at a time.
+
+const int kCompactProtoVersion = 2;
+
+// Fills graph from a square adjacency matrix, as edge lists when compact
+inline void encodeMatrix(const std::vector<std::vector<int>>& matrix,
+                         matrix::DirectedGraph* graph, bool compact) {
+  graph->Clear();
+  graph->set_num_nodes(matrix.size());
+  if (!compact) {
+    for (const auto& row : matrix) {
+      auto* matrixRow = graph->add_adjacencymatrix();
+      for (int edge : row) {
+        matrixRow->add_edges(edge);
+      }
+    }
+    return;
+  }
+  graph->set_version(kCompactProtoVersion);
+  for (const auto& row : matrix) {
+    int degree = 0, previous = 0;
+    for (int j = 0; j < (int)row.size(); ++j) {
+      if (!row[j]) continue;
+      graph->add_columndelta(j - previous);
+      previous = j;
+      degree++;
+    }
+    graph->add_rowdegree(degree);
+  }
+}
+
+// Rebuilds the n x n matrix from either version. Entries outside the
+// matrix are reported and skipped; returns false if there were any.
+inline bool decodeMatrix(const matrix::DirectedGraph& graph,
+                         std::vector<std::vector<int>>* matrix) {
+  int n = graph.num_nodes();
+  matrix->assign(n, std::vector<int>(n, 0));
+  bool valid = true;
+  if (graph.version() < kCompactProtoVersion) {
+    for (int i = 0; i < graph.adjacencymatrix_size(); ++i) {
+      if (i >= n) {
+        std::cerr << "Row index out of bounds: " << i << std::endl;
+        valid = false;
+        continue;
+      }
+      const auto& row = graph.adjacencymatrix(i);
+      for (int j = 0; j < row.edges_size(); ++j) {
+        if (j >= n) {
+          std::cerr << "Column index out of bounds: row " << i << ", col "
+                    << j << std::endl;
+          valid = false;
+          continue;
+        }
+        (*matrix)[i][j] = row.edges(j);
+      }
+    }
+    return valid;
+  }
+  int next = 0;
+  for (int i = 0; i < graph.rowdegree_size(); ++i) {
+    long long column = 0;
+    for (uint32_t k = 0; k < graph.rowdegree(i); ++k) {
+      if (next >= graph.columndelta_size()) {
+        std::cerr << "Edge list truncated at row " << i << std::endl;
+        return false;
+      }
+      column += graph.columndelta(next++);
+      if (i >= n || column >= n) {
+        std::cerr << "Edge out of bounds: " << i << " -> " << column
+                  << std::endl;
+        valid = false;
+        continue;
+      }
+      (*matrix)[i][column] = 1;
+    }
+  }
+  return valid;
+}
+
+// Sets the members of a component, as gaps when compact
+inline void encodeComponentTxns(
+    std::vector<int> txns, components::componentsTable::component* component,
+    bool compact) {
+  component->clear_transactionlist();
+  component->clear_transactiondelta();
+  if (!compact) {
+    for (int txn : txns) {
+      component->add_transactionlist()->set_id(txn);
+    }
+    return;
+  }
+  std::sort(txns.begin(), txns.end());
+  int previous = 0;
+  for (int txn : txns) {
+    component->add_transactiondelta(txn - previous);
+    previous = txn;
+  }
+}
+
+// Members of a component in either version, in the order they were sent
+inline std::vector<int> componentTxns(
+    const components::componentsTable::component& component) {
+  std::vector<int> txns;
+  if (component.transactiondelta_size() == 0) {
+    txns.reserve(component.transactionlist_size());
+    for (const auto& txn : component.transactionlist()) {
+      txns.push_back(txn.id());
+    }
+    return txns;
+  }
+  txns.reserve(component.transactiondelta_size());
+  int txn = 0;
+  for (uint32_t delta : component.transactiondelta()) {
+    txn += delta;
+    txns.push_back(txn);
+  }
+  return txns;
+}
@@ -1,36 +1,55 @@
+#include <chrono>
 #include <fstream>
 #include <iostream>
+#include <sstream>
 #include <string>
+#include <vector>
 
+#include "compactEncoding.h"
 #include "components.pb.h"
 
 using namespace std;
 
+// Reads component.bin in either version and reports its size and decode
+// time; small tables are printed too
 void readComponentFromFile(const string& filename) {
   components::componentsTable cTable;
 
   ifstream input(filename, ios::in | ios::binary);
+  stringstream buffer;
+  buffer << input.rdbuf();
+  input.close();
+  string serialized = buffer.str();
+
+  auto start = chrono::steady_clock::now();
   // reading from the input file
-  if (!cTable.ParseFromIstream(&input)) {
+  if (!cTable.ParseFromString(serialized)) {
     cerr << "Failed to read graph from file." << endl;
     return;
   }
+  vector<vector<int>> members;
+  size_t transactions = 0;
+  for (const auto& component : cTable.componentslist()) {
+    members.push_back(componentTxns(component));
+    transactions += members.back().size();
+  }
+  double decodeMs = chrono::duration<double, milli>(
+                        chrono::steady_clock::now() - start)
+                        .count();
 
-  input.close();
   cout << "Number of components: " << cTable.totalcomponents() << std::endl;
+  cout << "Version " << max(cTable.version(), 1) << ", " << transactions
+       << " transactions, " << serialized.size() << " bytes, decoded in "
+       << decodeMs << " ms" << endl;
+  if (transactions > 100) return;
 
   // Iterate over each component
-  for (int i = 0; i < cTable.componentslist_size(); i++) {
-    const components::componentsTable::component& component =
-        cTable.componentslist(i);
-
+  for (size_t i = 0; i < members.size(); i++) {
     cout << "Component " << i + 1 << ": ";
 
     // Iterate over the transaction list within this component
-    for (int j = 0; j < component.transactionlist_size(); j++) {
-      const components::componentsTable::transactionID& txn =
-          component.transactionlist(j);
-      cout << txn.id() << " ";  // Output the transaction ID
+    for (int txn : members[i]) {
+      cout << txn << " ";  // Output the transaction ID
     }
 
     cout << endl;
@@ -1,55 +1,81 @@
+#include <chrono>
 #include <fstream>
 #include <iostream>
+#include <random>
 #include <string>
+#include <vector>
 
+#include "compactEncoding.h"
 #include "components.pb.h"
 
 using namespace std;
 
-void writecomponentToFile(const std::string& filename) {
+// Usage: cWriter [version] [transactions] [components]
+// Writes the sample table, or the given number of transactions spread at
+// random over the given number of components, in version 1
+// (transactionID messages) or 2 (packed gaps, the default), and reports
+// its size and encode time.
+void writecomponentToFile(const std::string& filename, int version,
+                          int transactions, int componentCount) {
   components::componentsTable cTable;
 
-  int sampleComponent[3][3] = {// sample matrix to store
-                               {1, 2, -1},
-                               {3, 4, 5},
-                               {-1, -1, -1}};
+  vector<vector<int>> sampleComponents = {// sample components to store
+                                          {1, 2},
+                                          {3, 4, 5},
+                                          {}};
+  if (transactions > 0) {
+    mt19937 rng(42);
+    uniform_int_distribution<int> pick(0, componentCount - 1);
+    sampleComponents.assign(componentCount, {});
+    for (int txn = 0; txn < transactions; ++txn) {
+      sampleComponents[pick(rng)].push_back(txn);
+    }
+  }
 
-  cTable.set_totalcomponents(3);
+  auto start = chrono::steady_clock::now();
+  bool compact = version >= kCompactProtoVersion;
+  cTable.set_totalcomponents(sampleComponents.size());
+  if (compact) cTable.set_version(kCompactProtoVersion);
 
-  // storing the matrix
-  for (int i = 0; i < 3; ++i) {
+  // storing the components
+  for (size_t i = 0; i < sampleComponents.size(); ++i) {
     // Create a new component message for each component
     auto* component = cTable.add_componentslist();
-
-    for (int j = 0; j < 3; ++j) {
-      if (sampleComponent[i][j] != -1) {  // Skip invalid transaction IDs (-1)
-
-        auto* txn = component->add_transactionlist();
-
-        txn->set_id(sampleComponent[i][j]);
-      }
-    }
+    encodeComponentTxns(sampleComponents[i], component, compact);
+    component->set_compid(i);
   }
+  string serialized;
+  if (!cTable.SerializeToString(&serialized)) {
+    cerr << "Failed to write the table  to file." << endl;
+    return;
+  }
+  double encodeMs = chrono::duration<double, milli>(
+                        chrono::steady_clock::now() - start)
+                        .count();
 
   // Serialize to a binary file
   ofstream output(filename, ios::out | ios::binary);
-  if (!cTable.SerializeToOstream(&output)) {
-    cerr << "Failed to write the table  to file." << endl;
-  } else {
-    cout << "components table is written to " << filename << endl;
-  }
+  output << serialized;
   output.close();
+  cout << "components table is written to " << filename << " (version "
+       << version << ", " << serialized.size() << " bytes, encoded in "
+       << encodeMs << " ms)" << endl;
 }
 
-int main() {
+int main(int argc, char** argv) {
   // Initialize Protocol Buffers
   GOOGLE_PROTOBUF_VERIFY_VERSION;
 
+  int version = argc > 1 ? stoi(argv[1]) : kCompactProtoVersion;
+  int transactions = argc > 2 ? stoi(argv[2]) : 0;
+  int componentCount = argc > 3 ? stoi(argv[3]) : 100;
+
   // Write graph to file
-  writecomponentToFile("component.bin");
+  writecomponentToFile("component.bin", version, transactions,
+                       componentCount);
 
   // Optional:  Delete all global objects allocated by libprotobuf.
   google::protobuf::ShutdownProtobufLibrary();
 
   return 0;
-}
\ No newline at end of file
+}
@@ -1,30 +1,46 @@
+#include <chrono>
 #include <fstream>
 #include <iostream>
+#include <sstream>
 #include <string>
+#include <vector>
 
+#include "compactEncoding.h"
 #include "matrix.pb.h"
 
 using namespace std;
 
+// Reads graph.bin in either version and reports its size and decode time;
+// small graphs are printed too
 void readGraphFromFile(const string& filename) {
   matrix::DirectedGraph DAG;
 
   ifstream input(filename, ios::in | ios::binary);
+  stringstream buffer;
+  buffer << input.rdbuf();
+  input.close();
+  string serialized = buffer.str();
+
+  auto start = chrono::steady_clock::now();
+  vector<vector<int>> adjacencyMatrix;
   // reading from the input file
-  if (!DAG.ParseFromIstream(&input)) {
+  if (!DAG.ParseFromString(serialized) ||
+      !decodeMatrix(DAG, &adjacencyMatrix)) {
     std::cerr << "Failed to read graph from file." << endl;
     return;
   }
-
-  input.close();
+  double decodeMs = chrono::duration<double, milli>(
+                        chrono::steady_clock::now() - start)
+                        .count();
 
   cout << "Number of nodes: " << DAG.num_nodes() << endl;
+  cout << "Version " << max(DAG.version(), 1) << ", " << serialized.size()
+       << " bytes, decoded in " << decodeMs << " ms" << endl;
+  if (adjacencyMatrix.size() > 20) return;
 
-  for (int i = 0; i < DAG.adjacencymatrix_size(); ++i) {
-    const auto& row = DAG.adjacencymatrix(i);
-
-    for (int j = 0; j < row.edges_size(); ++j) {
-      std::cout << row.edges(j) << " ";
+  for (const auto& row : adjacencyMatrix) {
+    for (int edge : row) {
+      std::cout << edge << " ";
     }
     cout << endl;
   }
@@ -1,45 +1,68 @@
+#include <chrono>
 #include <fstream>
 #include <iostream>
+#include <random>
 #include <string>
+#include <vector>
 
+#include "compactEncoding.h"
 #include "matrix.pb.h"
 
 using namespace std;
 
-void writeGraphToFile(const std::string& filename) {
+// Usage: mWriter [version] [nodes] [density]
+// Writes the 3x3 sample, or a random DAG of the given size whose pairs
+// depend on each other with the given probability, in version 1 (dense)
+// or 2 (edge lists, the default), and reports its size and encode time.
+void writeGraphToFile(const std::string& filename, int version, int nodes,
+                      double density) {
   matrix::DirectedGraph DAG;
 
-  int adjacencyMatrix[3][3] = {// sample matrix to store
-                               {0, 1, 0},
-                               {0, 0, 1},
-                               {1, 0, 0}};
-
-  DAG.set_num_nodes(3);
-
-  // storing the matrix
-  for (int i = 0; i < 3; ++i) {
-    auto* row = DAG.add_adjacencymatrix();
-    for (int j = 0; j < 3; ++j) {
-      row->add_edges(adjacencyMatrix[i][j]);
+  vector<vector<int>> adjacencyMatrix = {// sample matrix to store
+                                         {0, 1, 0},
+                                         {0, 0, 1},
+                                         {1, 0, 0}};
+  if (nodes > 0) {
+    mt19937 rng(42);
+    bernoulli_distribution edge(density);
+    adjacencyMatrix.assign(nodes, vector<int>(nodes, 0));
+    for (int i = 0; i < nodes; ++i) {
+      for (int j = i + 1; j < nodes; ++j) {
+        adjacencyMatrix[i][j] = edge(rng);
+      }
     }
   }
 
-  // Serialize to a binary file
-  ofstream output(filename, ios::out | ios::binary);
-  if (!DAG.SerializeToOstream(&output)) {
+  auto start = chrono::steady_clock::now();
+  encodeMatrix(adjacencyMatrix, &DAG, version >= kCompactProtoVersion);
+  string serialized;
+  if (!DAG.SerializeToString(&serialized)) {
     cerr << "Failed to write graph to file." << std::endl;
-  } else {
-    cout << "Graph written to " << filename << std::endl;
+    return;
   }
+  double encodeMs = chrono::duration<double, milli>(
+                        chrono::steady_clock::now() - start)
+                        .count();
+
+  // Serialize to a binary file
+  ofstream output(filename, ios::out | ios::binary);
+  output << serialized;
   output.close();
+  cout << "Graph written to " << filename << " (version " << version << ", "
+       << adjacencyMatrix.size() << " nodes, " << serialized.size()
+       << " bytes, encoded in " << encodeMs << " ms)" << std::endl;
 }
 
-int main() {
+int main(int argc, char** argv) {
   // Initialize Protocol Buffers
   GOOGLE_PROTOBUF_VERIFY_VERSION;
 
+  int version = argc > 1 ? stoi(argv[1]) : kCompactProtoVersion;
+  int nodes = argc > 2 ? stoi(argv[2]) : 0;
+  double density = argc > 3 ? stod(argv[3]) : 0.001;
+
   // Write graph to file
-  writeGraphToFile("graph.bin");
+  writeGraphToFile("graph.bin", version, nodes, density);
 
   // Optional:  Delete all global objects allocated by libprotobuf.
   google::protobuf::ShutdownProtobufLibrary();
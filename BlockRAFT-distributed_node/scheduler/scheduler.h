@@ -1,19 +1,31 @@
+#pragma once
 #include <pthread.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 #include <tbb/concurrent_hash_map.h>
+#include <unistd.h>
 
 #include <atomic>
 #include <cmath>
+#include <condition_variable>
+#include <deque>
 #include <fstream>
 #include <iostream>
+#include <mutex>
 #include <sstream>
 #include <string>
 #include <thread>
 
 #include "../dagModule/DAGmodule.h"
+#include "../dataPlane/blobChannel.h"
+#include "../leader/componentProgress.h"
+#include "../leader/controlTxn.h"
+#include "../leader/prefixWatch.h"
 #include "../smartContracts/eCommerce/eCommProcessor.h"
 #include "../smartContracts/nft/nftProcessor.h"
 #include "../smartContracts/voting/votingProcessor.h"
 #include "../smartContracts/wallet/walletProcessor.h"
+#include "../smartContracts/writeLog.h"
 #include "block.pb.h"
 #include "components.pb.h"
 #include "matrix.pb.h"
@@ -26,13 +38,38 @@ class scheduler {
   GlobalState& state;
   DAGmodule dag;
   unordered_set<int> processed_components;
+  vector<int> assignedTxns;
   int threadCount;
   vector<transaction::Transaction> transactions;
   eCommProcessor eCommPro;
   WalletProcessor walletPro;
   NFTProcessor nftPro;
   VotingProcessor votePro;
-  atomic<int> compCount{0}, flag{true}, completeFlag{false}, updateFlag{false};
+  atomic<int> compCount{0}, flag{true}, completeFlag{false};
+  // Transactions left in each component, and the keys its transactions
+  // wrote, indexed by compID; a component is published when its count hits
+  // zero
+  unique_ptr<atomic<int>[]> componentLeft;
+  vector<vector<string>> componentWrites;
+  mutex componentsMutex;
+  std::string blockPath, termNo;
+  // Dynamic distribution, see componentProgress.h: table indices this
+  // member may still claim, how many claimed components are unfinished,
+  // and the lease its claims are bound to
+  deque<int> claimQueue;
+  mutex claimMutex;
+  atomic<int> activeComponents{0};
+  int64_t claimLease = 0;
+  chrono::steady_clock::time_point nextRescan;
+  // Nice value for the executor threads; the leader raises it so its own
+  // coordination threads stay ahead of the share it executes
+  int workerNice = 0;
+  // Finished components waiting for publishLoop, which publishes them off
+  // the executor threads; executorsDone ends it once the queue is drained
+  deque<int> publishQueue;
+  mutex publishMutex;
+  condition_variable publishReady;
+  bool executorsDone = false;
 
   tbb::concurrent_hash_map<std::string, std::string> myMap;
   // Constructor
@@ -42,6 +79,33 @@ class scheduler {
         walletPro(state, myMap),
         nftPro(state, myMap),
         votePro(state, myMap) {}
+  // Drops the previous block's state, so one scheduler runs block after
+  // block; the processors and the state handle are kept. flag is re-armed
+  // here rather than in scheduleTxns, so a stop requested while the block
+  // is being loaded still holds.
+  void resetBlock() {
+    dag.dagClean();
+    processed_components.clear();
+    assignedTxns.clear();
+    transactions.clear();
+    myMap.clear();
+    componentLeft.reset();
+    componentWrites.clear();
+    {
+      lock_guard<mutex> lock(claimMutex);
+      claimQueue.clear();
+    }
+    activeComponents.store(0);
+    {
+      lock_guard<mutex> lock(publishMutex);
+      publishQueue.clear();
+      executorsDone = false;
+    }
+    nextRescan = {};
+    compCount.store(0);
+    flag.store(true);
+    completeFlag.store(false);
+  }
   int columnSum(int colIndex) {
     int sum = 0;
 
@@ -53,30 +117,55 @@ class scheduler {
 
     return sum;
   }
-  // Serializes and stores shared map state to etcd
-  void dataStore(const std::string& path) {
-    addressList::AddressValueList protoList;
+  // Queues comp for publishLoop; called by the executor that finished it
+  void publishComponent(int comp) {
+    lock_guard<mutex> lock(publishMutex);
+    publishQueue.push_back(comp);
+    publishReady.notify_one();
+  }
 
-    // Build the protobuf message from the map
-    for (const auto& kv : myMap) {
-        addressList::AddressValue* pair = protoList.add_pairs();
-        pair->set_address(kv.first);
-        pair->set_value(kv.second);
-    }
+  // Publishes finished components as done, with their write sets, under
+  // their done keys, so the leader can count them and a later owner can
+  // skip them. The write set is what the processors logged, see
+  // writeLog.h; it goes to the data plane and etcd gets its BlobRef. The
+  // components queued meanwhile are published in one transaction, retried
+  // until it lands unless a later term owns the block or the leader has
+  // finished it already.
+  void publishLoop() {
+    while (true) {
+      vector<int> comps;
+      {
+        unique_lock<mutex> lock(publishMutex);
+        publishReady.wait(lock, [this]() {
+          return !publishQueue.empty() || executorsDone;
+        });
+        if (publishQueue.empty()) return;
+        comps.assign(publishQueue.begin(), publishQueue.end());
+        publishQueue.clear();
+      }
 
-    // Serialize to string
-    std::string serializedData;
-    if (!protoList.SerializeToString(&serializedData)) {
-        std::cerr << "Failed to serialize AddressValueList!" << std::endl;
-        return;
+      ControlTxn done(termNo, "components");
+      for (int comp : comps) {
+        vector<string> keys;
+        {
+          lock_guard<mutex> lock(componentsMutex);
+          keys = componentWrites[comp];
+        }
+        std::string serializedData;
+        if (!writeSetOf(keys, myMap).SerializeToString(&serializedData)) {
+          std::cerr << "Failed to serialize AddressValueList!" << std::endl;
+          continue;
+        }
+        done.putBlob(componentDoneKey(blockPath, comp),
+                     std::move(serializedData));
+      }
+      while (!done.commit() && !done.superseded() && flag.load() &&
+             !completeFlag.load()) {
+        this_thread::sleep_for(chrono::milliseconds(10));
+      }
     }
+  }
 
-    std::cout << "Path of store DATA is " << path << std::endl;
-    std::cout << "Size of serialized proto DATA is " << serializedData.size() << std::endl;
-
-    // Store in etcd (binary-safe)
-    etcdClient.put(path + "/" + node_id, serializedData).get();
-}
   // Parses and loads DAG matrix from serialized protobuf input
   void extractDAG(string matrixData) {
     // Deserialize the Protobuf message
@@ -92,34 +181,63 @@ class scheduler {
     for (size_t i = 0; i < dag.totalTxns; ++i) {
       dag.inDegree[i].store(-1, std::memory_order_relaxed);
     }
-    dag.adjacencyMatrix.resize(
-        dag.totalTxns,
-        vector<int>(dag.totalTxns,
-                    0));  // resizing the matrix based on the transaction count
-    for (int i = 0; i < graph.adjacencymatrix_size(); ++i) {
-      if (i >= dag.adjacencyMatrix.size()) {
-        cerr << "Row index out of bounds: " << i << endl;
-        continue;
-      }
-      const matrix::DirectedGraph::MatrixRow& row = graph.adjacencymatrix(i);
-      for (int j = 0; j < row.edges_size(); ++j) {
-        if (j >= dag.adjacencyMatrix[i].size()) {
-          cerr << "Column index out of bounds: row " << i << ", col " << j
-               << endl;
-          continue;
-        }
-        dag.adjacencyMatrix[i][j] = row.edges(j);
-      }
-    }
+    // Either wire version; out of bounds entries are reported and skipped
+    decodeMatrix(graph, &dag.adjacencyMatrix);
   }
   // Updates in-degree of transactions from a component
   void ProcessIndegree(const components::componentsTable::component component) {
     int col = 0, sum = 0, comp = component.compid();
-    for (int j = 0; j < component.transactionlist_size(); ++j) {
-      col = component.transactionlist(j).id();
-      sum = columnSum(col);
+    // Successors are registered before any in-degree is published, so a
+    // transaction cannot complete unseen by its successors
+    vector<int> inDegrees;
+    if (dag.cTable.edgelists()) inDegrees = dag.loadComponent(component);
+    vector<int> txns = componentTxns(component);
+    componentLeft[comp].store(txns.size());
+    activeComponents.fetch_add(1);
+    for (int j = 0; j < (int)txns.size(); ++j) {
+      col = txns[j];
+      sum = dag.cTable.edgelists() ? inDegrees[j] : columnSum(col);
+      dag.CurrentTransactions[col].compID = comp;
       dag.inDegree[col].store(sum, std::memory_order_relaxed);
       dag.completedTxns--;
+      assignedTxns.push_back(col);
+    }
+  }
+
+  // Loads the declared inputs of the assigned transactions into myMap with
+  // batched MultiGet calls, so processors rarely block on RocksDB. Only
+  // addresses that exist in state are cached; misses keep the lazy path so
+  // each processor still applies its own default for a new address.
+  void prefetchReadSet(int thCount) {
+    unordered_set<string> seen;
+    vector<string> addresses;
+    for (int txnId : assignedTxns) {
+      for (const auto& input : dag.CurrentTransactions[txnId].inputs) {
+        if (seen.insert(input).second) addresses.push_back(input);
+      }
+    }
+    if (addresses.empty()) return;
+
+    int workers = max(1, min(thCount, (int)addresses.size()));
+    size_t chunkSize = (addresses.size() + workers - 1) / workers;
+    vector<thread> threads;
+    for (int i = 0; i < workers; i++) {
+      size_t start = i * chunkSize;
+      size_t end = min(start + chunkSize, addresses.size());
+      if (start >= end) break;
+      threads.emplace_back([this, start, end, &addresses]() {
+        vector<string> chunk(addresses.begin() + start,
+                             addresses.begin() + end);
+        vector<string> values = state.multiGetValues(chunk);
+        for (size_t j = 0; j < chunk.size(); ++j) {
+          if (values[j].empty()) continue;
+          tbb::concurrent_hash_map<std::string, std::string>::accessor acc;
+          if (myMap.insert(acc, chunk[j])) acc->second = values[j];
+        }
+      });
+    }
+    for (auto& t : threads) {
+      t.join();
     }
   }
 
@@ -131,6 +249,14 @@ class scheduler {
     }
     return false;
   }
+  // Sizes the per-component bookkeeping for the first table of the block
+  void trackComponents() {
+    if (componentLeft) return;
+    int count = dag.cTable.componentslist_size();
+    componentLeft = unique_ptr<atomic<int>[]>(new atomic<int>[count]);
+    for (int i = 0; i < count; ++i) componentLeft[i].store(0);
+    componentWrites.assign(count, {});
+  }
   // Deserialize and process relevant components assigned to this node
   void ExtractComponents(const std::string& serialized_data, int node_id) {
     // Parse the serialized data
@@ -138,6 +264,12 @@ class scheduler {
       std::cerr << "Failed to parse componentsTable data." << std::endl;
       return;
     }
+    if (!dag.cTable.edgelists()) dag.buildMatrix();
+    trackComponents();
+    if (defaultDistribution() == "dynamic") {
+      queueComponents(node_id);
+      return;
+    }
     for (int i = 0; i < dag.cTable.componentslist_size(); ++i) {
       const auto& component = dag.cTable.componentslist(i);
       if (node_id == component.assignedfollower() &&
@@ -145,23 +277,86 @@ class scheduler {
         ProcessIndegree(component);
       }
     }
-    updateFlag.store(true);
   }
 
-  void ExtractNewComponents(const std::string& serialized_data, int node_id) {
+  // Queues the table for claiming: this member's components in order, then
+  // everyone else's from the back, so stealing starts at their tails
+  void queueComponents(int node_id) {
+    lock_guard<mutex> lock(claimMutex);
+    claimQueue.clear();
+    int count = dag.cTable.componentslist_size();
+    for (int i = 0; i < count; ++i) {
+      if (dag.cTable.componentslist(i).assignedfollower() == node_id) {
+        claimQueue.push_back(i);
+      }
+    }
+    for (int i = count - 1; i >= 0; --i) {
+      if (dag.cTable.componentslist(i).assignedfollower() != node_id) {
+        claimQueue.push_back(i);
+      }
+    }
+  }
+
+  // Claims more components once this member runs out of ready work, up to
+  // one unfinished component per thread. One thread claims at a time while
+  // the others keep executing. When the queue is drained, it is refilled
+  // from etcd now and then, to pick up the claims of crashed members.
+  void claimWork() {
+    if (activeComponents.load() >= threadCount) return;
+    unique_lock<mutex> lock(claimMutex, try_to_lock);
+    if (!lock.owns_lock()) return;
+    if (claimQueue.empty()) {
+      auto now = chrono::steady_clock::now();
+      if (now < nextRescan) return;
+      nextRescan = now + chrono::milliseconds(100);
+      for (int comp : unclaimedComponents(blockPath,
+                                          dag.cTable.componentslist_size())) {
+        claimQueue.push_back(comp);
+      }
+    }
+    int want = min(defaultClaimBatch(), threadCount - activeComponents.load());
+    vector<int> batch;
+    while (!claimQueue.empty() && (int)batch.size() < want) {
+      batch.push_back(claimQueue.front());
+      claimQueue.pop_front();
+    }
+    if (batch.empty()) return;
+    vector<int> claimed;
+    if (claimComponents(blockPath, batch, node_id, termNo, claimLease)) {
+      claimed = batch;
+    } else {
+      // Somebody holds one of them; claim the rest one by one
+      for (int comp : batch) {
+        if (claimComponents(blockPath, {comp}, node_id, termNo,
+                            claimLease)) {
+          claimed.push_back(comp);
+        }
+      }
+    }
+    for (int comp : claimed) {
+      const auto& component = dag.cTable.componentslist(comp);
+      if (CheckForNewComponents(component)) ProcessIndegree(component);
+    }
+  }
+
+  // Takes over reassigned components; those in finished were published by
+  // their previous owner already and are not executed again
+  void ExtractNewComponents(const std::string& serialized_data, int node_id,
+                            const unordered_set<int>& finished = {}) {
     // Parse the serialized data
-    bool etcdReset = false;
     if (!dag.cTable.ParseFromString(serialized_data)) {
       std::cerr << "Failed to parse componentsTable data." << std::endl;
       return;
     }
+    if (!dag.cTable.edgelists()) dag.buildMatrix();
+    trackComponents();
     // Iterate through the list of components
     for (int i = 0; i < dag.cTable.componentslist_size(); ++i) {
       const auto& component = dag.cTable.componentslist(i);
       if (node_id == component.assignedfollower() &&
-          CheckForNewComponents(component)) {
+          CheckForNewComponents(component) &&
+          !finished.count(component.compid())) {
         ProcessIndegree(component);
-        updateFlag.store(true);
       }
     }
   }
@@ -170,24 +365,13 @@ class scheduler {
                    const std::string& term_no, int block_num) {
     std::string path = leader_id + "/" + term_no + "/" +
                        std::to_string(block_num) + "/addresses";
+    if (workerNice > 0) {
+      setpriority(PRIO_PROCESS, syscall(SYS_gettid), workerNice);
+    }
 
     while ((!completeFlag.load()) && flag.load()) {
-      if (dag.completedTxns == dag.totalTxns && updateFlag) {
-        dataStore(leader_id + "/" + term_no + "/" + std::to_string(block_num) +
-                  "/data");
-        std::string comp_key = leader_id + "/" + term_no + "/" +
-                               std::to_string(block_num) +
-                               "/components/status" + "/" + node_id;
-        auto put_response =
-            etcdClient.put(comp_key, std::to_string(compCount)).get();
-        if (put_response.is_ok()) {
-          updateFlag.store(false);
-        } else {
-          std::cerr << "Failed to store component in etcd: "
-                    << put_response.error_message() << std::endl;
-        }
-      }
       int txnId = dag.selectTxn();
+      if (txnId == -1 && defaultDistribution() == "dynamic") claimWork();
       if (txnId != -1) {
         transaction::Transaction txn =
             transactions[txnId];  // Directly use txnId to get the transaction
@@ -198,24 +382,60 @@ class scheduler {
           continue;
         }
 
-        if (header.family_name() == "wallet") {
-          flag.store(walletPro.ProcessTxn(txn));  // Call wallet processing
-        } else if (header.family_name() == "eComm") {
-          flag.store(
-              eCommPro.ProcessTxn(txn, path));  // Call eCommerce processing
-        } else if (header.family_name() == "nft") {
-          flag.store(nftPro.ProcessTxn(txn));  // Call eCommerce processing
-        } else if (header.family_name() == "voting") {
-          flag.store(votePro.ProcessTxn(txn));  // Call eCommerce processing
-        } else {
-          flag.store(false);  // Use store for atomic flag assignment
-        }
+        vector<string> writes;
+        currentWriteLog() = &writes;
+        flag.store(processTxn(txn, header, path));
+        currentWriteLog() = nullptr;
 
+        int comp = dag.CurrentTransactions[txnId].compID;
+        {
+          lock_guard<mutex> lock(componentsMutex);
+          componentWrites[comp].insert(componentWrites[comp].end(),
+                                       writes.begin(), writes.end());
+        }
         dag.complete(txnId);
         compCount.fetch_add(1, std::memory_order_relaxed);
+        if (componentLeft[comp].fetch_sub(1) == 1) {
+          publishComponent(comp);
+          activeComponents.fetch_sub(1);
+        }
+      }
+    }
+  }
+
+  // Runs one transaction through its contract's processor
+  bool processTxn(const transaction::Transaction& txn,
+                  const transaction::TransactionHeader& header,
+                  const std::string& path) {
+    if (header.family_name() == "wallet") {
+      return walletPro.ProcessTxn(txn);
+    } else if (header.family_name() == "eComm") {
+      return eCommPro.ProcessTxn(txn, path);
+    } else if (header.family_name() == "nft") {
+      return nftPro.ProcessTxn(txn);
+    } else if (header.family_name() == "voting") {
+      return votePro.ProcessTxn(txn);
+    }
+    return false;
+  }
+
+  // Re-executes a stored block locally, in block order and without etcd,
+  // and returns its write set. Used to replay the blocks after a snapshot.
+  bool replayBlock(const Block& block,
+                   std::vector<std::pair<std::string, std::string>>& writes) {
+    myMap.clear();
+    for (const auto& txn : block.transactions()) {
+      transaction::TransactionHeader header;
+      if (!header.ParseFromString(txn.header()) ||
+          !processTxn(txn, header, "")) {
+        return false;
       }
     }
+    writes.assign(myMap.begin(), myMap.end());
+    myMap.clear();
+    return true;
   }
+
   void extractBlock(const string& blockData) {
     Block block;
 
@@ -230,40 +450,36 @@ class scheduler {
     dag.createfollower(block, threadCount);
   }
 
-  // this thread monitors the status from the leader
+  // this thread waits for the leader to mark the block finished, on a
+  // watch of the run key, or for execution to be stopped
   void monitorFunc(const std::string& leader_id, const std::string& term_no,
                    int block_num) {
     std::string run_key =
         leader_id + "/" + term_no + "/" + std::to_string(block_num) + "/run";
-    while (flag.load()) {
-      try {
-        etcd::Response response = etcdClient.get(run_key).get();
-        if (!response.is_ok()) {
-          std::cerr << "Failed to get run status: " << response.error_message()
-                    << std::endl;
-        }
-
-        std::string status = response.value().as_string();
-
-        if (status == "finish") {
-          completeFlag.store(true);
-          cout << "leader said finish" << endl;
-          return;
-        }
-        // std::this_thread::sleep_for(std::chrono::milliseconds(10));
-
-      } catch (const std::exception& e) {
-        std::cerr << "Exception while polling run key: " << e.what()
-                  << std::endl;
+    try {
+      PrefixWatch run(run_key);
+      bool finished = run.waitUntil(
+          [&run_key](const PrefixWatch::Values& values) {
+            auto it = values.find(run_key);
+            return it != values.end() && it->second == "finish";
+          },
+          [this]() { return !flag.load(); });
+      if (finished) {
+        completeFlag.store(true);
+        cout << "leader said finish" << endl;
       }
+    } catch (const std::exception& e) {
+      std::cerr << "Exception while watching run key: " << e.what()
+                << std::endl;
     }
   }
 
   bool scheduleTxns(const std::string& leader_id, const std::string& term_no,
                     int block_num, int thCount) {
     threadCount = thCount;
+    blockPath = leader_id + "/" + term_no + "/" + std::to_string(block_num);
+    termNo = term_no;
     thread threads[threadCount], runMonitor;
-    flag.store(true);
     completeFlag.store(false);
     cout << "Transactions to execute is " << dag.totalTxns - dag.completedTxns
          << endl;
@@ -271,12 +487,19 @@ class scheduler {
       threads[i] = thread(&scheduler::executeTxns, this, i, leader_id, term_no,
                           block_num);
     }
+    thread publisher(&scheduler::publishLoop, this);
     runMonitor =
         thread(&scheduler::monitorFunc, this, leader_id, term_no, block_num);
     runMonitor.join();
     for (int i = 0; i < threadCount; i++) {
       threads[i].join();  // Wait for all threads to finish
     }
+    {
+      lock_guard<mutex> lock(publishMutex);
+      executorsDone = true;
+    }
+    publishReady.notify_one();
+    publisher.join();
     return flag.load();
   }
 };
@@ -283,3 +283,22 @@ TEST(SchedulerTest, ColumnSumTest) {
   EXPECT_EQ(sched.columnSum(1), 1);
   EXPECT_EQ(sched.columnSum(2), 2);
 }
+TEST(SchedulerTest, PrefetchReadSet) {
+  scheduler sched(state);
+  state.insert("walletPrefetch", "250");
+
+  TransactionStruct txn;
+  txn.txn_no = 0;
+  txn.inputscount = 2;
+  txn.inputs = {"walletPrefetch", "walletMissing"};
+  sched.dag.CurrentTransactions.push_back(txn);
+  sched.assignedTxns.push_back(0);
+
+  sched.prefetchReadSet(2);
+
+  tbb::concurrent_hash_map<std::string, std::string>::const_accessor acc;
+  ASSERT_TRUE(sched.myMap.find(acc, "walletPrefetch"));
+  EXPECT_EQ(acc->second, "250");
+  acc.release();
+  EXPECT_FALSE(sched.myMap.find(acc, "walletMissing"));
+}
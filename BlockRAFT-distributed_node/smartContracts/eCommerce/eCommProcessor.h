@@ -13,6 +13,7 @@
 using json = nlohmann::json;
 #include "../../merkleTree/globalState.h"
 #include "../leader/etcdGlobals.h"
+#include "../writeLog.h"
 #include "transaction.pb.h"
 
 using namespace std;
@@ -32,6 +33,7 @@ class eCommProcessor {
     tbb::concurrent_hash_map<std::string, std::string>::accessor insertAcc;
     myMap.insert(insertAcc, key);
     insertAcc->second = value;
+    recordWrite(key);
     return value;
   }
 
@@ -39,6 +41,7 @@ class eCommProcessor {
     tbb::concurrent_hash_map<std::string, std::string>::accessor acc;
     myMap.insert(acc, key);
     acc->second = value;
+    recordWrite(key);
   }
 
  public:
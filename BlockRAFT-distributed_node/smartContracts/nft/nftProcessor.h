@@ -8,6 +8,7 @@
 #include <string>
 
 #include "../../merkleTree/globalState.h"
+#include "../writeLog.h"
 #include "sha512.h"
 #include "transaction.pb.h"
 
@@ -49,6 +50,7 @@ class NFTProcessor {
 
     nftMap.insert(acc, owner);
     acc->second = nftList.dump();
+    recordWrite(owner);
     return nftList;
   }
 
@@ -69,6 +71,7 @@ class NFTProcessor {
     }
 
     acc->second = imageList.dump();
+    recordWrite(owner);
     return true;
   }
 
@@ -92,6 +95,7 @@ class NFTProcessor {
     // Remove hash from old owner's list
     oldOwnerList.erase(pos);
     oldAcc->second = oldOwnerList.dump();
+    recordWrite(oldOwner);
 
     // Add hash to new owner's list
     tbb::concurrent_hash_map<std::string, std::string>::accessor newAcc;
@@ -99,6 +103,7 @@ class NFTProcessor {
 
     newOwnerList.push_back(hash);
     newAcc->second = newOwnerList.dump();
+    recordWrite(newOwner);
 
     return true;
   }
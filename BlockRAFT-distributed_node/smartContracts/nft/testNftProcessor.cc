@@ -191,6 +191,39 @@ TEST(NFTProcessorTest, TransferNFTTime) {
   removeTestFile(testImagePath);
 }
 
+// The client declares "nft" + owner, but the processor writes the owner key;
+// the published write set has to carry what was written
+TEST(NFTProcessorTest, WriteSetReachesCommittedState) {
+  tbb::concurrent_hash_map<std::string, std::string> nftMap;
+  NFTProcessor processor(state, nftMap);
+
+  std::string testImagePath = writeTestImage("testdata/write_set_image.png");
+  std::string hash = processor.computeImageHash(testImagePath);
+
+  std::vector<std::string> writes;
+  currentWriteLog() = &writes;
+  EXPECT_TRUE(processor.ProcessTxn(
+      buildTransaction("nft_create", testImagePath, "writeSetOwner")));
+  currentWriteLog() = nullptr;
+
+  // Commit the write set the way the leader and followers apply it
+  addressList::AddressValueList writeSet = writeSetOf(writes, nftMap);
+  ASSERT_EQ(writeSet.pairs_size(), 1);
+  EXPECT_EQ(writeSet.pairs(0).address(), "writeSetOwner");
+  std::string keys;
+  for (const auto& pair : writeSet.pairs()) {
+    state.insert(pair.address(), pair.value());
+    keys += pair.address() + " ";
+  }
+  state.updateTree(keys);
+
+  json committed = json::parse(state.getValue("writeSetOwner"));
+  EXPECT_NE(std::find(committed.begin(), committed.end(), hash),
+            committed.end());
+
+  removeTestFile(testImagePath);
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -7,6 +7,7 @@
 
 #include "../../merkleTree/globalState.h"
 #include "../leader/etcdGlobals.h"
+#include "../writeLog.h"
 #include "transaction.pb.h"
 
 using json = nlohmann::json;
@@ -34,6 +35,7 @@ class VotingProcessor {
     tbb::concurrent_hash_map<std::string, std::string>::accessor insertAcc;
     myMap.insert(insertAcc, name);
     insertAcc->second = std::to_string(votes);
+    recordWrite(name);
     return votes;
   }
 
@@ -41,6 +43,7 @@ class VotingProcessor {
     tbb::concurrent_hash_map<std::string, std::string>::accessor acc;
     if (myMap.insert(acc, name)) {
       acc->second = "10000";  // One vote token by default
+      recordWrite(name);
       return true;
     }
     return false;
@@ -50,6 +53,7 @@ class VotingProcessor {
     tbb::concurrent_hash_map<std::string, std::string>::accessor acc;
     if (myMap.insert(acc, name)) {
       acc->second = "0";  // Zero votes initially
+      recordWrite(name);
       return true;
     }
     return false;
@@ -66,11 +70,13 @@ class VotingProcessor {
         tbb::concurrent_hash_map<std::string, std::string>::accessor acc;
         myMap.insert(acc, from);
         acc->second = std::to_string(fromVotes - amount);
+        recordWrite(from);
       }
       {
         tbb::concurrent_hash_map<std::string, std::string>::accessor acc;
         myMap.insert(acc, to);
         acc->second = std::to_string(toVotes + amount);
+        recordWrite(to);
       }
       return true;
     }
@@ -87,11 +93,13 @@ class VotingProcessor {
         tbb::concurrent_hash_map<std::string, std::string>::accessor acc;
         myMap.insert(acc, voter);
         acc->second = std::to_string(voterVotes - 1);
+        recordWrite(voter);
       }
       {
         tbb::concurrent_hash_map<std::string, std::string>::accessor acc;
         myMap.insert(acc, candidate);
         acc->second = std::to_string(candidateVotes + 1);
+        recordWrite(candidate);
       }
       return true;
     }
@@ -1,5 +1,8 @@
 #include <gtest/gtest.h>
 
+#include <fstream>
+
+#include "../../merkleTree/bulkLoadInput.h"
 #include "walletClient.h"
 #include "walletProcessor.h"
 tbb::concurrent_hash_map<std::string, std::string> myMap;
@@ -66,6 +69,31 @@ TEST_F(WalletProcessorTest, TransferInsufficientFundsTest) {
                                std::to_string(transferAmt)));
 }
 
+// Test that balances bulk loaded from a setup file are the ones the wallet
+// reads
+TEST(WalletSetupTest, BulkLoadedSetupBalances) {
+  {
+    std::ofstream setup("walletSetupFile.txt");
+    setup << "./walletClientMain deposit a1 pass 36000\n"
+          << "./walletClientMain deposit a2 pass 500\n"
+          << "./walletClientMain deposit a1 pass 100\n";
+  }
+  BulkLoader loader("walletSetupState_work");
+  ASSERT_TRUE(readSetupFile("walletSetupFile.txt", loader));
+  {
+    RocksDBBackend backend("walletSetupState", true);
+    ASSERT_TRUE(loader.loadInto(backend));
+  }
+
+  GlobalState state("walletSetupState");
+  tbb::concurrent_hash_map<std::string, std::string> setupMap;
+  WalletProcessor setupWallet(state, setupMap);
+  EXPECT_EQ(setupWallet.getBalance("walleta1pass"), "36100");
+  EXPECT_EQ(setupWallet.getBalance("walleta2pass"), "500");
+  EXPECT_EQ(setupWallet.getOrLoadBalance("walleta2pass"), 500);
+  std::remove("walletSetupFile.txt");
+}
+
 // Main function to run all tests
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
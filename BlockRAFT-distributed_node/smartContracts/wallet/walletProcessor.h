@@ -11,6 +11,7 @@
 #include <vector>
 using json = nlohmann::json;
 #include "../../merkleTree/globalState.h"
+#include "../writeLog.h"
 #include "transaction.pb.h"
 
 using namespace std;
@@ -40,6 +41,7 @@ class WalletProcessor {
     // Insert the balance into the map if not found
     if (myMap.insert(acc, name)) {
       acc->second = std::to_string(balance);
+      recordWrite(name);
     }
 
     return balance;
@@ -53,6 +55,7 @@ class WalletProcessor {
     tbb::concurrent_hash_map<std::string, std::string>::accessor acc;
     if (myMap.insert(acc, name) || myMap.find(acc, name)) {
       acc->second = std::to_string(newBalance);
+      recordWrite(name);
     }
 
     return true;
@@ -78,6 +81,7 @@ class WalletProcessor {
         myMap.insert(acc, name);
         acc->second = std::to_string(newBalance);
       }
+      recordWrite(name);
       return true;
     }
 
@@ -99,11 +103,13 @@ class WalletProcessor {
         tbb::concurrent_hash_map<std::string, std::string>::accessor acc;
         myMap.insert(acc, name1);
         acc->second = std::to_string(newBalance1);
+        recordWrite(name1);
       }
       {
         tbb::concurrent_hash_map<std::string, std::string>::accessor acc;
         myMap.insert(acc, name2);
         acc->second = std::to_string(newBalance2);
+        recordWrite(name2);
       }
 
       return true;
@@ -0,0 +1,38 @@
+#pragma once
+#include <tbb/concurrent_hash_map.h>
+
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "addressList.pb.h"
+
+// Keys the transaction running on this thread put into the execution map.
+// The scheduler points the log at a buffer around each transaction and
+// publishes the logged keys as the component's write set, so processors
+// record every key they assign, including the values they cache from
+// state. Keys need not match the transaction's declared addresses.
+inline std::vector<std::string>*& currentWriteLog() {
+  thread_local std::vector<std::string>* log = nullptr;
+  return log;
+}
+
+inline void recordWrite(const std::string& key) {
+  if (std::vector<std::string>* log = currentWriteLog()) log->push_back(key);
+}
+
+// The logged keys, each once, with their current values in map
+inline addressList::AddressValueList writeSetOf(
+    const std::vector<std::string>& keys,
+    tbb::concurrent_hash_map<std::string, std::string>& map) {
+  addressList::AddressValueList writeSet;
+  std::unordered_set<std::string> seen;
+  for (const auto& key : keys) {
+    tbb::concurrent_hash_map<std::string, std::string>::const_accessor acc;
+    if (!seen.insert(key).second || !map.find(acc, key)) continue;
+    addressList::AddressValue* pair = writeSet.add_pairs();
+    pair->set_address(key);
+    pair->set_value(acc->second);
+  }
+  return writeSet;
+}
@@ -0,0 +1,147 @@
+#pragma once
+#include <boost/asio.hpp>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "../merkleTree/snapshots.h"
+#include "stateSync.h"
+
+using namespace std;
+using boost::asio::ip::tcp;
+
+// Streams a whole snapshot directory from a peer, for a new member or a
+// node too far behind for hash-diff sync. Uses the same frames as
+// stateSync.h. The client asks for a block ("" for the newest snapshot);
+// the server answers with the manifest ("" if it has no such snapshot),
+// then every file of the checkpoint as a path frame followed by data
+// frames and an empty frame, and ends with an empty path. Snapshots of the
+// RocksDB backend only; the memory backend keeps none on disk.
+class SnapshotServer {
+ private:
+  SnapshotStore snapshots;
+  boost::asio::io_context io;
+  tcp::acceptor acceptor;
+
+  static const size_t kChunk = 1 << 20;
+
+  void accept() {
+    acceptor.async_accept([this](boost::system::error_code ec,
+                                 tcp::socket socket) {
+      if (!ec) serve(socket);
+      if (acceptor.is_open()) accept();
+    });
+  }
+
+  void serve(tcp::socket& socket) {
+    try {
+      string requested = readFrame(socket);
+      SnapshotManifest manifest;
+      bool found = requested.empty()
+                       ? snapshots.latest(&manifest)
+                       : snapshots.read(stoi(requested), &manifest);
+      if (!found) {
+        writeFrame(socket, "");
+        return;
+      }
+      writeFrame(socket, manifest.serialize());
+
+      string root = snapshots.statePath(manifest.block);
+      vector<char> buffer(kChunk);
+      for (const auto& entry :
+           filesystem::recursive_directory_iterator(root)) {
+        if (!entry.is_regular_file()) continue;
+        ifstream in(entry.path(), ios::binary);
+        if (!in) throw runtime_error("Cannot read " + entry.path().string());
+        writeFrame(socket,
+                   filesystem::relative(entry.path(), root).string());
+        while (in.read(buffer.data(), buffer.size()) || in.gcount() > 0) {
+          writeFrame(socket, string(buffer.data(), in.gcount()));
+        }
+        writeFrame(socket, "");
+      }
+      writeFrame(socket, "");
+    } catch (const exception& e) {
+      cerr << "Snapshot transfer ended: " << e.what() << endl;
+    }
+  }
+
+ public:
+  SnapshotServer(const string& dir, unsigned short port)
+      : snapshots(dir), acceptor(io, tcp::endpoint(tcp::v4(), port)) {}
+
+  unsigned short port() const { return acceptor.local_endpoint().port(); }
+
+  // Serves clients one at a time until stop() is called
+  void run() {
+    accept();
+    io.run();
+  }
+
+  void stop() {
+    boost::asio::post(io, [this]() { acceptor.close(); });
+    io.stop();
+  }
+};
+
+class SnapshotClient {
+ private:
+  SnapshotStore snapshots;
+
+ public:
+  size_t filesFetched = 0;
+  size_t bytesFetched = 0;
+
+  explicit SnapshotClient(const string& dir) : snapshots(dir) {}
+
+  // Fetches the peer's snapshot of `block` (-1: its newest) into the local
+  // snapshot directory. The local manifest is only written once every file
+  // arrived and the state's recomputed root matched, so a failed transfer
+  // leaves no usable snapshot behind. Returns the block fetched, -1 on failure.
+  int fetch(const string& host, unsigned short port, int block = -1) {
+    filesFetched = bytesFetched = 0;
+    boost::asio::io_context io;
+    tcp::socket socket(io);
+    SnapshotManifest manifest;
+    try {
+      tcp::resolver resolver(io);
+      boost::asio::connect(socket, resolver.resolve(host, to_string(port)));
+      writeFrame(socket, block < 0 ? "" : to_string(block));
+      if (!manifest.parse(readFrame(socket))) return -1;
+
+      filesystem::remove_all(snapshots.snapshotPath(manifest.block));
+      string root = snapshots.statePath(manifest.block);
+      while (true) {
+        string relative = readFrame(socket);
+        if (relative.empty()) break;
+        if (relative.find("..") != string::npos || relative[0] == '/') {
+          throw runtime_error("Unexpected path " + relative);
+        }
+        filesystem::path target = filesystem::path(root) / relative;
+        filesystem::create_directories(target.parent_path());
+        ofstream out(target, ios::binary);
+        for (string chunk; !(chunk = readFrame(socket)).empty();) {
+          out.write(chunk.data(), chunk.size());
+          bytesFetched += chunk.size();
+        }
+        if (!out) throw runtime_error("Cannot write " + target.string());
+        ++filesFetched;
+      }
+    } catch (const exception& e) {
+      cerr << "Snapshot fetch failed: " << e.what() << endl;
+      if (manifest.block >= 0) {
+        filesystem::remove_all(snapshots.snapshotPath(manifest.block));
+      }
+      return -1;
+    }
+
+    if (!snapshots.verify(manifest) || !snapshots.writeManifest(manifest)) {
+      cerr << "Fetched snapshot of block " << manifest.block
+           << " does not match its manifest" << endl;
+      filesystem::remove_all(snapshots.snapshotPath(manifest.block));
+      return -1;
+    }
+    return manifest.block;
+  }
+};
@@ -0,0 +1,305 @@
+#pragma once
+#include <poll.h>
+
+#include <algorithm>
+#include <boost/asio.hpp>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../merkleTree/globalState.h"
+#include "addressList.pb.h"
+
+using namespace std;
+using boost::asio::ip::tcp;
+
+// Hash-diff state sync between two GlobalState instances. The client walks
+// the trie top-down, asking the server for a frontier of nodes per round
+// trip. Subtrees whose hashes already match are skipped, so the transfer is
+// proportional to how far the local state has diverged. Requests and
+// replies are AddressValueLists framed by a 4-byte big-endian length; an
+// empty request ends the session. Each leaf in a reply is followed by its
+// "leafAddr:<key hash>" entry when the server knows its address, so the
+// client can index the leaves it copies.
+
+// Largest frame readFrame accepts, so a bad length cannot exhaust memory
+const uint32_t kMaxFrameSize = 64 << 20;
+
+// How long either side of a sync waits for the other's next frame
+const chrono::milliseconds kSyncReadTimeout = chrono::seconds(10);
+
+// Fills buffer from socket, failing once deadline passes first. A zero
+// deadline waits indefinitely.
+inline void readFully(tcp::socket& socket, char* buffer, size_t size,
+                      chrono::steady_clock::time_point deadline) {
+  using Clock = chrono::steady_clock;
+  size_t done = 0;
+  while (done < size) {
+    if (deadline != Clock::time_point()) {
+      auto left = chrono::duration_cast<chrono::milliseconds>(
+                      deadline - Clock::now())
+                      .count();
+      pollfd ready = {socket.native_handle(), POLLIN, 0};
+      int polled = left > 0 ? ::poll(&ready, 1, static_cast<int>(left)) : 0;
+      if (polled < 0 && errno == EINTR) continue;
+      if (polled <= 0) throw runtime_error("Timed out waiting for a frame");
+    }
+    done += socket.read_some(boost::asio::buffer(buffer + done, size - done));
+  }
+}
+
+inline void writeFrame(tcp::socket& socket, const string& payload) {
+  uint32_t size = static_cast<uint32_t>(payload.size());
+  unsigned char header[4] = {
+      static_cast<unsigned char>(size >> 24),
+      static_cast<unsigned char>(size >> 16),
+      static_cast<unsigned char>(size >> 8), static_cast<unsigned char>(size)};
+  boost::asio::write(socket, boost::asio::buffer(header, 4));
+  boost::asio::write(socket, boost::asio::buffer(payload));
+}
+
+// Reads one frame; a nonzero timeout bounds the wait for the whole frame
+inline string readFrame(tcp::socket& socket,
+                        chrono::milliseconds timeout = {}) {
+  chrono::steady_clock::time_point deadline;
+  if (timeout.count() > 0) deadline = chrono::steady_clock::now() + timeout;
+  unsigned char header[4];
+  readFully(socket, reinterpret_cast<char*>(header), 4, deadline);
+  uint32_t size = (uint32_t(header[0]) << 24) | (uint32_t(header[1]) << 16) |
+                  (uint32_t(header[2]) << 8) | uint32_t(header[3]);
+  if (size > kMaxFrameSize) {
+    throw runtime_error("Frame of " + to_string(size) + " bytes exceeds limit");
+  }
+  string payload(size, '\0');
+  if (size > 0) readFully(socket, &payload[0], size, deadline);
+  return payload;
+}
+
+class StateSyncServer {
+ private:
+  GlobalState& state;
+  boost::asio::io_context io;
+  tcp::acceptor acceptor;
+  chrono::milliseconds timeout;  // a silent client is dropped after it
+
+  void accept() {
+    acceptor.async_accept([this](boost::system::error_code ec,
+                                 tcp::socket socket) {
+      if (!ec) serve(socket);
+      if (acceptor.is_open()) accept();
+    });
+  }
+
+  // Answers frontier requests with the serialized nodes, "" when missing,
+  // and the addresses of the leaves among them
+  void serve(tcp::socket& socket) {
+    try {
+      while (true) {
+        addressList::AddressValueList request;
+        if (!request.ParseFromString(readFrame(socket, timeout)) ||
+            request.pairs_size() == 0) {
+          return;
+        }
+        vector<string> keys;
+        keys.reserve(request.pairs_size());
+        for (const auto& pair : request.pairs()) {
+          keys.push_back(pair.address());
+        }
+
+        auto nodes = state.getNodes(keys);
+        auto addresses = state.addressesOf(keys);
+        addressList::AddressValueList reply;
+        for (size_t i = 0; i < keys.size(); ++i) {
+          auto* pair = reply.add_pairs();
+          pair->set_address(keys[i]);
+          if (nodes[i].hash.empty()) continue;
+          pair->set_value(state.serializeNode(nodes[i]));
+          if (keys[i].size() == 64 && !addresses[i].empty()) {
+            auto* address = reply.add_pairs();
+            address->set_address(kLeafAddressPrefix + keys[i]);
+            address->set_value(addresses[i]);
+          }
+        }
+        string serialized;
+        reply.SerializeToString(&serialized);
+        writeFrame(socket, serialized);
+      }
+    } catch (const exception& e) {
+      cerr << "State sync session ended: " << e.what() << endl;
+    }
+  }
+
+ public:
+  StateSyncServer(GlobalState& state, unsigned short port,
+                  chrono::milliseconds timeout = kSyncReadTimeout)
+      : state(state),
+        acceptor(io, tcp::endpoint(tcp::v4(), port)),
+        timeout(timeout) {}
+
+  unsigned short port() const { return acceptor.local_endpoint().port(); }
+
+  // Serves clients one at a time until stop() is called
+  void run() {
+    accept();
+    io.run();
+  }
+
+  void stop() {
+    boost::asio::post(io, [this]() { acceptor.close(); });
+    io.stop();
+  }
+};
+
+class StateSyncClient {
+ private:
+  GlobalState& state;
+  size_t batchSize;
+  size_t commitBatch;
+  chrono::milliseconds timeout;
+
+  // Commits the staged nodes once they reach commitBatch and opens the
+  // next batch
+  void commitIfFull() {
+    if (state.overlaySize() < commitBatch) return;
+    if (!state.commitOverlay()) {
+      throw runtime_error("Failed to commit state sync batch");
+    }
+    state.beginOverlay();
+  }
+
+ public:
+  size_t nodesFetched = 0;
+  size_t nodesWritten = 0;
+  size_t nodesErased = 0;
+
+  StateSyncClient(GlobalState& state, size_t batchSize = 1024,
+                  size_t commitBatch = 1 << 16,
+                  chrono::milliseconds timeout = kSyncReadTimeout)
+      : state(state),
+        batchSize(batchSize),
+        commitBatch(commitBatch),
+        timeout(timeout) {}
+
+  // Pulls the server's state and returns true if the local root matches
+  // the remote root afterwards. Local subtrees the remote lacks are erased.
+  // Writes are committed every commitBatch nodes, so memory stays bounded
+  // however far the state diverged. Each partition is marked syncing in
+  // the batch that first rewrites it, and the root is only replaced in the
+  // last batch, which clears the marks: an interrupted sync leaves the
+  // root as it was, and the next one walks the marked partitions in full.
+  bool syncFrom(const string& host, unsigned short port) {
+    nodesFetched = nodesWritten = nodesErased = 0;
+    boost::asio::io_context io;
+    tcp::socket socket(io);
+    string remoteRoot;
+    string remoteRootNode;  // serialized, written last
+    // Partitions an interrupted sync left half copied; syncing adds the
+    // ones this sync starts rewriting
+    const string resumed = state.getSyncingPartitions();
+    string syncing = resumed;
+    // a leaf was copied without its address, here or by an interrupted sync
+    bool unindexed = !resumed.empty();
+
+    state.beginOverlay();
+    try {
+      tcp::resolver resolver(io);
+      boost::asio::connect(socket, resolver.resolve(host, to_string(port)));
+
+      vector<string> frontier = {"rootNode"};
+      while (!frontier.empty()) {
+        vector<string> next;
+        for (size_t start = 0; start < frontier.size(); start += batchSize) {
+          size_t end = min(frontier.size(), start + batchSize);
+          addressList::AddressValueList request;
+          for (size_t i = start; i < end; ++i) {
+            request.add_pairs()->set_address(frontier[i]);
+          }
+          string serialized;
+          request.SerializeToString(&serialized);
+          writeFrame(socket, serialized);
+
+          addressList::AddressValueList reply;
+          if (!reply.ParseFromString(readFrame(socket, timeout))) {
+            throw runtime_error("Malformed state sync reply");
+          }
+          unordered_map<string, string> copiedLeaves;  // key hash -> value
+          for (const auto& pair : reply.pairs()) {
+            if (pair.value().empty()) continue;
+            const string& address = pair.address();
+            if (address.compare(0, kLeafAddressPrefix.size(),
+                                kLeafAddressPrefix) == 0) {
+              auto copied =
+                  copiedLeaves.find(address.substr(kLeafAddressPrefix.size()));
+              if (copied != copiedLeaves.end()) {
+                state.indexLeaf(pair.value(), copied->first, copied->second);
+                copiedLeaves.erase(copied);
+              }
+              continue;
+            }
+            ++nodesFetched;
+            auto remote = state.deserializeNode(pair.value());
+            bool isRoot = address == "rootNode";
+            if (isRoot) remoteRoot = remote.hash;
+            auto local = state.getNode(address);
+            if (local.hash == remote.hash) {
+              // An interrupted sync may have copied this node but not all
+              // of its subtree, so marked partitions are walked again
+              if (isRoot ? !resumed.empty()
+                         : resumed.find(address[0]) != string::npos) {
+                next.insert(next.end(), remote.children.begin(),
+                            remote.children.end());
+              }
+              continue;
+            }
+            if (!isRoot && syncing.find(address[0]) == string::npos) {
+              syncing += address[0];
+              state.setSyncingPartitions(syncing);
+            }
+
+            // Drop local children the remote lacks, so no orphaned leaf is
+            // read or relinked later, then copy the node verbatim and
+            // descend into its children
+            for (const auto& child : local.children) {
+              if (find(remote.children.begin(), remote.children.end(),
+                       child) == remote.children.end()) {
+                nodesErased += state.eraseSubtree(child);
+              }
+            }
+            if (isRoot) {
+              remoteRootNode = pair.value();
+            } else {
+              state.putNode(address, remote);
+            }
+            if (address.size() == 64) copiedLeaves[address] = remote.value;
+            ++nodesWritten;
+            next.insert(next.end(), remote.children.begin(),
+                        remote.children.end());
+          }
+          unindexed = unindexed || !copiedLeaves.empty();
+          commitIfFull();
+        }
+        frontier.swap(next);
+      }
+      writeFrame(socket, "");
+    } catch (const exception& e) {
+      // Batches already committed stay, marked for the next sync
+      cerr << "State sync failed: " << e.what() << endl;
+      state.discardOverlay();
+      return false;
+    }
+
+    if (!remoteRootNode.empty()) {
+      state.putNode("rootNode", state.deserializeNode(remoteRootNode));
+    }
+    if (!syncing.empty()) state.setSyncingPartitions("");
+    if (!state.commitOverlay()) return false;
+    // Without the address the index entry may be stale; find it by value
+    if (unindexed) state.reconcileAddressIndex();
+    return !remoteRoot.empty() && state.getRootHash() == remoteRoot;
+  }
+};
@@ -0,0 +1,55 @@
+#include <iostream>
+#include <string>
+
+#include "snapshotTransfer.h"
+#include "stateSync.h"
+
+// Usage:
+//   stateSync serve <dbPath> <port>
+//   stateSync pull <dbPath> <host> <port>
+//   stateSync serve-snapshots <snapshotDir> <port>
+//   stateSync fetch-snapshot <snapshotDir> <host> <port> [block]
+int main(int argc, char* argv[]) {
+  std::string mode = argc > 1 ? argv[1] : "";
+  if (mode == "serve" && argc == 4) {
+    GlobalState state(argv[2]);
+    StateSyncServer server(state, std::stoi(argv[3]));
+    std::cout << "Serving state sync on port " << server.port() << std::endl;
+    server.run();
+    return 0;
+  }
+  if (mode == "pull" && argc == 5) {
+    GlobalState state(argv[2]);
+    StateSyncClient client(state);
+    bool synced = client.syncFrom(argv[3], std::stoi(argv[4]));
+    std::cout << "Fetched " << client.nodesFetched << " nodes, wrote "
+              << client.nodesWritten << ", root "
+              << (synced ? "matches" : "differs") << std::endl;
+    return synced ? 0 : 1;
+  }
+  if (mode == "serve-snapshots" && argc == 4) {
+    SnapshotServer server(argv[2], std::stoi(argv[3]));
+    std::cout << "Serving snapshots on port " << server.port() << std::endl;
+    server.run();
+    return 0;
+  }
+  if (mode == "fetch-snapshot" && (argc == 5 || argc == 6)) {
+    SnapshotClient client(argv[2]);
+    int block = client.fetch(argv[3], std::stoi(argv[4]),
+                             argc == 6 ? std::stoi(argv[5]) : -1);
+    if (block < 0) {
+      std::cerr << "No snapshot fetched" << std::endl;
+      return 1;
+    }
+    std::cout << "Fetched snapshot of block " << block << ": "
+              << client.filesFetched << " files, " << client.bytesFetched
+              << " bytes" << std::endl;
+    return 0;
+  }
+  std::cerr << "Usage: stateSync serve <dbPath> <port>\n"
+            << "       stateSync pull <dbPath> <host> <port>\n"
+            << "       stateSync serve-snapshots <snapshotDir> <port>\n"
+            << "       stateSync fetch-snapshot <snapshotDir> <host> <port>"
+            << " [block]" << std::endl;
+  return 1;
+}
@@ -0,0 +1,274 @@
+#include <gtest/gtest.h>
+
+#include <thread>
+
+#include "snapshotTransfer.h"
+#include "stateSync.h"
+
+// Inserts key<from>..key<to-1> and rehashes the touched paths
+void fill(GlobalState& state, int from, int to, const std::string& tag) {
+  std::string keys;
+  for (int i = from; i < to; ++i) {
+    std::string key = "key" + std::to_string(i);
+    state.insert(key, tag + std::to_string(i));
+    keys += key + " ";
+  }
+  state.updateTree(keys);
+}
+
+// Test that a lagging state catches up by fetching only the divergence
+TEST(StateSyncTest, SyncsDivergedState) {
+  GlobalState source("syncSource", true);
+  GlobalState lagging("syncLagging", true);
+  fill(source, 0, 500, "value");
+  fill(lagging, 0, 500, "value");
+  fill(source, 0, 5, "updated");
+  fill(source, 500, 505, "value");
+
+  StateSyncServer server(source, 0);
+  std::thread serverThread([&server]() { server.run(); });
+
+  StateSyncClient client(lagging, 16);
+  EXPECT_TRUE(client.syncFrom("127.0.0.1", server.port()));
+  EXPECT_EQ(lagging.getRootHash(), source.getRootHash());
+  EXPECT_EQ(lagging.getValue("key3"), "updated3");
+  EXPECT_EQ(lagging.getValue("key502"), "value502");
+  std::string indexed;
+  lagging.scan("key3", 1, [&](const std::string&, const std::string& value) {
+    indexed = value;
+    return true;
+  });
+  EXPECT_EQ(indexed, "updated3");
+  // Addresses only the source held are indexed too
+  indexed.clear();
+  lagging.scan("key502", 1,
+               [&](const std::string&, const std::string& value) {
+                 indexed = value;
+                 return true;
+               });
+  EXPECT_EQ(indexed, "value502");
+  size_t divergentWrites = client.nodesWritten;
+
+  // A second sync finds equal roots and transfers nothing else
+  EXPECT_TRUE(client.syncFrom("127.0.0.1", server.port()));
+  EXPECT_EQ(client.nodesFetched, 1);
+  EXPECT_EQ(client.nodesWritten, 0);
+
+  // An empty state copies everything
+  GlobalState empty("syncEmpty", true);
+  StateSyncClient fullClient(empty);
+  EXPECT_TRUE(fullClient.syncFrom("127.0.0.1", server.port()));
+  EXPECT_EQ(empty.getRootHash(), source.getRootHash());
+  EXPECT_LT(divergentWrites * 10, fullClient.nodesWritten);
+  size_t emptyIndexed = empty.scan("key", 0, [](auto&, auto&) {
+    return true;
+  });
+  EXPECT_EQ(emptyIndexed, 505);
+
+  server.stop();
+  serverThread.join();
+}
+
+// Test that keys only the local state holds are erased, not left orphaned
+TEST(StateSyncTest, ErasesLocalOnlyKeys) {
+  GlobalState source("syncExtraSource", true);
+  GlobalState diverged("syncExtraDiverged", true);
+  fill(source, 0, 300, "value");
+  fill(diverged, 0, 300, "value");
+  fill(diverged, 300, 340, "extra");
+  fill(diverged, 0, 10, "different");
+
+  StateSyncServer server(source, 0);
+  std::thread serverThread([&server]() { server.run(); });
+  StateSyncClient client(diverged, 16);
+  EXPECT_TRUE(client.syncFrom("127.0.0.1", server.port()));
+  server.stop();
+  serverThread.join();
+
+  EXPECT_GE(client.nodesErased, 40);
+  EXPECT_EQ(diverged.getRootHash(), source.getRootHash());
+  EXPECT_EQ(diverged.getValue("key5"), "value5");
+  EXPECT_EQ(diverged.getValue("key320"), "");
+  size_t indexed = diverged.scan("key32", 0, [](const std::string&,
+                                                const std::string&) {
+    return true;
+  });
+  EXPECT_EQ(indexed, 1);  // key32 itself
+
+  // Relinking every stored leaf finds nothing the source does not hold
+  diverged.refreshPartitions("0123456789abcdef");
+  EXPECT_EQ(diverged.getRootHash(), source.getRootHash());
+}
+
+// Test that a frame longer than the limit is refused before it is read
+TEST(StateSyncTest, RejectsOversizedFrame) {
+  boost::asio::io_context io;
+  tcp::acceptor acceptor(io, tcp::endpoint(tcp::v4(), 0));
+  tcp::socket sender(io), receiver(io);
+  sender.connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(),
+                               acceptor.local_endpoint().port()));
+  acceptor.accept(receiver);
+  unsigned char header[4] = {0xff, 0xff, 0xff, 0xff};
+  boost::asio::write(sender, boost::asio::buffer(header, 4));
+  EXPECT_THROW(readFrame(receiver), std::runtime_error);
+}
+
+// Test that a sync whose server stalls gives up at the deadline, keeps
+// the batches it committed without replacing the root, and that the next
+// sync finishes the partitions it left half copied
+TEST(StateSyncTest, ResumesInterruptedSync) {
+  GlobalState source("syncResumeSource", true);
+  GlobalState lagging("syncResumeLagging", true);
+  fill(source, 0, 300, "value");
+  fill(lagging, 0, 100, "value");
+  std::string laggingRoot = lagging.getRootHash();
+
+  // Answers three requests from source, then goes silent
+  boost::asio::io_context io;
+  tcp::acceptor acceptor(io, tcp::endpoint(tcp::v4(), 0));
+  std::thread stalling([&]() {
+    tcp::socket socket(io);
+    acceptor.accept(socket);
+    try {
+      for (int round = 0; round < 3; ++round) {
+        addressList::AddressValueList request, reply;
+        request.ParseFromString(readFrame(socket));
+        std::vector<std::string> keys;
+        for (const auto& pair : request.pairs()) {
+          keys.push_back(pair.address());
+        }
+        auto nodes = source.getNodes(keys);
+        for (size_t i = 0; i < keys.size(); ++i) {
+          auto* pair = reply.add_pairs();
+          pair->set_address(keys[i]);
+          if (nodes[i].hash.empty()) continue;
+          pair->set_value(source.serializeNode(nodes[i]));
+        }
+        std::string serialized;
+        reply.SerializeToString(&serialized);
+        writeFrame(socket, serialized);
+      }
+      // Reads the next request and waits for the client to hang up
+      readFrame(socket);
+      readFrame(socket);
+    } catch (const std::exception&) {
+    }
+  });
+
+  StateSyncClient client(lagging, 16, 8, std::chrono::milliseconds(200));
+  auto started = std::chrono::steady_clock::now();
+  EXPECT_FALSE(client.syncFrom("127.0.0.1", acceptor.local_endpoint().port()));
+  EXPECT_LT(std::chrono::steady_clock::now() - started,
+            std::chrono::seconds(5));
+  stalling.join();
+  EXPECT_EQ(lagging.getRootHash(), laggingRoot);
+  EXPECT_FALSE(lagging.getSyncingPartitions().empty());
+
+  StateSyncServer server(source, 0);
+  std::thread serverThread([&server]() { server.run(); });
+  StateSyncClient resumed(lagging, 1024, 8);
+  EXPECT_TRUE(resumed.syncFrom("127.0.0.1", server.port()));
+  EXPECT_EQ(lagging.getRootHash(), source.getRootHash());
+  EXPECT_EQ(lagging.getSyncingPartitions(), "");
+  std::string indexed;
+  lagging.scan("key250", 1,
+               [&](const std::string&, const std::string& value) {
+                 indexed = value;
+                 return true;
+               });
+  EXPECT_EQ(indexed, "value250");
+  server.stop();
+  serverThread.join();
+}
+
+// Test that a failed sync leaves the local state untouched
+TEST(StateSyncTest, UnreachableServer) {
+  GlobalState state("syncUnreachable", true);
+  fill(state, 0, 10, "value");
+  std::string root = state.getRootHash();
+  StateSyncClient client(state);
+  EXPECT_FALSE(client.syncFrom("127.0.0.1", 1));
+  EXPECT_EQ(state.getRootHash(), root);
+}
+
+// Test that a snapshot restores the state it was taken from
+TEST(StateSyncTest, SnapshotRestore) {
+  std::filesystem::remove_all("syncSnapshots");
+  SnapshotStore snapshots("syncSnapshots");
+  GlobalState state("syncSnapshotState", true);
+  fill(state, 0, 200, "value");
+  std::string root = state.getRootHash();
+  ASSERT_TRUE(snapshots.take(state, 4, "blockHash4"));
+
+  fill(state, 0, 20, "updated");
+  ASSERT_NE(state.getRootHash(), root);
+  ASSERT_TRUE(snapshots.restore(state, 4));
+  EXPECT_EQ(state.getRootHash(), root);
+  EXPECT_EQ(state.getValue("key7"), "value7");
+
+  // Only the newest snapshots are kept
+  ASSERT_TRUE(snapshots.take(state, 8, "blockHash8"));
+  ASSERT_TRUE(snapshots.take(state, 12, "blockHash12"));
+  std::vector<SnapshotManifest> kept = snapshots.list();
+  ASSERT_EQ(kept.size(), defaultSnapshotsKept());
+  EXPECT_EQ(kept.back().block, 12);
+  EXPECT_EQ(kept.back().blockHash, "blockHash12");
+  std::filesystem::remove_all("syncSnapshots");
+}
+
+// Test that a snapshot whose leaf was altered after hashing is refused and
+// leaves the state as it was
+TEST(StateSyncTest, RejectsCorruptedSnapshot) {
+  std::filesystem::remove_all("syncCorruptSnapshots");
+  SnapshotStore snapshots("syncCorruptSnapshots");
+  GlobalState state("syncCorruptState", true);
+  fill(state, 0, 100, "value");
+  ASSERT_TRUE(snapshots.take(state, 3, "blockHash3"));
+  {
+    // The stored hashes, and so the stored root, stay intact
+    RocksDBBackend checkpoint(snapshots.statePath(3));
+    std::string leaf = HashEngine::hash("key7");
+    std::string data;
+    ASSERT_TRUE(checkpoint.get(leaf, &data));
+    data.replace(data.find("value7"), 6, "forged");
+    ASSERT_TRUE(checkpoint.put(leaf, data));
+  }
+
+  fill(state, 0, 5, "updated");
+  std::string root = state.getRootHash();
+  EXPECT_FALSE(snapshots.restore(state, 3));
+  EXPECT_EQ(state.getRootHash(), root);
+  EXPECT_EQ(state.getValue("key3"), "updated3");
+  std::filesystem::remove_all("syncCorruptSnapshots");
+}
+
+// Test that a snapshot streamed from a peer restores the peer's state
+TEST(StateSyncTest, StreamsSnapshot) {
+  std::filesystem::remove_all("syncServedSnapshots");
+  std::filesystem::remove_all("syncFetchedSnapshots");
+  GlobalState source("syncSnapshotSource", true);
+  fill(source, 0, 300, "value");
+  ASSERT_TRUE(SnapshotStore("syncServedSnapshots")
+                  .take(source, 6, "blockHash6"));
+
+  SnapshotServer server("syncServedSnapshots", 0);
+  std::thread serverThread([&server]() { server.run(); });
+  SnapshotClient client("syncFetchedSnapshots");
+  EXPECT_EQ(client.fetch("127.0.0.1", server.port(), 5), -1);
+  EXPECT_EQ(client.fetch("127.0.0.1", server.port()), 6);
+  EXPECT_GT(client.filesFetched, 0);
+  server.stop();
+  serverThread.join();
+
+  GlobalState fresh("syncSnapshotFresh", true);
+  ASSERT_TRUE(SnapshotStore("syncFetchedSnapshots").restore(fresh, 6));
+  EXPECT_EQ(fresh.getRootHash(), source.getRootHash());
+  EXPECT_EQ(fresh.getValue("key42"), "value42");
+  std::filesystem::remove_all("syncServedSnapshots");
+  std::filesystem::remove_all("syncFetchedSnapshots");
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}